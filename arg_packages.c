@@ -229,7 +229,7 @@ int arg_packages_size(struct arg_packages *aps)
 //        n_hash_size(aps->resolved_caps);
 }
 
-tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed)
+static tn_array *get_masks(struct arg_packages *aps, int hashed, int with_pkgs)
 {
     tn_array *masks;
     int i;
@@ -240,6 +240,9 @@ tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed)
         n_array_push(masks, n_strdup(mask));
     }
 
+    if (!with_pkgs)
+        return masks;
+
     hashed = 0;                 /* disabled for a while */
     for (i=0; i < n_array_size(aps->packages); i++) {
         struct pkg *pkg = n_array_nth(aps->packages, i);
@@ -261,6 +264,21 @@ tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed)
     return masks;
 }
 
+tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed)
+{
+    return get_masks(aps, hashed, 1);
+}
+
+tn_array *arg_packages_get_plain_masks(struct arg_packages *aps)
+{
+    return get_masks(aps, 0, 0);
+}
+
+tn_array *arg_packages_get_pkgs(struct arg_packages *aps)
+{
+    return n_ref(aps->packages);
+}
+
 
 int arg_packages_add_pkglist(struct arg_packages *aps, const char *path)
 {
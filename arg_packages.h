@@ -32,6 +32,9 @@ EXPORT void arg_packages_clean(struct arg_packages *aps);
 EXPORT int arg_packages_size(struct arg_packages *aps);
 
 EXPORT tn_array *arg_packages_get_masks(struct arg_packages *aps, int hashed);
+/* as above, but without masks made of packages added by arg_packages_add_pkg() */
+EXPORT tn_array *arg_packages_get_plain_masks(struct arg_packages *aps);
+EXPORT tn_array *arg_packages_get_pkgs(struct arg_packages *aps);
 
 EXPORT int arg_packages_add_pkgmask(struct arg_packages *aps, const char *mask);
 EXPORT int arg_packages_add_pkgmaska(struct arg_packages *aps, tn_array *masks);
@@ -336,3 +336,26 @@ struct capreq_idx_ent *capreq_idx_lookup(struct capreq_idx *idx,
 
     return ent;
 }
+
+/* read-only variant of capreq_idx_lookup(), safe to call from many threads
+   at once; pkgs is valid as long as the index is not modified */
+int capreq_idx_lookup_pkgs(const struct capreq_idx *idx,
+                           const char *capname, int capname_len,
+                           struct pkg *const **pkgs)
+{
+    const struct capreq_idx_ent *ent;
+    unsigned hash = n_hash_compute_hash(idx->ht, capname, capname_len);
+
+    if ((ent = n_hash_hget(idx->ht, capname, capname_len, hash)) == NULL)
+        return 0;
+
+    if (ent->items == 0)
+        return 0;
+
+    if (ent->_size == 1)        /* not transformed, single package */
+        *pkgs = &ent->crent_pkg;
+    else
+        *pkgs = ent->crent_pkgs;
+
+    return ent->items;
+}
@@ -53,4 +53,9 @@ void capreq_idx_remove(struct capreq_idx *idx, const char *capname,
 const struct capreq_idx_ent *capreq_idx_lookup(struct capreq_idx *idx,
                                                const char *capname, int capname_len);
 
+/* thread-safe lookup, RET: number of packages in *pkgs */
+int capreq_idx_lookup_pkgs(const struct capreq_idx *idx,
+                           const char *capname, int capname_len,
+                           struct pkg *const **pkgs);
+
 #endif /* POLDEK_CAPREQIDX_H */
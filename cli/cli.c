@@ -32,12 +32,14 @@
 #include "compiler.h"
 #include <sigint/sigint.h>
 #include "pkgdir/pkgdir.h"
+#include "pm/pm.h"
 #include "i18n.h"
 #include "log.h"
 #include "conf.h"
 #include "cli.h"
 #include "cmd_chain.h"
 #include "cmd_pipe.h"
+#include "search_idx.h"
 
 static unsigned argp_parse_flags = ARGP_NO_EXIT;
 
@@ -55,6 +57,7 @@ extern struct poclidek_cmd command_external;
 extern struct poclidek_cmd command_help;
 extern struct poclidek_cmd command_alias;
 extern struct poclidek_cmd command_reload;
+extern struct poclidek_cmd command_export;
 
 static struct poclidek_cmd *commands_tab[] = {
     &command_ls,
@@ -69,6 +72,7 @@ static struct poclidek_cmd *commands_tab[] = {
     &command_help,
     &command_alias,
     &command_reload,
+    &command_export,
     NULL
 };
 
@@ -373,6 +377,17 @@ int cmdctx_printf_c(struct cmdctx *cmdctx, int color, const char *fmt, ...)
     return n;
 }
 
+int cmdctx_write(struct cmdctx *cmdctx, const char *buf, int size)
+{
+    if (size <= 0)
+        return 0;
+
+    if (cmdctx->pipe_right)
+        return cmd_pipe_write(cmdctx->pipe_right, buf, size);
+
+    return fwrite(buf, 1, size, stdout);
+}
+
 int cmdctx_addtoresult(struct cmdctx *cmdctx, struct pkg *pkg)
 {
     if (cmdctx->pipe_right)
@@ -580,6 +595,9 @@ void poclidek_destroy(struct poclidek_ctx *cctx)
         pkgdir_free(cctx->dbpkgdir);
     }
 
+    if (cctx->search_idx)
+        search_idx_free(cctx->search_idx);
+
     n_alloc_free(cctx->_dent_na);
     n_array_free(cctx->commands);
 
@@ -767,7 +785,17 @@ int poclidek_exec_cmd_ent(struct poclidek_ctx *cctx, struct poldek_ts *ts,
 
         cmdctx.pipe_left = pipe;
 
-        if (ent->cmd->flags & COMMAND_PIPE_XARGS) {
+        if ((ent->cmd->flags & COMMAND_PIPE_XARGS) &&
+            (ent->cmd->flags & COMMAND_PIPE_PACKAGES) &&
+            cmd_pipe_size(pipe, CMD_PIPE_CTX_PACKAGES) > 0) {
+            struct pkg *pkg;
+
+            /* pass packages as they are, not as names to resolve again */
+            while ((pkg = cmd_pipe_getpkg(pipe)))
+                poldek_ts_add_pkg(cmdctx.ts, pkg);
+            cmdctx.rtflags |= CMDCTX_GOTARGS;
+
+        } else if (ent->cmd->flags & COMMAND_PIPE_XARGS) {
             if (ent->cmd->flags & COMMAND_PIPE_PACKAGES)
                 pipe_args = cmd_pipe_xargs(pipe, CMD_PIPE_CTX_PACKAGES);
             else
@@ -832,6 +860,11 @@ int do_poclidek_execline(struct poclidek_ctx *cctx, struct poldek_ts *ts,
             rc = poclidek_exec_cmd_ent(cctx, ts, ent, NULL);
     }
 
+    /* command done, write db changes PM defers (pset index) */
+    if (cctx->ctx && poldek_get_pmctx(cctx->ctx) &&
+        !pm_dbflush(poldek_get_pmctx(cctx->ctx)))
+        rc = 0;
+
     /* restore verbose setting */
     poldek_set_verbose(verbose);
 
@@ -883,8 +916,10 @@ void poclidek_apply_iinf(struct poclidek_ctx *cctx, struct poldek_ts *ts)
         struct pkg *pkg = n_array_nth(ts->pkgs_removed, i);
 
         pkgdir_remove_package(cctx->dbpkgdir, pkg);
-        if (ent)
+        if (ent) {
             pkg_dent_remove_pkg(ent, pkg);
+            cctx->dent_gen++;
+        }
 
         n++;
         DBGF("- %s\n", pkg_id(pkg));
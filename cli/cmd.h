@@ -51,6 +51,8 @@ struct cmdctx {
 EXPORT int cmdctx_addtoresult(struct cmdctx *cmdctx, struct pkg *pkg);
 EXPORT int cmdctx_printf(struct cmdctx *cmdctx, const char *fmt, ...);
 EXPORT int cmdctx_printf_c(struct cmdctx *cmdctx, int color, const char *fmt, ...);
+/* writes block of already formatted output */
+EXPORT int cmdctx_write(struct cmdctx *cmdctx, const char *buf, int size);
 
 /* poclidek_cmd */
 #define COMMAND_NOARGS       (1 << 0) /* cmd don't accept arguments */
@@ -121,6 +123,7 @@ EXPORT int poclidek_cmd_ncmp(struct poclidek_cmd *c1, struct poclidek_cmd *c2);
                                             */
 
 struct pkg_dent;                /* package dirent struct */
+struct search_idx;
 struct poclidek_ctx {
     unsigned            flags;
     struct poldek_ctx   *ctx;
@@ -140,7 +143,9 @@ struct poclidek_ctx {
     struct pkg_dent     *rootdir;
     struct pkg_dent     *homedir;
     struct pkg_dent     *currdir;
+    unsigned            dent_gen;    /* bumped on any dent change */
 
+    struct search_idx   *search_idx; /* search's trigram index, lazy loaded */
 };
 
 #endif
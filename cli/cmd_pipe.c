@@ -93,6 +93,11 @@ int cmd_pipe_writeline(struct cmd_pipe *p, const char *line, int len)
     return len;
 }
 
+int cmd_pipe_write(struct cmd_pipe *p, const char *buf, int size)
+{
+    return n_buf_write(p->nbuf, buf, size);
+}
+
 int cmd_pipe_printf(struct cmd_pipe *p, const char *fmt, ...)
 {
     va_list  args;
@@ -42,19 +42,42 @@
 #define RPMDBCACHE_PDIRTYPE "rpmdbcache"
 
 static
-struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload);
+struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload,
+                                     time_t *dbmtime);
+
+/*
+  Installed packages are indexed once and the index is shared with
+  transactions run by this context (see poldek_ts_dbopen()), so
+  dependency queries against installed packages do not go to rpmdb.
+*/
+static void setup_installed_index(struct poclidek_ctx *cctx,
+                                  struct pkgdir *pkgdir, time_t dbmtime)
+{
+    struct pkgdb_idx *idx = NULL;
+
+    if (dbmtime)
+        idx = pkgdb_idx_new(cctx->ctx->pmctx, cctx->ctx->ts->rootdir,
+                            dbmtime, pkgdir->pkgs, PKGDB_IDX_NOFL);
+
+    poldek__set_installed_index(cctx->ctx, idx);
+    if (idx)
+        pkgdb_idx_free(idx);
+}
 
 int poclidek__load_installed(struct poclidek_ctx *cctx, int reload)
 {
     struct pkgdir *pkgdir;
+    time_t dbmtime = 0;
     DBGF("%d\n", reload);
 
     if (cctx->dbpkgdir && !reload)
         return 0;
 
-    if ((pkgdir = load_installed_pkgdir(cctx, reload)) == NULL)
+    if ((pkgdir = load_installed_pkgdir(cctx, reload, &dbmtime)) == NULL)
         return 0;
 
+    setup_installed_index(cctx, pkgdir, dbmtime);
+
     poclidek_dent_setup(cctx, POCLIDEK_INSTALLEDDIR, pkgdir->pkgs, reload);
 
     if (cctx->dbpkgdir)
@@ -121,7 +144,8 @@ char *mkrpmdb_path(char *path, size_t size, const char *root, const char *dbpath
 
 
 static
-struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
+struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload,
+                                     time_t *dbmtime)
 {
     char             rpmdb_path[PATH_MAX], dbcache_path[PATH_MAX], dbpath[PATH_MAX];
     const char       *lc_lang;
@@ -129,6 +153,7 @@ struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
     struct pm_ctx    *pmctx;
     struct poldek_ts *ts = cctx->ctx->ts; /* for short */
     unsigned         ldflags = PKGDIR_LD_NOUNIQ;
+    time_t           mtime_rpmdb;
 
     if (ts->getop(ts, POLDEK_OP_AUTODIRDEP))
         ldflags |= PKGDIR_LD_DIRINDEX;
@@ -155,12 +180,14 @@ struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
 
     ldflags |= PKGDIR_LD_DIRINDEX;
 
+    /* taken before loading, so changes made meanwhile are not missed */
+    mtime_rpmdb = pm_dbmtime(pmctx, rpmdb_path);
+
     if (!reload) {              /* use cache */
-        time_t mtime_rpmdb, mtime_dbcache;
+        time_t mtime_dbcache;
         mtime_dbcache = mtime(dbcache_path);
-        mtime_rpmdb = pm_dbmtime(pmctx, rpmdb_path);
 
-        if (mtime_rpmdb && mtime_dbcache && mtime_rpmdb < mtime_dbcache) {
+        if (mtime_rpmdb && mtime_dbcache) {
             dir = pkgdir_open_ext(dbcache_path, NULL, RPMDBCACHE_PDIRTYPE,
                                   dbpath, NULL, 0, lc_lang);
             if (dir)
@@ -171,13 +198,12 @@ struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
         }
         DBGF("%ld > %ld\n", mtime_rpmdb, mtime_dbcache);
 
-
         /*
-           outdated cache, use it as prev_dir
-           DISABLED due to no performance gain, as we have to
-           load whole rpm headers from db
+           outdated cache, use it as prev_dir: packages of untouched
+           db records (same recno, NEVR and install time) are taken
+           from it, only new or changed ones are built from headers
         */
-        if (0 && mtime_rpmdb > mtime_dbcache) {
+        if (dir && mtime_rpmdb >= mtime_dbcache) {
             prev_dir = dir;
             dir = NULL;
         }
@@ -196,12 +222,32 @@ struct pkgdir *load_installed_pkgdir(struct poclidek_ctx *cctx, int reload)
         int n = n_array_size(dir->pkgs);
         msgn(1, ngettext("%d package loaded",
                          "%d packages loaded", n), n);
+        *dbmtime = mtime_rpmdb;
     }
 
     return dir;
 }
 
 
+/* rpm database has been changed since installed packages were loaded? */
+int poclidek__installed_changed(struct poclidek_ctx *cctx)
+{
+    char         rpmdb_path[PATH_MAX], dbpath[PATH_MAX];
+    struct poldek_ts *ts = cctx->ctx->ts; /* for short */
+
+    if (cctx->dbpkgdir == NULL)
+        return 0;
+
+    if (!pm_dbpath(cctx->ctx->pmctx, dbpath, sizeof(dbpath)))
+        return 0;
+
+    if (mkrpmdb_path(rpmdb_path, sizeof(rpmdb_path),
+                     ts->rootdir, dbpath) == NULL)
+        return 0;
+
+    return pm_dbmtime(cctx->ctx->pmctx, rpmdb_path) > cctx->ts_dbpkgdir;
+}
+
 int poclidek_save_installedcache(struct poclidek_ctx *cctx,
                                  struct pkgdir *pkgdir)
 {
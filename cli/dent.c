@@ -31,6 +31,16 @@
 #include "arg_packages.h"
 #include "poldek_util.h"
 
+/*
+  Package entries of a directory are created on its first use; until
+  then the directory holds a reference to the packages array it is
+  backed by (installed or available packages).
+*/
+struct pkg_dent_lazy {
+    tn_array   *pkgs;
+    const char *pkgdir_id;      /* take pkgs of this pkgdir only */
+};
+
 static inline
 struct pkg_dent *pkg_dent_new(struct poclidek_ctx *cctx, const char *name,
                               struct pkg *pkg, int flags, const char *dirpath)
@@ -110,7 +120,11 @@ void pkg_dent_free(struct pkg_dent *ent)
         return;
     }
 
-    if (ent->flags & PKG_DENT_DIR) {
+    if (ent->flags & PKG_DENT_LAZY) {
+        n_array_free(ent->ent.lazy->pkgs); /* lazy itself is obstacked */
+        ent->ent.lazy = NULL;
+
+    } else if (ent->flags & PKG_DENT_DIR) {
         n_assert(ent->pkg_dent_ents);
         n_array_free(ent->pkg_dent_ents);
         ent->pkg_dent_ents = NULL;
@@ -125,6 +139,73 @@ void pkg_dent_free(struct pkg_dent *ent)
     //free(ent); - obstacked
 }
 
+static void dent_setup_lazy(struct poclidek_ctx *cctx, struct pkg_dent *dent,
+                            tn_array *pkgs, const char *pkgdir_id)
+{
+    struct pkg_dent_lazy *lazy;
+
+    n_assert(pkg_dent_isdir(dent));
+
+    if (dent->flags & PKG_DENT_LAZY) {
+        lazy = dent->ent.lazy;
+        n_array_free(lazy->pkgs);
+
+    } else {
+        n_assert(n_array_size(dent->pkg_dent_ents) == 0);
+        n_array_free(dent->pkg_dent_ents);
+        lazy = cctx->_dent_alloc(cctx, sizeof(*lazy));
+    }
+
+    lazy->pkgs = n_ref(pkgs);
+    lazy->pkgdir_id = pkgdir_id;
+
+    dent->ent.lazy = lazy;
+    dent->flags |= PKG_DENT_LAZY;
+    cctx->dent_gen++;
+}
+
+static void dent_load_lazy(struct poclidek_ctx *cctx, struct pkg_dent *dent)
+{
+    struct pkg_dent_lazy *lazy = dent->ent.lazy;
+    tn_array *ents;
+    int i;
+
+    ents = n_array_new(n_array_size(lazy->pkgs) + 1,
+                       (tn_fn_free)pkg_dent_free, (tn_fn_cmp)pkg_dent_cmp);
+    n_array_ctl(ents, TN_ARRAY_AUTOSORTED);
+
+    for (i=0; i < n_array_size(lazy->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(lazy->pkgs, i);
+
+        if (lazy->pkgdir_id) {  /* pkgdir's subdir */
+            if (pkg->pkgdir == NULL ||
+                n_str_ne(pkgdir_idstr(pkg->pkgdir), lazy->pkgdir_id))
+                continue;
+
+        } else if (pkg_is_scored(pkg, PKG_IGNORED)) {
+            continue;
+        }
+
+        n_array_push(ents, pkg_dent_new_pkg(cctx, pkg));
+    }
+    n_array_sort(ents);
+
+    DBGF("%s: %d ents\n", dent->name, n_array_size(ents));
+    n_array_free(lazy->pkgs);
+    dent->flags &= ~PKG_DENT_LAZY;
+    dent->pkg_dent_ents = ents;
+    cctx->dent_gen++;
+}
+
+static inline tn_array *dent_ents(struct poclidek_ctx *cctx,
+                                  struct pkg_dent *dent)
+{
+    if (dent->flags & PKG_DENT_LAZY)
+        dent_load_lazy(cctx, dent);
+
+    return dent->pkg_dent_ents;
+}
+
 static inline struct pkg *pkg_dent_getpkg(struct pkg_dent *ent)
 {
     if (ent->flags & PKG_DENT_DIR)
@@ -196,9 +277,14 @@ struct pkg_dent *pkg_dent_add_pkg(struct poclidek_ctx *cctx,
 {
     struct pkg_dent *ent;
 
+    /* not loaded yet, its pkgs array is updated by the caller */
+    if (dent->flags & PKG_DENT_LAZY)
+        return NULL;
+
     ent = pkg_dent_new_pkg(cctx, pkg);
     n_array_push(dent->pkg_dent_ents, ent);
     n_array_sort(dent->pkg_dent_ents);
+    cctx->dent_gen++;
     return ent;
 }
 
@@ -206,6 +292,9 @@ void pkg_dent_remove_pkg(struct pkg_dent *dent, struct pkg *pkg)
 {
     struct pkg_dent tmp;
 
+    if (dent->flags & PKG_DENT_LAZY) /* see pkg_dent_add_pkg() */
+        return;
+
     n_array_sort(dent->pkg_dent_ents);
     tmp.name = pkg_id(pkg);
     n_array_remove(dent->pkg_dent_ents, &tmp);
@@ -219,15 +308,17 @@ int pkg_dent_add_pkgs(struct poclidek_ctx *cctx,
 {
     int i;
     struct pkg_dent *ent;
+    tn_array *ents = dent_ents(cctx, dent);
 
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
         if (pkg_is_scored(pkg, PKG_IGNORED))
             continue;
         ent = pkg_dent_new_pkg(cctx, pkg);
-        n_array_push(dent->pkg_dent_ents, ent);
+        n_array_push(ents, ent);
     }
-    n_array_sort(dent->pkg_dent_ents);
+    n_array_sort(ents);
+    cctx->dent_gen++;
     return 1;
 }
 
@@ -273,6 +364,7 @@ int pkg_dent_replace_pkgs(struct poclidek_ctx *cctx, struct pkg_dent *dent,
 
     n_array_sort(dent->pkg_dent_ents);
     n_array_free(ents);
+    cctx->dent_gen++;
     return 1;
 }
 
@@ -325,10 +417,13 @@ struct pkg_dent *pkg_dent_add_dir(struct poclidek_ctx *cctx,
     DBGF("adddir %s, %s\n", name, path);
 
     if (parent) {
+        tn_array *ents = dent_ents(cctx, parent);
+
         ent->parent = parent;
-        n_array_push(parent->pkg_dent_ents, ent);
-        n_array_sort(parent->pkg_dent_ents);
+        n_array_push(ents, ent);
+        n_array_sort(ents);
     }
+    cctx->dent_gen++;
     return ent;
 }
 
@@ -357,20 +452,12 @@ char *poclidek_dent_dirpath(char *path, int size, const struct pkg_dent *dent)
 }
 
 
-static void dent_sort(const char *foo, void *dent)
-{
-    struct pkg_dent *ent = dent;
-    foo = foo;
-    n_assert(pkg_dent_isdir(ent));
-    n_array_sort(ent->pkg_dent_ents);
-}
-
 struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
                                      const char *path, tn_array *pkgs,
                                      int force)
 {
     struct pkgdir    *curr_pkgdir = NULL;
-    struct pkg_dent  *dest = NULL, *curr_ent = NULL;
+    struct pkg_dent  *dest = NULL;
     tn_hash          *dent_ht;
     int i, add = 0, add_subdirs = 0, replace = 0;
 
@@ -394,7 +481,11 @@ struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
 
     n_assert(dest);
     pkg_dent_clr_isstub(dest);
-    if (replace)
+
+    /* already loaded entries (stubs or previous load) are reused */
+    if ((dest->flags & PKG_DENT_LAZY) || n_array_size(dest->pkg_dent_ents) == 0)
+        dent_setup_lazy(cctx, dest, pkgs, NULL);
+    else if (replace)
         pkg_dent_replace_pkgs(cctx, dest, pkgs);
     else
         pkg_dent_add_pkgs(cctx, dest, pkgs);
@@ -409,33 +500,30 @@ struct pkg_dent *poclidek_dent_setup(struct poclidek_ctx *cctx,
     dent_ht = n_hash_new(32, NULL);
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
+        struct pkg_dent *dent;
+        const char *id;
 
-        if (pkg->pkgdir != curr_pkgdir) {
-            struct pkg_dent *dent;
-            const char *id;
-
-            n_assert(pkg->pkgdir);
-            curr_pkgdir = pkg->pkgdir;
-
-            id = pkgdir_idstr(pkg->pkgdir);
-            if ((dent = n_hash_get(dent_ht, id)) == NULL) {
-                char name[256], *p;
-                n_snprintf(name, sizeof(name), "%s", id);
-                p = name;
-                while (*p) {
-                    if (!isprint(*p)) *p = '.';
-                    p++;
-                }
-                dent = pkg_dent_add_dir(cctx, cctx->rootdir, name);
-                n_hash_insert(dent_ht, id, dent);
-            }
+        if (pkg->pkgdir == curr_pkgdir)
+            continue;
+
+        n_assert(pkg->pkgdir);
+        curr_pkgdir = pkg->pkgdir;
 
-            curr_ent = dent;
+        id = pkgdir_idstr(pkg->pkgdir);
+        if (n_hash_exists(dent_ht, id))
+            continue;
+
+        char name[256], *p;
+        n_snprintf(name, sizeof(name), "%s", id);
+        p = name;
+        while (*p) {
+            if (!isprint(*p)) *p = '.';
+            p++;
         }
-        n_array_push(curr_ent->pkg_dent_ents, pkg_dent_new_pkg(cctx, pkg));
+        dent = pkg_dent_add_dir(cctx, cctx->rootdir, name);
+        dent_setup_lazy(cctx, dent, pkgs, id);
+        n_hash_insert(dent_ht, id, dent);
     }
-
-    n_hash_map(dent_ht, dent_sort);
     n_hash_free(dent_ht);
     return dest;
 }
@@ -454,7 +542,7 @@ struct pkg_dent *get_dir_dent(struct poclidek_ctx *cctx,
     n_assert(currdir);
 
     if ((p = strchr(path, '/')) == NULL) {
-        ent = n_array_bsearch_ex(currdir->pkg_dent_ents, path,
+        ent = n_array_bsearch_ex(dent_ents(cctx, currdir), path,
                                  (tn_fn_cmp)pkg_dent_strcmp);
         return ent;
     }
@@ -498,7 +586,7 @@ int poclidek_chdir(struct poclidek_ctx *cctx, const char *path)
     }
 
     if ((p = strchr(path, '/')) == NULL) {
-        ent = n_array_bsearch_ex(cctx->currdir->pkg_dent_ents, path,
+        ent = n_array_bsearch_ex(dent_ents(cctx, cctx->currdir), path,
                                  (tn_fn_cmp)pkg_dent_strcmp);
         if (ent) {
             cctx->currdir = ent;
@@ -541,15 +629,14 @@ struct pkg_dent *poclidek_dent_ldfind(struct poclidek_ctx *cctx, const char *pat
     DBGF("path %s, currdir=%s\n", path, cctx->currdir ? cctx->currdir->name : NULL);
 
     if ((dent = poclidek_dent_find(cctx, path)) != NULL) {
-        DBGF("dent %s, stub %d, ents %d\n", dent->name, pkg_dent_isstub(dent),
-             n_array_size(dent->pkg_dent_ents));
-
         n_assert(pkg_dent_isdir(dent));
+        DBGF("dent %s, stub %d, lazy %d\n", dent->name, pkg_dent_isstub(dent),
+             (dent->flags & PKG_DENT_LAZY) != 0);
 
         if (!pkg_dent_isstub(dent))
             return dent;
 
-        if ((flags & PKG_DENT_LDFIND_STUBSOK) && n_array_size(dent->pkg_dent_ents) > 0) /* have package stubs */
+        if ((flags & PKG_DENT_LDFIND_STUBSOK) && n_array_size(dent_ents(cctx, dent)) > 0) /* have package stubs */
             return dent;
     }
 
@@ -605,7 +692,7 @@ tn_array *poclidek_get_dent_ents(struct poclidek_ctx *cctx, const char *path, un
 
     DBGF("path %s, %d\n", path, flags);
     if ((ent = poclidek_dent_ldfind(cctx, path, flags)))
-        return ent->pkg_dent_ents;
+        return dent_ents(cctx, ent);
 
     return NULL;
 }
@@ -658,16 +745,52 @@ tn_array *poclidek_resolve_dents(const char *path,
     return do_resolve(ts->aps, ents, resolve_flags);
 }
 
+/*
+  Entries of the same package built for other arches share the name,
+  so entry is matched by package, then by arch (piped packages may come
+  from other dir)
+*/
+static struct pkg_dent *find_pkg_dent(tn_array *ents, struct pkg *pkg)
+{
+    struct pkg_dent *found = NULL;
+    const char *id = pkg_id(pkg);
+    int i;
+
+    i = n_array_bsearch_idx_ex(ents, id, (tn_fn_cmp)pkg_dent_strcmp);
+    if (i < 0)
+        return NULL;
+
+    while (i > 0 && pkg_dent_strcmp(n_array_nth(ents, i - 1), id) == 0)
+        i--;
+
+    for (; i < n_array_size(ents); i++) {
+        struct pkg_dent *ent = n_array_nth(ents, i);
+
+        if (pkg_dent_strcmp(ent, id) != 0)
+            break;
+
+        if (pkg_dent_isdir(ent))
+            continue;
+
+        if (ent->pkg_dent_pkg == pkg)
+            return ent;
+
+        if (found == NULL && pkg_cmp_arch(ent->pkg_dent_pkg, pkg) == 0)
+            found = ent;
+    }
+
+    return found;
+}
 
 static
 tn_array *do_resolve(struct arg_packages *aps,
                      tn_array *ents, unsigned flags)
 {
-    tn_array *ments = NULL, *masks;
-    int i, j, nmasks;
+    tn_array *ments = NULL, *masks, *pkgs;
+    int i, j, nmasks, nmissing = 0;
     int *matches, *matches_bycmp;
 
-    masks = arg_packages_get_masks(aps, 0);
+    masks = arg_packages_get_plain_masks(aps);
     nmasks = n_array_size(masks);
 
     for (i=0; i < nmasks; i++) {
@@ -677,18 +800,40 @@ tn_array *do_resolve(struct arg_packages *aps,
         if (len > 1 && mask[len - 1] == '-')
             mask[len - 1] = '\0';
 
-        if (*mask == '*' && *(mask + 1) == '\0')
+        if (*mask == '*' && *(mask + 1) == '\0') {
+            n_array_free(masks);
             return n_ref(ents);
+        }
     }
 
+    ments = n_array_clone(ents);
+
+    /* packages (piped ones) are looked up by id, no need to match them */
+    pkgs = arg_packages_get_pkgs(aps);
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+        struct pkg_dent *ent;
+
+        if ((ent = find_pkg_dent(ents, pkg)))
+            n_array_push(ments, pkg_dent_link(ent));
+
+        else if ((flags & ARG_PACKAGES_RESOLV_MISSINGOK) == 0) {
+            logn(LOGERR, _("%s: no such package"), pkg_id(pkg));
+            nmissing++;
+        }
+    }
+    n_array_free(pkgs);
+
+    if (nmissing && (flags & ARG_PACKAGES_RESOLV_WARN_ONLY) == 0)
+        n_array_clean(ments);
+
     matches = alloca(nmasks * sizeof(*matches));
     memset(matches, 0, nmasks * sizeof(*matches));
 
     matches_bycmp = alloca(nmasks * sizeof(*matches_bycmp));
     memset(matches_bycmp, 0, nmasks * sizeof(*matches_bycmp));
 
-    ments = n_array_clone(ents);
-    for (i=0; i < n_array_size(ents); i++) {
+    for (i=0; nmasks > 0 && i < n_array_size(ents); i++) {
         struct pkg_dent *ent = n_array_nth(ents, i);
         struct pkg *pkg = NULL;
 
@@ -25,6 +25,9 @@ struct poclidek_ctx;
 #define PKG_DENT_DELETED       (1 << 1)
 #define PKG_DENT_STUB_EMPTY    (1 << 2)
 #define PKG_DENT_STUB          (1 << 3)
+#define PKG_DENT_LAZY          (1 << 4) /* ents not created yet */
+
+struct pkg_dent_lazy;
 
 struct pkg_dent {
     uint16_t         _refcnt;
@@ -34,6 +37,7 @@ struct pkg_dent {
     union {
         tn_array        *ents;
         struct pkg      *pkg;
+        struct pkg_dent_lazy *lazy; /* PKG_DENT_LAZY dirs */
     } ent;
 
     const char *name;
@@ -677,131 +677,143 @@ static void mode_t_to_str(char *str, int size, mode_t mode)
 
 
 
-static void list_files_long(struct cmdctx *cmdctx, tn_tuple *fl, int mode_octal)
-{
-    int i, j;
-    const char *fmt = "!%-10s%10s\t%s\n";
-
-
-    if (mode_octal)
-        fmt = "!%-6s%10s\t%s\n";
-
-    cmdctx_printf_c(cmdctx, PRCOLOR_YELLOW, fmt, _("mode"), _("size"), _("name"));
+struct files_show {
+    struct cmdctx   *cmdctx;
+    tn_array        *dirnames;  /* all of them, for subdirs lookup */
+    int             mode_octal;
+    int             term_width;
+    int             nents;
+};
 
-    for (i=0; i < n_tuple_size(fl); i++) {
-        struct pkgfl_ent    *flent = n_tuple_nth(fl, i);
-        char                tmpbuf[PATH_MAX];
+static int list_files_long(struct pkgfl_ent *flent, void *ptr)
+{
+    struct files_show   *fs = ptr;
+    struct cmdctx       *cmdctx = fs->cmdctx;
+    int                 j;
 
-        for (j=0; j < flent->items; j++) {
-            struct flfile *f = flent->files[j];
-            char buf[1024], *slash = "";
-            int n;
+    if (fs->nents++ == 0) {
+        const char *fmt = "!%-10s%10s\t%s\n";
 
+        if (fs->mode_octal)
+            fmt = "!%-6s%10s\t%s\n";
 
-            if (S_ISDIR(f->mode)) {
-                //struct pkgfl_ent tmpent;
+        cmdctx_printf_c(cmdctx, PRCOLOR_YELLOW, fmt, _("mode"), _("size"),
+                        _("name"));
+    }
 
-                if (*flent->dirname != '/')
-                    slash = "/";
-                snprintf(tmpbuf, sizeof(tmpbuf),
-                                "%s/%s", flent->dirname, f->basename);
+    for (j=0; j < flent->items; j++) {
+        struct flfile *f = flent->files[j];
+        char buf[1024], *slash = "";
+        int n;
 
-                //tmpent.dirname = tmpbuf;
-                //if (n_array_bsearch(fl, &tmpent))
-                //    continue;
-            }
+        if (S_ISDIR(f->mode) && *flent->dirname != '/')
+            slash = "/";
 
-            n = n_snprintf(buf, sizeof(buf), "%s%s%s%s%s",
-                         *flent->dirname == '/' ? "":"/",
-                         flent->dirname,
-                         *flent->dirname == '/' ? "":"/",
-                         f->basename, slash);
+        n = n_snprintf(buf, sizeof(buf), "%s%s%s%s%s",
+                       *flent->dirname == '/' ? "":"/",
+                       flent->dirname,
+                       *flent->dirname == '/' ? "":"/",
+                       f->basename, slash);
 
-            if (S_ISLNK(f->mode))
-                n += n_snprintf(&buf[n], sizeof(buf) - n, " -> %s",
-                              f->basename + strlen(f->basename) + 1);
+        if (S_ISLNK(f->mode))
+            n += n_snprintf(&buf[n], sizeof(buf) - n, " -> %s",
+                            f->basename + strlen(f->basename) + 1);
 
-            if (mode_octal) {
-                cmdctx_printf(cmdctx, "%6o%10d\t%s\n", f->mode, f->size, buf);
+        if (fs->mode_octal) {
+            cmdctx_printf(cmdctx, "%6o%10d\t%s\n", f->mode, f->size, buf);
 
-            } else {
-                char s[12];
-                mode_t_to_str(s, sizeof(s), f->mode);
-                cmdctx_printf(cmdctx, "%10s%10d\t%s\n", s, f->size, buf);
-            }
+        } else {
+            char s[12];
+            mode_t_to_str(s, sizeof(s), f->mode);
+            cmdctx_printf(cmdctx, "%10s%10d\t%s\n", s, f->size, buf);
         }
     }
+
+    return !sigint_reached();
 }
 
 
-static void list_files(struct cmdctx *cmdctx, tn_tuple *fl, int term_width)
+static int list_files(struct pkgfl_ent *flent, void *ptr)
 {
-    int i, j, ncol = 0;
-
-    for (i=0; i < n_tuple_size(fl); i++) {
-        struct pkgfl_ent    *flent = n_tuple_nth(fl, i);
-        char                tmpbuf[PATH_MAX];
-        int                 dn_printed = 0;
-
-        for (j=0; j<flent->items; j++) {
-            struct flfile *f = flent->files[j];
-            char buf[1024], *slash = "";
-            int n;
-
+    struct files_show   *fs = ptr;
+    struct cmdctx       *cmdctx = fs->cmdctx;
+    char                tmpbuf[PATH_MAX];
+    int                 j, ncol = 0, dn_printed = 0;
+
+    for (j=0; j<flent->items; j++) {
+        struct flfile *f = flent->files[j];
+        char buf[1024], *slash = "";
+        int n;
 
-            if (S_ISDIR(f->mode)) {
-                struct pkgfl_ent tmpent;
+        if (S_ISDIR(f->mode)) {
+            slash = "/";
+            if (fs->dirnames) { /* skip ones listed as dirname */
+                if (*flent->dirname == '/') /* root */
+                    n_snprintf(tmpbuf, sizeof(tmpbuf), "%s", f->basename);
+                else
+                    n_snprintf(tmpbuf, sizeof(tmpbuf), "%s/%s",
+                               flent->dirname, f->basename);
 
-                slash = "/";
-                snprintf(tmpbuf, sizeof(tmpbuf),
-                                "%s/%s", flent->dirname, f->basename);
-                tmpent.dirname = tmpbuf;
-                if (n_tuple_bsearch_ex(fl, &tmpent, (tn_fn_cmp)pkgfl_ent_cmp))
+                if (n_array_bsearch(fs->dirnames, tmpbuf))
                     continue;
             }
+        }
 
-            if (!dn_printed) {
-                ncol = cmdctx_printf_c(cmdctx, PRCOLOR_BLUE | PRAT_BOLD,
-                                       "%s%s:  ",
-                                       *flent->dirname == '/' ? "":"/",
-                                       flent->dirname);
-                dn_printed = 1;
-            }
-
-
-            n = n_snprintf(buf, sizeof(buf), "%s%s", f->basename, slash);
+        if (!dn_printed) {
+            ncol = cmdctx_printf_c(cmdctx, PRCOLOR_BLUE | PRAT_BOLD,
+                                   "%s%s:  ",
+                                   *flent->dirname == '/' ? "":"/",
+                                   flent->dirname);
+            dn_printed = 1;
+        }
 
-            if (S_ISLNK(f->mode))
-                n += n_snprintf(&buf[n], sizeof(buf) - n, " -> %s",
-                              f->basename + strlen(f->basename) + 1);
+        n = n_snprintf(buf, sizeof(buf), "%s%s", f->basename, slash);
 
-            if (ncol + n >= term_width) {
-                ncol = SUBIDENT;
-                nlident(cmdctx, ncol);
-            }
+        if (S_ISLNK(f->mode))
+            n += n_snprintf(&buf[n], sizeof(buf) - n, " -> %s",
+                            f->basename + strlen(f->basename) + 1);
 
-            ncol += cmdctx_printf(cmdctx, "%s%s", buf, j + 1 < flent->items ? ", " : "");
+        if (ncol + n >= fs->term_width) {
+            ncol = SUBIDENT;
+            nlident(cmdctx, ncol);
         }
 
-        if (dn_printed)
-            cmdctx_printf(cmdctx, "\n");
+        ncol += cmdctx_printf(cmdctx, "%s%s", buf, j + 1 < flent->items ? ", " : "");
     }
+
+    if (dn_printed)
+        cmdctx_printf(cmdctx, "\n");
+
+    return !sigint_reached();
 }
 
+static int add_dirname(struct pkgfl_ent *flent, void *ptr)
+{
+    tn_array *dirnames = ptr;
+
+    n_array_push(dirnames, n_strdup(flent->dirname));
+    return 1;
+}
 
+/* file list is streamed from the index, without loading it whole */
 static void show_files(struct cmdctx *cmdctx, struct pkg *pkg, int longfmt, int term_width)
 {
-    struct pkgflist *flist;
+    struct files_show fs;
 
-    if ((flist = pkg_get_flist(pkg)) == NULL)
-        return;
+    memset(&fs, 0, sizeof(fs));
+    fs.cmdctx = cmdctx;
+    fs.term_width = term_width;
+
+    if (!longfmt) {             /* dirnames first, files are skipped */
+        fs.dirnames = n_array_new(64, free, (tn_fn_cmp)strcmp);
+        pkg_flist_map(pkg, PKGFL_MAP_DIRNAMES, add_dirname, fs.dirnames);
+        n_array_sort(fs.dirnames);
+    }
 
-    if (longfmt)
-        list_files_long(cmdctx, flist->fl, 0);
-    else
-        list_files(cmdctx, flist->fl, term_width);
+    pkg_flist_map(pkg, 0, longfmt ? list_files_long : list_files, &fs);
 
-    pkgflist_free(flist);
+    if (fs.dirnames)
+        n_array_free(fs.dirnames);
 }
 
 static
@@ -1085,6 +1097,8 @@ static int desc(struct cmdctx *cmdctx)
             pkgu = NULL;
         }
 
+        cmdctx_addtoresult(cmdctx, pkg);
+
         if (sigint_reached())
             goto l_end;
     }
@@ -0,0 +1,632 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Machine readable dump of package metadata, one record per package,
+  either as JSON Lines or as binary record stream:
+
+    stream := "PEX1" record*
+    record := uint32 size, field*    (size of fields in bytes)
+    field  := uint8 tag, uint32 size, data
+
+  Integers are big endian. String data is not NUL terminated.
+  Dependencies are stored as "name\0relation\0evr", relation and evr
+  are empty for unversioned ones. Array fields (dependencies, files)
+  are repeated once per item. See EXPORT_TAG_* for tags.
+
+  JSON strings are valid UTF-8, bytes which are not are replaced with
+  U+FFFD; binary records keep them as they are.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+
+#include <trurl/trurl.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkg.h"
+#include "pkgfl.h"
+#include "pkgu.h"
+#include "capreq.h"
+#include "pkgcmp.h"
+#include "pkgdir/pkgdir.h"
+#include "sigint/sigint.h"
+#include "cli.h"
+#include "export.h"
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static int export(struct cmdctx *cmdctx);
+
+#define OPT_EXPORT_BINARY     EXPORT_REC_BINARY /* cmd_state->flags */
+#define OPT_EXPORT_NOFILES    EXPORT_REC_NOFILES
+#define OPT_EXPORT_NODESC     EXPORT_REC_NODESC
+#define OPT_EXPORT_INSTALLED  (1 << 8)
+
+#define OPT_NOFILES  1001
+#define OPT_NODESC   1002
+
+static struct argp_option options[] = {
+ { "binary", 'b', 0, 0, N_("Write binary records instead of JSON Lines"), 1},
+ { "output", 'o', "FILE", 0, N_("Write to FILE instead of standard output"), 1},
+ { "dir", 'd', "DIR", 0, N_("Export packages from DIR instead of current one"), 1},
+ { "installed", 'I', 0, 0, N_("Export installed packages"), 1},
+ { "no-files", OPT_NOFILES, 0, 0, N_("Do not export file lists"), 1},
+ { "no-desc", OPT_NODESC, 0, 0, N_("Do not export descriptions"), 1},
+ { 0, 0, 0, 0, 0, 0 },
+};
+
+struct export_args {
+    char *dir;
+    char *output;
+};
+
+static void *export_args_new(void)
+{
+    return n_calloc(1, sizeof(struct export_args));
+}
+
+static void export_args_free(void *ptr)
+{
+    struct export_args *args = ptr;
+
+    n_cfree(&args->dir);
+    n_cfree(&args->output);
+    free(args);
+}
+
+struct poclidek_cmd command_export = {
+    COMMAND_EMPTYARGS | COMMAND_PIPEABLE_LEFT |
+    COMMAND_PIPE_XARGS | COMMAND_PIPE_PACKAGES,
+    "export", N_("[PACKAGE...]"), N_("Dump package metadata in machine readable form"),
+    options, parse_opt, NULL, export,
+    export_args_new, export_args_free, NULL, NULL, NULL, 0, 0
+};
+
+static
+error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct cmdctx *cmdctx = state->input;
+    struct export_args *args = cmdctx->_data;
+
+    switch (key) {
+        case 'b':
+            cmdctx->_flags |= OPT_EXPORT_BINARY;
+            break;
+
+        case 'o':
+            n_cfree(&args->output);
+            args->output = n_strdup(arg);
+            break;
+
+        case 'd':
+            n_cfree(&args->dir);
+            args->dir = n_strdup(arg);
+            break;
+
+        case 'I':
+            cmdctx->_flags |= OPT_EXPORT_INSTALLED;
+            break;
+
+        case OPT_NOFILES:
+            cmdctx->_flags |= OPT_EXPORT_NOFILES;
+            break;
+
+        case OPT_NODESC:
+            cmdctx->_flags |= OPT_EXPORT_NODESC;
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/* binary record tags */
+#define EXPORT_TAG_NAME        'N'
+#define EXPORT_TAG_EPOCH       'E'
+#define EXPORT_TAG_VERSION     'V'
+#define EXPORT_TAG_RELEASE     'R'
+#define EXPORT_TAG_ARCH        'A'
+#define EXPORT_TAG_OS          'O'
+#define EXPORT_TAG_SIZE        'S'
+#define EXPORT_TAG_FSIZE       'z'
+#define EXPORT_TAG_BTIME       'b'
+#define EXPORT_TAG_GROUP       'g'
+#define EXPORT_TAG_SOURCERPM   'r'
+#define EXPORT_TAG_PROVIDE     'P'
+#define EXPORT_TAG_REQUIRE     'Q'
+#define EXPORT_TAG_SUGGEST     'W'
+#define EXPORT_TAG_CONFLICT    'C'
+#define EXPORT_TAG_OBSOLETE    'o'
+#define EXPORT_TAG_FILE        'F'
+#define EXPORT_TAG_SUMMARY     's'
+#define EXPORT_TAG_DESCRIPTION 'd'
+#define EXPORT_TAG_URL         'u'
+#define EXPORT_TAG_LICENSE     'l'
+#define EXPORT_TAG_VENDOR      'v'
+#define EXPORT_TAG_BUILDHOST   'h'
+
+#define EXPORT_MAGIC       "PEX1"
+#define EXPORT_BLOCK_SIZE  (64 * 1024)
+
+struct export_out {
+    struct cmdctx *cmdctx;
+    FILE          *stream;      /* NULL => cmdctx output */
+    tn_buf        *nbuf;        /* pending output */
+    int           binary;
+    int           nfields;      /* JSON fields written in current record */
+    int           err;
+};
+
+static void out_flush(struct export_out *out)
+{
+    int size = n_buf_size(out->nbuf);
+
+    if (size == 0)
+        return;
+
+    if (out->stream == NULL)
+        cmdctx_write(out->cmdctx, n_buf_ptr(out->nbuf), size);
+
+    else if (fwrite(n_buf_ptr(out->nbuf), 1, size, out->stream) != (size_t)size)
+        out->err = errno ? errno : EIO;
+
+    n_buf_clean(out->nbuf);
+}
+
+static void put_be32(tn_buf *nbuf, uint32_t v)
+{
+    unsigned char b[4];
+
+    b[0] = v >> 24;
+    b[1] = v >> 16;
+    b[2] = v >> 8;
+    b[3] = v;
+    n_buf_write(nbuf, b, sizeof(b));
+}
+
+/* length of valid UTF-8 sequence at s, 0 if there is none */
+static int utf8_seqlen(const unsigned char *s)
+{
+    unsigned char lo = 0x80, hi = 0xbf;
+    int i, len;
+
+    if (*s < 0x80)
+        return 1;
+
+    if (*s >= 0xc2 && *s <= 0xdf)
+        len = 2;
+    else if (*s >= 0xe0 && *s <= 0xef)
+        len = 3;
+    else if (*s >= 0xf0 && *s <= 0xf4)
+        len = 4;
+    else
+        return 0;
+
+    /* no overlongs, surrogates or code points above U+10FFFF */
+    if (*s == 0xe0)
+        lo = 0xa0;
+    else if (*s == 0xed)
+        hi = 0x9f;
+    else if (*s == 0xf0)
+        lo = 0x90;
+    else if (*s == 0xf4)
+        hi = 0x8f;
+
+    for (i = 1; i < len; i++) {
+        if (s[i] < lo || s[i] > hi)
+            return 0;
+        lo = 0x80;
+        hi = 0xbf;
+    }
+
+    return len;
+}
+
+/* bytes not being valid UTF-8 are replaced with U+FFFD */
+static void json_str(tn_buf *nbuf, const char *s)
+{
+    const char *p = s;
+
+    n_buf_putc(nbuf, '"');
+    while (*p) {
+        const char *q = p;
+        int len;
+
+        while (*q && *q != '"' && *q != '\\' && (unsigned char)*q >= 0x20) {
+            if ((len = utf8_seqlen((const unsigned char*)q)) == 0)
+                break;
+            q += len;
+        }
+
+        if (q > p)
+            n_buf_write(nbuf, p, q - p);
+
+        if (*q == '\0')
+            break;
+
+        switch (*q) {
+            case '"':  n_buf_puts(nbuf, "\\\""); break;
+            case '\\': n_buf_puts(nbuf, "\\\\"); break;
+            case '\n': n_buf_puts(nbuf, "\\n"); break;
+            case '\t': n_buf_puts(nbuf, "\\t"); break;
+            default:
+                if ((unsigned char)*q >= 0x80)
+                    n_buf_puts(nbuf, "\\ufffd");
+                else
+                    n_buf_printf(nbuf, "\\u%.4x", (unsigned char)*q);
+        }
+        p = q + 1;
+    }
+    n_buf_putc(nbuf, '"');
+}
+
+static void json_key(struct export_out *out, const char *key)
+{
+    if (out->nfields++ > 0)
+        n_buf_putc(out->nbuf, ',');
+
+    json_str(out->nbuf, key);
+    n_buf_putc(out->nbuf, ':');
+}
+
+static void put_str(struct export_out *out, int tag, const char *key,
+                    const char *val)
+{
+    if (val == NULL)
+        return;
+
+    if (out->binary) {
+        int len = strlen(val);
+
+        n_buf_add_int8(out->nbuf, tag);
+        put_be32(out->nbuf, len);
+        n_buf_write(out->nbuf, val, len);
+
+    } else {
+        json_key(out, key);
+        json_str(out->nbuf, val);
+    }
+}
+
+static void put_int(struct export_out *out, int tag, const char *key,
+                    uint32_t val)
+{
+    if (out->binary) {
+        n_buf_add_int8(out->nbuf, tag);
+        put_be32(out->nbuf, sizeof(uint32_t));
+        put_be32(out->nbuf, val);
+
+    } else {
+        json_key(out, key);
+        n_buf_printf(out->nbuf, "%u", val);
+    }
+}
+
+static const char *capreq_relstr(const struct capreq *cr, char *buf)
+{
+    char *p = buf;
+
+    if (cr->cr_relflags & REL_LT)
+        *p++ = '<';
+    else if (cr->cr_relflags & REL_GT)
+        *p++ = '>';
+
+    if (cr->cr_relflags & REL_EQ)
+        *p++ = '=';
+
+    *p = '\0';
+    return buf;
+}
+
+static void capreq_strings(const struct capreq *cr, char *name, int nsize,
+                           char *rel, char *evr, int esize)
+{
+    int n = 0;
+
+    if (capreq_is_rpmlib(cr))
+        n_snprintf(name, nsize, "rpmlib(%s)", capreq_name(cr));
+    else
+        n_snprintf(name, nsize, "%s", capreq_name(cr));
+
+    *evr = '\0';
+    if (capreq_has_epoch(cr))
+        n += n_snprintf(&evr[n], esize - n, "%d:", capreq_epoch(cr));
+
+    if (capreq_has_ver(cr))
+        n += n_snprintf(&evr[n], esize - n, "%s", capreq_ver(cr));
+
+    if (capreq_has_rel(cr))
+        n += n_snprintf(&evr[n], esize - n, "-%s", capreq_rel(cr));
+
+    if (n == 0)
+        *rel = '\0';
+    else
+        capreq_relstr(cr, rel);
+}
+
+/* obsl: -1 => all, 0 => conflicts only, 1 => obsoletes only */
+static void put_capreqs(struct export_out *out, int tag, const char *key,
+                        tn_array *crs, int obsl)
+{
+    char name[1024], rel[4], evr[512];
+    int i, n = 0;
+
+    if (crs == NULL)
+        return;
+
+    for (i = 0; i < n_array_size(crs); i++) {
+        const struct capreq *cr = n_array_nth(crs, i);
+
+        if (obsl >= 0 && (capreq_is_obsl(cr) ? 1 : 0) != obsl)
+            continue;
+
+        capreq_strings(cr, name, sizeof(name), rel, evr, sizeof(evr));
+
+        if (out->binary) {
+            int nlen = strlen(name), rlen = strlen(rel), elen = strlen(evr);
+
+            n_buf_add_int8(out->nbuf, tag);
+            put_be32(out->nbuf, nlen + rlen + elen + 2);
+            n_buf_write(out->nbuf, name, nlen + 1);
+            n_buf_write(out->nbuf, rel, rlen + 1);
+            n_buf_write(out->nbuf, evr, elen);
+            continue;
+        }
+
+        if (n++ == 0) {
+            json_key(out, key);
+            n_buf_putc(out->nbuf, '[');
+        } else {
+            n_buf_putc(out->nbuf, ',');
+        }
+
+        n_buf_puts(out->nbuf, "{\"name\":");
+        json_str(out->nbuf, name);
+        if (*rel) {
+            n_buf_puts(out->nbuf, ",\"rel\":");
+            json_str(out->nbuf, rel);
+            n_buf_puts(out->nbuf, ",\"evr\":");
+            json_str(out->nbuf, evr);
+        }
+        n_buf_putc(out->nbuf, '}');
+    }
+
+    if (n > 0)
+        n_buf_putc(out->nbuf, ']');
+}
+
+static void put_files(struct export_out *out, const struct pkg *pkg)
+{
+    struct pkgflist *flist;
+    char path[PATH_MAX];
+    int i, j, n = 0;
+
+    if ((flist = pkg_get_flist(pkg)) == NULL)
+        return;
+
+    for (i = 0; i < n_tuple_size(flist->fl); i++) {
+        struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+
+        for (j = 0; j < flent->items; j++) {
+            struct flfile *f = flent->files[j];
+
+            if (*flent->dirname == '/')
+                n_snprintf(path, sizeof(path), "%s%s", flent->dirname, f->basename);
+            else
+                n_snprintf(path, sizeof(path), "/%s%s%s", flent->dirname,
+                           *f->basename ? "/" : "", f->basename);
+
+            if (out->binary) {
+                put_str(out, EXPORT_TAG_FILE, NULL, path);
+                continue;
+            }
+
+            if (n++ == 0) {
+                json_key(out, "files");
+                n_buf_putc(out->nbuf, '[');
+            } else {
+                n_buf_putc(out->nbuf, ',');
+            }
+            json_str(out->nbuf, path);
+        }
+    }
+
+    if (n > 0)
+        n_buf_putc(out->nbuf, ']');
+
+    pkgflist_free(flist);
+}
+
+static void put_uinf(struct export_out *out, const struct pkg *pkg)
+{
+    struct pkguinf *pkgu;
+
+    if ((pkgu = pkg_uinf(pkg)) == NULL)
+        return;
+
+    put_str(out, EXPORT_TAG_SUMMARY, "summary", pkguinf_get(pkgu, PKGUINF_SUMMARY));
+    put_str(out, EXPORT_TAG_DESCRIPTION, "description",
+            pkguinf_get(pkgu, PKGUINF_DESCRIPTION));
+    put_str(out, EXPORT_TAG_URL, "url", pkguinf_get(pkgu, PKGUINF_URL));
+    put_str(out, EXPORT_TAG_LICENSE, "license", pkguinf_get(pkgu, PKGUINF_LICENSE));
+    put_str(out, EXPORT_TAG_VENDOR, "vendor", pkguinf_get(pkgu, PKGUINF_VENDOR));
+    put_str(out, EXPORT_TAG_BUILDHOST, "buildhost",
+            pkguinf_get(pkgu, PKGUINF_BUILDHOST));
+
+    pkguinf_free(pkgu);
+}
+
+static void export_pkg(struct export_out *out, const struct pkg *pkg,
+                       unsigned flags)
+{
+    int offs = n_buf_size(out->nbuf);
+
+    if (out->binary)
+        put_be32(out->nbuf, 0); /* record size, set below */
+    else
+        n_buf_putc(out->nbuf, '{');
+
+    out->nfields = 0;
+
+    put_str(out, EXPORT_TAG_NAME, "name", pkg->name);
+    put_int(out, EXPORT_TAG_EPOCH, "epoch", pkg->epoch);
+    put_str(out, EXPORT_TAG_VERSION, "version", pkg->ver);
+    put_str(out, EXPORT_TAG_RELEASE, "release", pkg->rel);
+    put_str(out, EXPORT_TAG_ARCH, "arch", pkg_arch(pkg));
+    put_str(out, EXPORT_TAG_OS, "os", pkg_os(pkg));
+    put_int(out, EXPORT_TAG_SIZE, "size", pkg->size);
+    put_int(out, EXPORT_TAG_FSIZE, "fsize", pkg->fsize);
+    put_int(out, EXPORT_TAG_BTIME, "btime", pkg->btime);
+    put_str(out, EXPORT_TAG_GROUP, "group", pkg_group(pkg));
+    put_str(out, EXPORT_TAG_SOURCERPM, "sourcerpm", pkg_srcfilename_s(pkg));
+
+    put_capreqs(out, EXPORT_TAG_PROVIDE, "provides", pkg->caps, -1);
+    put_capreqs(out, EXPORT_TAG_REQUIRE, "requires", pkg->reqs, -1);
+    put_capreqs(out, EXPORT_TAG_SUGGEST, "suggests", pkg->sugs, -1);
+    put_capreqs(out, EXPORT_TAG_CONFLICT, "conflicts", pkg->cnfls, 0);
+    put_capreqs(out, EXPORT_TAG_OBSOLETE, "obsoletes", pkg->cnfls, 1);
+
+    /* lazy fields, loaded from index in package order */
+    if ((flags & OPT_EXPORT_NOFILES) == 0)
+        put_files(out, pkg);
+
+    if ((flags & OPT_EXPORT_NODESC) == 0)
+        put_uinf(out, pkg);
+
+    if (out->binary) {
+        unsigned char *rec = (unsigned char*)n_buf_ptr(out->nbuf) + offs;
+        uint32_t size = n_buf_size(out->nbuf) - offs - sizeof(uint32_t);
+
+        rec[0] = size >> 24;
+        rec[1] = size >> 16;
+        rec[2] = size >> 8;
+        rec[3] = size;
+    } else {
+        n_buf_puts(out->nbuf, "}\n");
+    }
+}
+
+void export_record(tn_buf *nbuf, const struct pkg *pkg, unsigned flags)
+{
+    struct export_out out;
+
+    memset(&out, 0, sizeof(out));
+    out.nbuf = nbuf;
+    out.binary = (flags & EXPORT_REC_BINARY) != 0;
+    export_pkg(&out, pkg, flags);
+}
+
+/*
+  Index order, so lazily loaded fields are read sequentially; indexes
+  are ordered as sources are (by priority), then by path to get the
+  same output on every run.
+*/
+static int pkg_cmp_index_order(const struct pkg *p1, const struct pkg *p2)
+{
+    const struct pkgdir *d1 = p1->pkgdir, *d2 = p2->pkgdir;
+    int rc;
+
+    if (d1 != d2) {
+        if (d1 == NULL || d2 == NULL)
+            return d1 ? 1 : -1;
+
+        if ((rc = d1->pri - d2->pri))
+            return rc;
+
+        if (d1->idxpath && d2->idxpath && (rc = strcmp(d1->idxpath, d2->idxpath)))
+            return rc;
+    }
+
+    return pkg_cmp_seqno(p1, p2);
+}
+
+static int export(struct cmdctx *cmdctx)
+{
+    struct export_args  *args = cmdctx->_data;
+    struct export_out   out;
+    tn_array            *pkgs = NULL;
+    const char          *path;
+    int                 i, err = 0;
+
+    path = poclidek_pwd(cmdctx->cctx);
+    if (cmdctx->_flags & OPT_EXPORT_INSTALLED)
+        path = POCLIDEK_INSTALLEDDIR;
+
+    if (args->dir)
+        path = args->dir;
+
+    if (poldek_ts_get_arg_count(cmdctx->ts) == 0)
+        pkgs = poclidek_get_dent_packages(cmdctx->cctx, path, 0);
+    else
+        pkgs = poclidek_resolve_packages(path, cmdctx->cctx, cmdctx->ts, 0, 0);
+
+    if (pkgs == NULL || n_array_size(pkgs) == 0) {
+        logn(LOGERR, _("%s: no packages found"), path ? path : "/");
+        err++;
+        goto l_end;
+    }
+
+    memset(&out, 0, sizeof(out));
+    out.cmdctx = cmdctx;
+    out.binary = (cmdctx->_flags & OPT_EXPORT_BINARY) != 0;
+
+    if (args->output && (out.stream = fopen(args->output, "w")) == NULL) {
+        logn(LOGERR, _("%s: open failed: %m"), args->output);
+        err++;
+        goto l_end;
+    }
+
+    out.nbuf = n_buf_new(EXPORT_BLOCK_SIZE + 4096);
+    if (out.binary)
+        n_buf_write(out.nbuf, EXPORT_MAGIC, strlen(EXPORT_MAGIC));
+
+    n_array_sort_ex(pkgs, (tn_fn_cmp)pkg_cmp_index_order);
+
+    for (i = 0; i < n_array_size(pkgs); i++) {
+        if (sigint_reached() || out.err)
+            break;
+
+        export_pkg(&out, n_array_nth(pkgs, i), cmdctx->_flags);
+        if (n_buf_size(out.nbuf) >= EXPORT_BLOCK_SIZE)
+            out_flush(&out);
+    }
+
+    out_flush(&out);
+
+    if (out.stream && fclose(out.stream) != 0 && out.err == 0)
+        out.err = errno;
+
+    if (out.err) {
+        logn(LOGERR, "%s: %s", args->output, strerror(out.err));
+        err++;
+    }
+
+    n_buf_free(out.nbuf);
+
+ l_end:
+    if (pkgs)
+        n_array_free(pkgs);
+
+    return err == 0;
+}
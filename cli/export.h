@@ -0,0 +1,27 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef POCLIDEK_EXPORT_H
+#define POCLIDEK_EXPORT_H
+
+#include <trurl/nbuf.h>
+
+struct pkg;
+
+#define EXPORT_REC_BINARY   (1 << 0) /* binary record instead of JSON line */
+#define EXPORT_REC_NOFILES  (1 << 1)
+#define EXPORT_REC_NODESC   (1 << 2)
+
+/* appends pkg's record to nbuf, see export.c for the format */
+void export_record(tn_buf *nbuf, const struct pkg *pkg, unsigned flags);
+
+#endif
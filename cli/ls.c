@@ -239,11 +239,29 @@ int pkg_cmp_lookup(struct pkg *lpkg, tn_array *pkgs,
     return found;
 }
 
+/* uses marker precomputed by index builder, parses changelog otherwise */
+static int has_security_fixes(struct pkg *pkg, time_t since)
+{
+    struct pkguinf *inf;
+    int yes;
+
+    if (pkg->flags & PKG_HAS_SECTIME)
+        return pkg->sectime > since;
+
+    if ((inf = pkg_uinf(pkg)) == NULL)
+        return 0;
+
+    yes = pkguinf_changelog_with_security_fixes(inf, since);
+    pkguinf_free(inf);
+    return yes;
+}
+
 static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
                                 tn_array *evrs)
 {
     int        found, compare_ver = 0, i;
-    tn_array   *upgradeable, *cmpto_pkgs = NULL, *srcpkgs = NULL;
+    tn_array   *upgradeable, *cmpto_pkgs = NULL;
+    tn_hash    *srcpkgs = NULL;
     char       *cmpto_path;
 
     n_assert(cmdctx->_flags & OPT_LS_UPGRADEABLE);
@@ -268,7 +286,7 @@ static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
     upgradeable = n_array_clone(ls_ents);
 
     if (cmdctx->_flags & OPT_LS_UPGRADEABLE_SEC)
-        srcpkgs = n_array_new(64, free, (tn_fn_cmp)strcmp);
+        srcpkgs = n_hash_new(64, NULL);
 
     for (i=0; i < n_array_size(ls_ents); i++) {
         struct pkg_dent  *ent;
@@ -293,12 +311,11 @@ static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
         if (cmdctx->_flags & OPT_LS_UPGRADEABLE_SEC) {
             const char *spkg = pkg_srcfilename_s(rpkg);
 
-            if (spkg && n_array_bsearch(srcpkgs, spkg)) { /* parent included, so me too */
+            if (spkg && n_hash_exists(srcpkgs, spkg)) { /* parent included, so me too */
                 found = 1;
 
             } else {
                 struct pkg *ipkg, *upkg;
-                struct pkguinf *inf;
 
                 ipkg = rpkg;
                 upkg = ent->pkg_dent_pkg;
@@ -308,20 +325,13 @@ static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
                 }
 
                 found = 0;
-                if ((inf = pkg_uinf(upkg)) == NULL)
-                    continue;
-
-                if (pkguinf_changelog_with_security_fixes(inf, ipkg->btime)) {
-                    char *sp;
-                    if ((sp = pkg_srcfilename_s(rpkg))) {
-                        n_array_push(srcpkgs, n_strdup(sp));
-                        n_array_sort(srcpkgs);
-                        DBGF("%s\n", sp);
+                if (has_security_fixes(upkg, ipkg->btime)) {
+                    if (spkg) {
+                        n_hash_insert(srcpkgs, spkg, NULL);
+                        DBGF("%s\n", spkg);
                     }
                     found = 1;
                 }
-
-                pkguinf_free(inf);
             }
         }
 
@@ -337,7 +347,8 @@ static tn_array *do_upgradeable(struct cmdctx *cmdctx, tn_array *ls_ents,
     }
 
     n_array_cfree(&cmpto_pkgs);
-    n_array_cfree(&srcpkgs);
+    if (srcpkgs)
+        n_hash_free(srcpkgs);
 
     return upgradeable;
 }
@@ -425,6 +436,17 @@ static void ls_summary(struct cmdctx *cmdctx, struct pkg *pkg)
 }
 
 
+/* --qf output is collected and written in blocks of that size */
+#define LS_QF_BLOCK_SIZE  (64 * 1024)
+
+static void qf_flush(struct cmdctx *cmdctx, tn_buf *qfout)
+{
+    if (qfout && n_buf_size(qfout) > 0) {
+        cmdctx_write(cmdctx, n_buf_ptr(qfout), n_buf_size(qfout));
+        n_buf_clean(qfout);
+    }
+}
+
 static
 int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 {
@@ -433,6 +455,7 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
     register int         incstep = 0;
     int                  term_width, term_width_div2;
     unsigned             flags;
+    tn_buf               *qfout = NULL;
 
     //printf("do_ls %d\n", n_array_size(ents));
     if (n_array_size(ents) == 0)
@@ -476,6 +499,9 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 
     hdr[sizeof(hdr) - 2] = '\n';
 
+    if (flags & OPT_LS_QUERYFMT)
+        qfout = n_buf_new(LS_QF_BLOCK_SIZE + 1024);
+
     size = 0;
     i = 0;
     incstep = 1;
@@ -493,6 +519,7 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
             break;
 
         if (pkg_dent_isdir(ent)) {
+            qf_flush(cmdctx, qfout);
             cmdctx_printf_c(cmdctx, PRCOLOR_GREEN, "%s/\n", ent->name);
             i += incstep;
             continue;
@@ -521,13 +548,17 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
 			  (term_width/7), srcrpm ? srcrpm : "(unset)");
 
         } else if (flags & OPT_LS_QUERYFMT) {
-	    char *queryfmt = NULL;
+            int off = n_buf_size(qfout);
 
-	    if ((queryfmt = lsqf_to_string(cmdctx->_data, pkg))) {
-		cmdctx_printf(cmdctx, "%s", queryfmt);
+	    if (lsqf_render(cmdctx->_data, pkg, qfout)) {
+                if (n_buf_size(qfout) >= LS_QF_BLOCK_SIZE)
+                    qf_flush(cmdctx, qfout);
 
-                n_free(queryfmt);
-	    }
+	    } else {            /* drop partially rendered line */
+                if (off > 0)
+                    cmdctx_write(cmdctx, n_buf_ptr(qfout), off);
+                n_buf_clean(qfout);
+            }
 
         } else if ((flags & OPT_LS_LONG) == 0) {
             cmdctx_printf(cmdctx, "%s\n", pkg_name);
@@ -567,13 +598,20 @@ int do_ls(const tn_array *ents, struct cmdctx *cmdctx, const tn_array *evrs)
             n_assert(0);
         }
 
-        if (flags & OPT_LS_SUMMARY)
+        if (flags & OPT_LS_SUMMARY) {
+            qf_flush(cmdctx, qfout);
             ls_summary(cmdctx, pkg);
+        }
 
         npkgs++;
         i += incstep;
     }
 
+    if (qfout) {
+        qf_flush(cmdctx, qfout);
+        n_buf_free(qfout);
+    }
+
     if (npkgs) {
         char buf[1024];
         int n;
@@ -14,12 +14,8 @@
 # include "config.h"
 #endif
 
-/* for asprintf() from stdio.h */
-#ifndef _GNU_SOURCE
-# define _GNU_SOURCE
-#endif
-
 #include <sys/stat.h>
+#include <sys/param.h>          /* for PATH_MAX */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,9 +33,6 @@
 
 #define n_strcase_eq(s, p) (strcasecmp(s, p) == 0)
 
-/* to avoid gcc warn about ignored result */
-#define do_asprintf(buf, fmt, args...)   n_assert(asprintf(buf, fmt, ## args) >= 0)
-
 static const char *invalid_format = N_("invalid format:");
 
 enum LsqfParseMode {
@@ -155,54 +148,141 @@ static const struct lsqf_tags lsqf_tags[] = {
     { LSQF_N_TAGS,              0, 0, 0, { NULL } }
 };
 
+/*
+  Per package rendering state, lives on the stack. Array sizes are
+  counted once and array items are mostly accessed in sequence, so
+  cursors of the last accessed items are kept.
+*/
 struct lsqf_pkgdata {
     const struct pkg  *pkg;
     struct pkgflist   *flist;
     struct pkguinf    *uinf;
-};
+    unsigned          loaded;   /* LSQF_LD_* */
 
-static struct lsqf_pkgdata *lsqf_pkgdata_new(const struct pkg *pkg)
-{
-    struct lsqf_pkgdata *pkgdata = NULL;
+    int               nfiles;   /* -1 => not counted yet */
+    int               ncnfls;
+    int               nobsls;
 
-    pkgdata = n_malloc(sizeof(struct lsqf_pkgdata));
+    int               fl_num;   /* last accessed file */
+    int               fl_i, fl_j;
+    int               cr_num[2]; /* last accessed conflict and obsolete */
+    int               cr_i[2];
+};
 
-    if (pkgdata) {
-	pkgdata->pkg = pkg;
-	pkgdata->flist = NULL;
-	pkgdata->uinf = NULL;
-    }
+#define LSQF_LD_FLIST (1 << 0)
+#define LSQF_LD_UINF  (1 << 1)
 
-    return pkgdata;
+static void lsqf_pkgdata_init(struct lsqf_pkgdata *pkgdata, const struct pkg *pkg)
+{
+    memset(pkgdata, 0, sizeof(*pkgdata));
+    pkgdata->pkg = pkg;
+    pkgdata->nfiles = -1;
+    pkgdata->ncnfls = -1;
+    pkgdata->nobsls = -1;
+    pkgdata->fl_num = -1;
+    pkgdata->cr_num[0] = pkgdata->cr_num[1] = -1;
 }
 
 static struct pkgflist *lsqf_pkgdata_flist(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata->flist == NULL)
+    if ((pkgdata->loaded & LSQF_LD_FLIST) == 0) {
 	pkgdata->flist = pkg_get_flist(pkgdata->pkg);
+	pkgdata->loaded |= LSQF_LD_FLIST;
+    }
 
     return pkgdata->flist;
 }
 
 static struct pkguinf *lsqf_pkgdata_uinf(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata->uinf == NULL)
+    if ((pkgdata->loaded & LSQF_LD_UINF) == 0) {
 	pkgdata->uinf = pkg_uinf(pkgdata->pkg);
+	pkgdata->loaded |= LSQF_LD_UINF;
+    }
 
     return pkgdata->uinf;
 }
 
-static void lsqf_pkgdata_free(struct lsqf_pkgdata *pkgdata)
+static void lsqf_pkgdata_destroy(struct lsqf_pkgdata *pkgdata)
 {
-    if (pkgdata) {
-	if (pkgdata->flist)
-	    pkgflist_free(pkgdata->flist);
+    if (pkgdata->flist)
+	pkgflist_free(pkgdata->flist);
+
+    if (pkgdata->uinf)
+	pkguinf_free(pkgdata->uinf);
+}
 
-	if (pkgdata->uinf)
-	    pkguinf_free(pkgdata->uinf);
+/* returns num-th file's dir entry, *j is set to file index in it */
+static struct pkgfl_ent *lsqf_pkgdata_file(struct lsqf_pkgdata *pkgdata,
+                                           struct pkgflist *flist,
+                                           int num, int *j)
+{
+    struct pkgfl_ent *flent = NULL;
+    int i, n;
 
-	n_free(pkgdata);
+    if (pkgdata->fl_num < 0 || num < pkgdata->fl_num) {
+	pkgdata->fl_num = 0;
+	pkgdata->fl_i = pkgdata->fl_j = 0;
     }
+
+    i = pkgdata->fl_i;
+    n = num - pkgdata->fl_num + pkgdata->fl_j; /* index from i-th entry start */
+
+    for (; i < n_tuple_size(flist->fl); i++) {
+	flent = n_tuple_nth(flist->fl, i);
+
+	if (flent->items <= n)
+	    n -= flent->items;
+	else
+	    break;
+    }
+
+    if (i == n_tuple_size(flist->fl))
+	return NULL;
+
+    pkgdata->fl_num = num;
+    pkgdata->fl_i = i;
+    pkgdata->fl_j = n;
+
+    *j = n;
+    return flent;
+}
+
+/* returns num-th conflict or obsolete */
+static struct capreq *lsqf_pkgdata_cnfl(struct lsqf_pkgdata *pkgdata, int obsl,
+                                        int num)
+{
+    const struct pkg *pkg = pkgdata->pkg;
+    int i, n;
+
+    if (pkg->cnfls == NULL)
+	return NULL;
+
+    if (pkgdata->cr_num[obsl] < 0 || num < pkgdata->cr_num[obsl]) {
+	n = -1;
+	i = 0;
+    } else {
+	n = pkgdata->cr_num[obsl];
+	i = pkgdata->cr_i[obsl];
+	if (n == num)
+	    return n_array_nth(pkg->cnfls, i);
+	i++;
+    }
+
+    for (; i < n_array_size(pkg->cnfls); i++) {
+	struct capreq *cr = n_array_nth(pkg->cnfls, i);
+
+	if ((capreq_is_obsl(cr) ? 1 : 0) != obsl)
+	    continue;
+
+	if (++n == num) {
+	    pkgdata->cr_num[obsl] = n;
+	    pkgdata->cr_i[obsl] = i;
+	    return cr;
+	}
+    }
+
+    return NULL;
 }
 
 static int get_tagid_by_name(char *tag)
@@ -258,32 +338,31 @@ static int capreq_snprintf_evr(char *str, size_t size, const struct capreq *cr)
     return n;
 }
 
-static char *format_date(int outfmtfnid, uint32_t time)
+static const char *format_date(char *buf, size_t size, int outfmtfnid,
+                               uint32_t t)
 {
-    char *buf = NULL, datestr[32];
-
-    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DATE) {
-	strftime(datestr, sizeof(datestr), "%c", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else if (outfmtfnid == LSQF_TAG_OUTFMTFN_DAY) {
-	strftime(datestr, sizeof(datestr), "%a %b %d %Y", gmtime((time_t *)&time));
-	do_asprintf(&buf, "%s", datestr);
-    } else {
-	do_asprintf(&buf, "%u", time);
-    }
+    time_t tt = t;
+
+    if (outfmtfnid == LSQF_TAG_OUTFMTFN_DATE)
+	strftime(buf, size, "%c", gmtime(&tt));
+    else if (outfmtfnid == LSQF_TAG_OUTFMTFN_DAY)
+	strftime(buf, size, "%a %b %d %Y", gmtime(&tt));
+    else
+	n_snprintf(buf, size, "%u", t);
 
     return buf;
 }
 
-static char *format_flags(int outfmtfnid, struct capreq *cr)
+static const char *format_flags(char *buf, size_t size, int outfmtfnid,
+                                const struct capreq *cr)
 {
-    char *buf = NULL;
+    if (cr == NULL)
+	return NULL;
 
     if (outfmtfnid == LSQF_TAG_OUTFMTFN_DEPFLAGS) {
-	char relstr[3], *p;
+	char *p = buf;
 
-	p = relstr;
-	*p = '\0';
+	*p++ = ' ';
 
 	if (cr->cr_relflags & REL_LT)
 	    *p++ = '<';
@@ -293,258 +372,248 @@ static char *format_flags(int outfmtfnid, struct capreq *cr)
 	if (cr->cr_relflags & REL_EQ)
 	    *p++ = '=';
 
+	*p++ = ' ';
 	*p = '\0';
 
-	do_asprintf(&buf, " %s ", relstr);
     } else {
-	do_asprintf(&buf, "%u", cr->cr_relflags);
+	n_snprintf(buf, size, "%u", cr->cr_relflags);
     }
 
     return buf;
 }
 
-static char *get_str_by_tagid(const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata,
-                              int num)
+static const char *format_evr(char *buf, size_t size, const struct capreq *cr)
+{
+    if (cr && capreq_snprintf_evr(buf, size, cr) > 0)
+	return buf;
+
+    return NULL;
+}
+
+/* writes tag value directly into nbuf, nothing is allocated per field */
+static void put_tag(tn_buf *nbuf, const struct lsqf_ent *ent,
+                    struct lsqf_pkgdata *pkgdata, int num)
 {
     const struct pkg *pkg = pkgdata->pkg;
     struct capreq *c = NULL;
-    char *buf = NULL, evr[32];
-    int i;
+    const char *str = NULL;
+    char buf[PATH_MAX];
+    int id = ent->tag.id;
 
-    if (lsqf_tags[ent->tag.id].need_uinf) {
+    if (lsqf_tags[id].need_uinf) {
 	struct pkguinf *pkgu = lsqf_pkgdata_uinf(pkgdata);
-	const char *str = NULL;
+	int tag = 0;
 
-	switch (ent->tag.id) {
+	switch (id) {
 	    case LSQF_TAG_BUILDHOST:
-		str = pkguinf_get(pkgu, PKGUINF_BUILDHOST);
+		tag = PKGUINF_BUILDHOST;
 		break;
 
 	    case LSQF_TAG_DESCRIPTION:
-		str = pkguinf_get(pkgu, PKGUINF_DESCRIPTION);
+		tag = PKGUINF_DESCRIPTION;
 		break;
 
 	    case LSQF_TAG_LICENSE:
-		str = pkguinf_get(pkgu, PKGUINF_LICENSE);
+		tag = PKGUINF_LICENSE;
 		break;
 
 	    case LSQF_TAG_SUMMARY:
-		str = pkguinf_get(pkgu, PKGUINF_SUMMARY);
+		tag = PKGUINF_SUMMARY;
 		break;
 
 	    case LSQF_TAG_URL:
-		str = pkguinf_get(pkgu, PKGUINF_URL);
+		tag = PKGUINF_URL;
 		break;
 
 	    case LSQF_TAG_VENDOR:
-		str = pkguinf_get(pkgu, PKGUINF_VENDOR);
+		tag = PKGUINF_VENDOR;
 		break;
 
 	    default:
 		n_assert(0);
 	}
 
-	if (str)
-	    buf = n_strdup(str);
-	else
-	    buf = n_strdup("(none)");
+	if (pkgu)
+	    str = pkguinf_get(pkgu, tag);
 
-    } else if (lsqf_tags[ent->tag.id].need_flist) {
+	if (str == NULL)
+	    str = "(none)";
+
+    } else if (lsqf_tags[id].need_flist) {
 	struct pkgflist *flist = lsqf_pkgdata_flist(pkgdata);
 	struct pkgfl_ent *flent = NULL;
-
-	if (flist) {
-	    switch (ent->tag.id) {
-		case LSQF_TAG_BASENAMES:
-    		case LSQF_TAG_FILELINKTOS:
-    		case LSQF_TAG_FILEMODES:
-    		case LSQF_TAG_FILENAMES:
-		case LSQF_TAG_FILESIZES:
-		    for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			flent = n_tuple_nth(flist->fl, i);
-
-			if (flent->items <= num)
-			    num -= flent->items;
-			else
-			    break;
-		    }
-
-		    if (ent->tag.id == LSQF_TAG_BASENAMES)
-			buf = n_strdup(flent->files[num]->basename);
-		    else if (ent->tag.id == LSQF_TAG_FILEMODES)
-			do_asprintf(&buf, "%u", flent->files[num]->mode);
-		    else if (ent->tag.id == LSQF_TAG_FILENAMES) {
-			if (*flent->dirname == '/')
-			    do_asprintf(&buf, "%s%s", flent->dirname, flent->files[num]->basename);
-			else
-			    do_asprintf(&buf, "/%s%s%s", flent->dirname,
-						      *flent->files[num]->basename ? "/" : "",
-						      flent->files[num]->basename);
-		    } else if (ent->tag.id == LSQF_TAG_FILESIZES)
-			do_asprintf(&buf, "%u", flent->files[num]->size);
+	struct flfile *f;
+	int j;
+
+	if (flist == NULL)
+	    return;
+
+	switch (id) {
+	    case LSQF_TAG_BASENAMES:
+	    case LSQF_TAG_FILELINKTOS:
+	    case LSQF_TAG_FILEMODES:
+	    case LSQF_TAG_FILENAMES:
+	    case LSQF_TAG_FILESIZES:
+		if ((flent = lsqf_pkgdata_file(pkgdata, flist, num, &j)) == NULL)
+		    return;
+
+		f = flent->files[j];
+
+		if (id == LSQF_TAG_BASENAMES)
+		    str = f->basename;
+		else if (id == LSQF_TAG_FILEMODES) {
+		    n_snprintf(buf, sizeof(buf), "%u", f->mode);
+		    str = buf;
+		} else if (id == LSQF_TAG_FILENAMES) {
+		    if (*flent->dirname == '/')
+			n_snprintf(buf, sizeof(buf), "%s%s", flent->dirname, f->basename);
 		    else
-			if (S_ISLNK(flent->files[num]->mode))
-			    buf = n_strdup(flent->files[num]->basename + strlen(flent->files[num]->basename) + 1);
+			n_snprintf(buf, sizeof(buf), "/%s%s%s", flent->dirname,
+				   *f->basename ? "/" : "", f->basename);
+		    str = buf;
+		} else if (id == LSQF_TAG_FILESIZES) {
+		    n_snprintf(buf, sizeof(buf), "%u", f->size);
+		    str = buf;
+		} else if (S_ISLNK(f->mode))
+		    str = f->basename + strlen(f->basename) + 1;
 
-		    break;
+		break;
 
-		case LSQF_TAG_DIRNAMES:
-		    flent = n_tuple_nth(flist->fl, num);
+	    case LSQF_TAG_DIRNAMES:
+		flent = n_tuple_nth(flist->fl, num);
 
-		    do_asprintf(&buf, "%s%s", *flent->dirname == '/' ? "" : "/",
-					   flent->dirname);
-		    break;
+		n_snprintf(buf, sizeof(buf), "%s%s",
+			   *flent->dirname == '/' ? "" : "/", flent->dirname);
+		str = buf;
+		break;
 
-		default:
-		    n_assert(0);
-	    }
+	    default:
+		n_assert(0);
 	}
+
     } else {
-	switch (ent->tag.id) {
+	switch (id) {
 	    case LSQF_TAG_ARCH:
-		buf = n_strdup(pkg_arch(pkg));
+		str = pkg_arch(pkg);
 		break;
 
 	    case LSQF_TAG_BUILDTIME:
-		buf = format_date(ent->tag.outfmtfnid, pkg->btime);
+		str = format_date(buf, sizeof(buf), ent->tag.outfmtfnid, pkg->btime);
 		break;
 
 	    case LSQF_TAG_CONFLICTFLAGS:
 	    case LSQF_TAG_CONFLICTS:
 	    case LSQF_TAG_CONFLICTVERSION:
+		if ((c = lsqf_pkgdata_cnfl(pkgdata, 0, num)) == NULL)
+		    break;
+
+		if (id == LSQF_TAG_CONFLICTS)
+		    str = capreq_name(c);
+		else if (id == LSQF_TAG_CONFLICTFLAGS)
+		    str = format_flags(buf, sizeof(buf), ent->tag.outfmtfnid, c);
+		else
+		    str = format_evr(buf, sizeof(buf), c);
+		break;
+
 	    case LSQF_TAG_OBSOLETEFLAGS:
 	    case LSQF_TAG_OBSOLETES:
 	    case LSQF_TAG_OBSOLETEVERSION:
-	    {
-		int n = 0;
-
-		for (i = 0; i < n_array_size(pkg->cnfls); i++) {
-		    struct capreq *cr = n_array_nth(pkg->cnfls, i);
-
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_CONFLICTFLAGS) {
-			if (!capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    } else {
-			if (capreq_is_obsl(cr)) {
-			    if (n == num) {
-				c = cr;
-				break;
-			    }
-
-			    n++;
-			}
-		    }
-		}
-
-		if (c) {
-		    if (ent->tag.id == LSQF_TAG_CONFLICTS || ent->tag.id == LSQF_TAG_OBSOLETES)
-			buf = n_strdup(capreq_name(c));
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_OBSOLETEFLAGS)
-			buf = format_flags(ent->tag.outfmtfnid, c);
-		    else if (ent->tag.id == LSQF_TAG_CONFLICTVERSION || ent->tag.id == LSQF_TAG_OBSOLETEVERSION)
-			if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-			    buf = n_strdup(evr);
+		if ((c = lsqf_pkgdata_cnfl(pkgdata, 1, num)) == NULL)
+		    break;
 
-		}
+		if (id == LSQF_TAG_OBSOLETES)
+		    str = capreq_name(c);
+		else if (id == LSQF_TAG_OBSOLETEFLAGS)
+		    str = format_flags(buf, sizeof(buf), ent->tag.outfmtfnid, c);
+		else
+		    str = format_evr(buf, sizeof(buf), c);
 		break;
-	    }
 
 	    case LSQF_TAG_EPOCH:
-		do_asprintf(&buf, "%d", pkg->epoch);
+		n_snprintf(buf, sizeof(buf), "%d", pkg->epoch);
+		str = buf;
 		break;
 
 	    case LSQF_TAG_GROUP:
-		buf = n_strdup(pkg_group(pkg));
+		str = pkg_group(pkg);
 		break;
 
 	    case LSQF_TAG_NAME:
-		buf = n_strdup(pkg->name);
+		str = pkg->name;
 		break;
 
 	    case LSQF_TAG_NVRA:
-		buf = n_strdup(pkg_id(pkg));
+		str = pkg_id(pkg);
 		break;
 
 	    case LSQF_TAG_PACKAGECOLOR:
-		do_asprintf(&buf, "%d", pkg->color);
+		n_snprintf(buf, sizeof(buf), "%d", pkg->color);
+		str = buf;
 		break;
 
 	    case LSQF_TAG_PROVIDEFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->caps, num));
+		str = format_flags(buf, sizeof(buf), ent->tag.outfmtfnid,
+				   n_array_nth(pkg->caps, num));
 		break;
 
 	    case LSQF_TAG_PROVIDES:
 		c = n_array_nth(pkg->caps, num);
-		buf = n_strdup(capreq_name(c));
+		str = capreq_name(c);
 		break;
 
 	    case LSQF_TAG_PROVIDEVERSION:
-		c = n_array_nth(pkg->caps, num);
-
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
-
+		str = format_evr(buf, sizeof(buf), n_array_nth(pkg->caps, num));
 		break;
 
 	    case LSQF_TAG_RELEASE:
-		buf = n_strdup(pkg->rel);
+		str = pkg->rel;
 		break;
 
 	    case LSQF_TAG_REQUIREFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->reqs, num));
+		str = format_flags(buf, sizeof(buf), ent->tag.outfmtfnid,
+				   n_array_nth(pkg->reqs, num));
 		break;
 
 	    case LSQF_TAG_REQUIRES:
 		c = n_array_nth(pkg->reqs, num);
 
-		if (capreq_is_rpmlib(c))
-		    do_asprintf(&buf, "rpmlib(%s)", capreq_name(c));
-		else
-		    buf = n_strdup(capreq_name(c));
-
+		if (capreq_is_rpmlib(c)) {
+		    n_snprintf(buf, sizeof(buf), "rpmlib(%s)", capreq_name(c));
+		    str = buf;
+		} else {
+		    str = capreq_name(c);
+		}
 		break;
 
 	    case LSQF_TAG_REQUIREVERSION:
-		c = n_array_nth(pkg->reqs, num);
-
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
-
+		str = format_evr(buf, sizeof(buf), n_array_nth(pkg->reqs, num));
 		break;
 
 	    case LSQF_TAG_VERSION:
-		buf = n_strdup(pkg->ver);
+		str = pkg->ver;
 		break;
 
 	    case LSQF_TAG_SIZE:
-		do_asprintf(&buf, "%u", pkg->size);
+		n_snprintf(buf, sizeof(buf), "%u", pkg->size);
+		str = buf;
 		break;
 
 	    case LSQF_TAG_SOURCERPM:
-		buf = n_strdup(pkg_srcfilename_s(pkg));
+		str = pkg_srcfilename_s(pkg);
 		break;
 
 	    case LSQF_TAG_SUGGESTSFLAGS:
-		buf = format_flags(ent->tag.outfmtfnid, n_array_nth(pkg->sugs, num));
+		str = format_flags(buf, sizeof(buf), ent->tag.outfmtfnid,
+				   n_array_nth(pkg->sugs, num));
 		break;
 
 	    case LSQF_TAG_SUGGESTS:
 		c = n_array_nth(pkg->sugs, num);
-		buf = n_strdup(capreq_name(c));
+		str = capreq_name(c);
 		break;
 
 	    case LSQF_TAG_SUGGESTSVERSION:
-		c = n_array_nth(pkg->sugs, num);
-
-		if (capreq_snprintf_evr(evr, sizeof(evr), c) > 0)
-		    buf = n_strdup(evr);
-
+		str = format_evr(buf, sizeof(buf), n_array_nth(pkg->sugs, num));
 		break;
 
 	    default:
@@ -552,7 +621,8 @@ static char *get_str_by_tagid(const struct lsqf_ent *ent, struct lsqf_pkgdata *p
 	}
     }
 
-    return buf;
+    if (str)
+	n_buf_printf(nbuf, "%*s", ent->tag.pad, str);
 }
 
 static char get_escaped_char(char zn)
@@ -890,12 +960,17 @@ static int get_tag_array_size(const struct lsqf_ent *ent, struct lsqf_pkgdata *p
 		    case LSQF_TAG_FILEMODES:
 		    case LSQF_TAG_FILENAMES:
 		    case LSQF_TAG_FILESIZES:
-			for (i = 0; i < n_tuple_size(flist->fl); i++) {
-			    struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
+			if (pkgdata->nfiles < 0) {
+			    pkgdata->nfiles = 0;
+
+			    for (i = 0; i < n_tuple_size(flist->fl); i++) {
+				struct pkgfl_ent *flent = n_tuple_nth(flist->fl, i);
 
-			    size += flent->items;
+				pkgdata->nfiles += flent->items;
+			    }
 			}
 
+			size = pkgdata->nfiles;
 			break;
 
 	    	    case LSQF_TAG_DIRNAMES:
@@ -914,25 +989,28 @@ static int get_tag_array_size(const struct lsqf_ent *ent, struct lsqf_pkgdata *p
 		case LSQF_TAG_OBSOLETEFLAGS:
 		case LSQF_TAG_OBSOLETES:
 		case LSQF_TAG_OBSOLETEVERSION:
-		    if (pkg->cnfls) {
-			int nobsl = 0, ncnfls = 0;
+		    if (pkg->cnfls == NULL)
+			break;
+
+		    if (pkgdata->ncnfls < 0) {
+			pkgdata->ncnfls = pkgdata->nobsls = 0;
 
 			for (i = 0; i < n_array_size(pkg->cnfls); i++) {
 			    struct capreq *cr = n_array_nth(pkg->cnfls, i);
 
 			    if (capreq_is_obsl(cr))
-				nobsl++;
+				pkgdata->nobsls++;
 			    else
-				ncnfls++;
+				pkgdata->ncnfls++;
 			}
-
-			if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_CONFLICTS
-			 || ent->tag.id == LSQF_TAG_CONFLICTVERSION)
-			    size = ncnfls;
-			else
-			    size = nobsl;
 		    }
 
+		    if (ent->tag.id == LSQF_TAG_CONFLICTFLAGS || ent->tag.id == LSQF_TAG_CONFLICTS
+		     || ent->tag.id == LSQF_TAG_CONFLICTVERSION)
+			size = pkgdata->ncnfls;
+		    else
+			size = pkgdata->nobsls;
+
 		    break;
 
 		case LSQF_TAG_PROVIDEFLAGS:
@@ -1000,28 +1078,12 @@ static int check_size(const struct lsqf_ent_array *array, struct lsqf_pkgdata *p
     return 0;
 }
 
-static void add_tagstr_to_nbuf(tn_buf *nbuf, const struct lsqf_ent *ent, struct lsqf_pkgdata *pkgdata, unsigned int num)
-{
-    char *str = NULL, fmt[16];
-
-    if (ent->tag.countArray) {
-	n_snprintf(fmt, sizeof(fmt), "%%%dd", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, get_tag_array_size(ent, pkgdata));
-
-    } else if ((str = get_str_by_tagid(ent, pkgdata, num))) {
-	n_snprintf(fmt, sizeof(fmt), "%%%ds", ent->tag.pad);
-	n_buf_printf(nbuf, fmt, str);
-
-	n_free(str);
-    }
-}
-
 /**
  * tags_size - number of items in tags. It's mostly used by tag-arrays (for example REQUIRES)
  */
-static int ent_array_to_string(const struct lsqf_ent_array *array,
-                               struct lsqf_pkgdata *pkgdata,
-                               tn_buf *nbuf, int tags_size)
+static int ent_array_render(const struct lsqf_ent_array *array,
+                            struct lsqf_pkgdata *pkgdata,
+                            tn_buf *nbuf, int tags_size)
 {
     unsigned i, size = 0;
     int j;
@@ -1033,11 +1095,15 @@ static int ent_array_to_string(const struct lsqf_ent_array *array,
 
 	    switch (ent->type) {
 		case LSQF_ENT_TYPE_TAG:
-		    add_tagstr_to_nbuf(nbuf, ent, pkgdata, j);
+		    if (ent->tag.countArray)
+			n_buf_printf(nbuf, "%*d", ent->tag.pad,
+				     get_tag_array_size(ent, pkgdata));
+		    else
+			put_tag(nbuf, ent, pkgdata, j);
 		    break;
 
 		case LSQF_ENT_TYPE_STRING:
-		    n_buf_puts_z(nbuf, ent->string);
+		    n_buf_puts(nbuf, ent->string);
 		    break;
 
 		case LSQF_ENT_TYPE_ARRAY:
@@ -1045,7 +1111,7 @@ static int ent_array_to_string(const struct lsqf_ent_array *array,
 			logn(LOGERR, _("%s array iterator used with different sized arrays"), invalid_format);
 			ret = 0;
 		    } else {
-			ret = ent_array_to_string(ent->array, pkgdata, nbuf, size);
+			ret = ent_array_render(ent->array, pkgdata, nbuf, size);
 		    }
 
 		    break;
@@ -1063,23 +1129,44 @@ static int ent_array_to_string(const struct lsqf_ent_array *array,
     return 1;
 }
 
+/**
+ * lsqf_render:
+ *
+ * Appends formatted pkg to nbuf. Caller is expected to reuse nbuf
+ * for subsequent packages.
+ *
+ * Returns: 0 on error, nbuf content is undefined then.
+ **/
+int lsqf_render(const struct lsqf_ent_array *array, const struct pkg *pkg,
+                tn_buf *nbuf)
+{
+    struct lsqf_pkgdata pkgdata;
+    int rc;
+
+    lsqf_pkgdata_init(&pkgdata, pkg);
+
+    /* In the first array there can't be more than one item per tag,
+     * so force tags_size = 1 */
+    rc = ent_array_render(array, &pkgdata, nbuf, 1);
+
+    lsqf_pkgdata_destroy(&pkgdata);
+
+    return rc;
+}
+
 char *lsqf_to_string(const struct lsqf_ent_array *array, const struct pkg *pkg)
 {
-    struct lsqf_pkgdata *pkgdata = NULL;
     tn_buf		*nbuf = NULL;
     char		*buf = NULL;
 
-    pkgdata = lsqf_pkgdata_new(pkg);
     nbuf = n_buf_new(64);
 
-    /* In the first array there can't be more than one item per tag,
-     * so force tags_size = 1 */
-    if (ent_array_to_string(array, pkgdata, nbuf, 1)) {
+    if (lsqf_render(array, pkg, nbuf)) {
+	n_buf_putc(nbuf, '\0');
 	buf = n_strdup(n_buf_ptr(nbuf));
     }
 
     n_buf_free(nbuf);
-    lsqf_pkgdata_free(pkgdata);
 
     return buf;
 }
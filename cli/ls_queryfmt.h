@@ -50,6 +50,8 @@ struct lsqf_ent {
 
 struct lsqf_ent_array *lsqf_parse(char *fmt);
 char                  *lsqf_to_string(const struct lsqf_ent_array *array, const struct pkg *pkg);
+int                    lsqf_render(const struct lsqf_ent_array *array, const struct pkg *pkg,
+                                   tn_buf *nbuf);
 
 struct lsqf_ent_array *lsqf_ent_array_new(void);
 void                   lsqf_ent_array_free(struct lsqf_ent_array *array);
@@ -43,6 +43,8 @@
 #endif
 
 extern int poclidek_shell(struct poclidek_ctx *cctx);
+extern int poclidek_server(struct poclidek_ctx *cctx, const char *path,
+                           char **argv);
 
 const char *argp_program_version = poldek_VERSION_BANNER;
 const char *argp_program_bug_address = poldek_BUG_MAILADDR;
@@ -73,6 +75,7 @@ static void argp_as_docbook(struct argp *argp);
 #define OPT_OPTION 'O'
 #define OPT_SHCMD             (OPT_GID + 19)
 #define OPT_NOPROGRESS          (OPT_GID + 20)
+#define OPT_SERVER            (OPT_GID + 21)
 #define OPT_DOCB              (OPT_GID + 24)
 
 #define OPT_AS_FLAG(OPT)       (1 << (OPT - OPT_GID))
@@ -100,6 +103,10 @@ static struct argp_option common_options[] = {
 {"shcmd", OPT_SHELL_CMD, "COMMAND", OPTION_HIDDEN,
                  N_("Run poldek shell COMMAND and exit"), OPT_GID },
 
+{"server", OPT_SERVER, "SOCKET", 0,
+     N_("Keep packages loaded and run shell commands read from "
+        "UNIX socket SOCKET"), OPT_GID },
+
 {"skip-installed", OPT_SKIPINSTALLED, 0, 0,
      N_("Don't load installed packages at startup"), OPT_GID },
 {"fast", 0, 0, OPTION_ALIAS | OPTION_HIDDEN, NULL, OPT_GID }, /* legacy */
@@ -175,6 +182,8 @@ struct args {
     char        *path_log;
 
     char        *shcmd;
+    char        *server_path;
+    char        **server_argv;
 
     tn_array    *opgroup_rts;
 
@@ -280,6 +289,12 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
             argsp->cnflags |= OPT_AS_FLAG(OPT_SHELL);
             break;
 
+        case OPT_SERVER:
+            argsp->server_path = arg;
+            argsp->mjrmode = MODE_SHELL;
+            argsp->cnflags |= OPT_AS_FLAG(OPT_SHELL);
+            break;
+
         case 'f':
             logn(LOGWARN, "-f is obsoleted, use --skip-installed instead");
             /* fallthru */
@@ -624,7 +639,9 @@ static int run_poldek(struct poclidek_ctx *cctx)
 {
     int rc;
 
-    if (args.shcmd)
+    if (args.server_path)
+        rc = poclidek_server(cctx, args.server_path, args.server_argv);
+    else if (args.shcmd)
         rc = poclidek_execline(cctx, args.ts, args.shcmd);
     else
         rc = poclidek_shell(cctx);
@@ -685,6 +702,7 @@ int main(int argc, char **argv)
     cctx = poclidek_new(ctx);
 
     parse_options(cctx, ts, argc, argv, mode);
+    args.server_argv = argv;
 
     if (!poldek_setup(ctx))
         exit(EXIT_FAILURE);
@@ -14,6 +14,7 @@
 # include "config.h"
 #endif
 
+#include <ctype.h>
 #include <limits.h>
 #include <stdint.h>
 #include <string.h>
@@ -23,6 +24,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef ENABLE_THREADS
+# include <pthread.h>
+#endif
+
 #define _GNU_SOURCE 1           /* for FNM_CASEFOLD (Linux, glibc) */
 #ifndef __BSD_VISIBLE           /* for FNM_CASEFOLD (FreeBSD) */
 # define POLDEK__BSD_VISIBLE 1
@@ -51,10 +56,33 @@
 #include "search.h"
 #include "pkgu.h"
 #include "cli.h"
+#include "search_idx.h"
+#include "parallel.h"
+#include "poldek_intern.h"      /* for ctx->ts->cachedir */
 
 static const unsigned char   *pcre_chartable = NULL;
 static int                    pcre_established = 0;
 
+#ifdef PCRE_STUDY_JIT_COMPILE
+# define PATTERN_STUDY_FLAGS PCRE_STUDY_JIT_COMPILE
+#else
+# define PATTERN_STUDY_FLAGS 0
+#endif
+
+/* search index is shared by workers */
+#ifdef ENABLE_THREADS
+static pthread_mutex_t idx_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define idx_lock()    pthread_mutex_lock(&idx_mutex)
+# define idx_unlock()  pthread_mutex_unlock(&idx_mutex)
+#else
+# define idx_lock()
+# define idx_unlock()
+#endif
+
+#define SEARCH_MIN_PER_WORKER      64   /* packages.dir fields searched */
+#define SEARCH_MIN_PER_WORKER_MEM  1024 /* in-memory fields only */
+#define SEARCH_PROGRESS_STEPS      40   /* progress bar length */
+
 #define PATTERN_FMASK   0
 #define PATTERN_PCRE    1
 
@@ -338,7 +366,7 @@ int pattern_compile(struct pattern *pt, int ntimes)
 
     if (ntimes > 10) {
         pcre_err = NULL;
-        pt->pcre_extra = pcre_study(pt->pcre, 0, &pcre_err);
+        pt->pcre_extra = pcre_study(pt->pcre, PATTERN_STUDY_FLAGS, &pcre_err);
         if (pt->pcre_extra == NULL && pcre_err) {
             logn(LOGERR, _("search: pattern study: %s: %s"), pt->regexp,
                  pcre_err);
@@ -362,10 +390,22 @@ int pattern_match(struct pattern *pt, const char *s, int len)
             match = (fnmatch(pt->regexp, s, pt->fnmatch_flags) == 0);
             break;
 
-        case PATTERN_PCRE:
-            if (pcre_exec(pt->pcre, pt->pcre_extra, s, len, 0, 0, NULL, 0) == 0)
+        case PATTERN_PCRE: {
+            int rc = pcre_exec(pt->pcre, pt->pcre_extra, s, len, 0, 0, NULL, 0);
+
+#ifdef PCRE_ERROR_JIT_STACKLIMIT
+            /* default JIT stack is small, retry with interpreter */
+            if (rc == PCRE_ERROR_JIT_STACKLIMIT) {
+                pcre_extra extra = *pt->pcre_extra;
+
+                extra.flags &= ~PCRE_EXTRA_EXECUTABLE_JIT;
+                rc = pcre_exec(pt->pcre, &extra, s, len, 0, 0, NULL, 0);
+            }
+#endif
+            if (rc == 0)
                 match = 1;
             break;
+        }
 
         default:
             n_assert(0);
@@ -391,13 +431,36 @@ void pattern_free(struct pattern *pt)
     }
 
     if (pt->pcre_extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+        pcre_free_study(pt->pcre_extra);
+#else
         free(pt->pcre_extra);
+#endif
         pt->pcre_extra = NULL;
     }
 
     free(pt);
 }
 
+/* returns NULL if no literal could be extracted */
+static tn_array *pattern_literals(struct pattern *pt)
+{
+    tn_array *literals = n_array_new(4, free, NULL);
+    int ok;
+
+    if (pt->type == PATTERN_FMASK)
+        ok = search_idx_fmask_literals(literals, pt->regexp);
+    else if (pt->pcre_flags & PCRE_EXTENDED) /* whitespace is not literal */
+        ok = 0;
+    else
+        ok = search_idx_pcre_literals(literals, pt->regexp);
+
+    if (!ok || n_array_size(literals) == 0)
+        n_array_cfree(&literals);
+
+    return literals;
+}
+
 
 static int fl_match(tn_tuple *fl, struct pattern *pt)
 {
@@ -441,26 +504,112 @@ l_end:
 }
 
 
-static int search_pkg_files(struct pkg *pkg, struct pattern *pt)
+/* adds the same strings fl_match() matches against */
+static void fl_index(tn_tuple *fl, struct search_idx *idx,
+                     struct search_idx_doc *doc)
+{
+    int i, j;
+
+    for (i=0; i < n_tuple_size(fl); i++) {
+        struct pkgfl_ent    *flent = n_tuple_nth(fl, i);
+        char                path[PATH_MAX], *dn;
+        int                 n;
+
+        dn = flent->dirname;
+        if (*dn == '/')
+            n = n_snprintf(path, sizeof(path), dn);
+        else
+            n = n_snprintf(path, sizeof(path), "/%s/", dn);
+
+        for (j=0; j < flent->items; j++) {
+            struct flfile *f = flent->files[j];
+            int nn;
+
+            if (S_ISLNK(f->mode))
+                search_idx_add(idx, doc, OPT_SEARCH_FL,
+                               f->basename + strlen(f->basename) + 1, 0);
+
+            nn = n_snprintf(&path[n], sizeof(path) - n, "%s", f->basename);
+            search_idx_add(idx, doc, OPT_SEARCH_FL, path, n + nn);
+        }
+    }
+}
+
+static int search_pkg_files(struct pkg *pkg, struct pattern *pt,
+                            struct search_idx *idx, struct search_idx_doc *doc)
 {
     struct pkgflist *flist;
     int       match = 0;
 
+    if (doc && !search_idx_doc_needs(doc, OPT_SEARCH_FL))
+        doc = NULL;
 
-    if (pkg->fl && fl_match(pkg->fl, pt))
+    if (doc == NULL && pkg->fl && fl_match(pkg->fl, pt))
         return 1;
 
     if ((flist = pkg_get_nodep_flist(pkg)) != NULL) {
-        match = fl_match(flist->fl, pt);
+        if (doc) {              /* index whole list before matching */
+            idx_lock();
+            if (pkg->fl)
+                fl_index(pkg->fl, idx, doc);
+            fl_index(flist->fl, idx, doc);
+            search_idx_doc_done(idx, doc, OPT_SEARCH_FL);
+            idx_unlock();
+            match = pkg->fl && fl_match(pkg->fl, pt);
+        }
+
+        if (!match)
+            match = fl_match(flist->fl, pt);
         pkgflist_free(flist);
+
+    } else if (doc && pkg->fl) {
+        match = fl_match(pkg->fl, pt);
     }
 
     return match;
 }
 
+static void uinf_index(struct pkguinf *pkgu, unsigned flags,
+                       struct search_idx *idx, struct search_idx_doc *doc)
+{
+    static const struct {
+        unsigned flag;
+        int      tag;
+    } tags[] = {
+        { OPT_SEARCH_SUMM,      PKGUINF_SUMMARY     },
+        { OPT_SEARCH_SUMM,      PKGUINF_LICENSE     },
+        { OPT_SEARCH_SUMM,      PKGUINF_URL         },
+        { OPT_SEARCH_DESC,      PKGUINF_DESCRIPTION },
+        { OPT_SEARCH_CHANGELOG, PKGUINF_CHANGELOG   },
+        { 0, 0 },
+    };
+    unsigned done = 0;
+    int i;
+
+    for (i=0; tags[i].flag; i++) {
+        const char *s;
+
+        if ((flags & tags[i].flag) == 0 ||
+            !search_idx_doc_needs(doc, tags[i].flag))
+            continue;
+
+        if ((s = pkguinf_get(pkgu, tags[i].tag)))
+            search_idx_add(idx, doc, tags[i].flag, s, 0);
+        done |= tags[i].flag;
+    }
+
+    for (i=0; tags[i].flag; i++)
+        if (done & tags[i].flag)
+            search_idx_doc_done(idx, doc, tags[i].flag);
+}
+
 
 
-static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
+/* doc is non-NULL if loaded fields should be added to the index;
+   *failed is set if package info cannot be loaded */
+static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags,
+                     struct search_idx *idx, struct search_idx_doc *doc,
+                     char *failed)
 {
     int i, match = 0;
     struct capreq *cr;
@@ -532,7 +681,7 @@ static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
     }
 
     if (flags & (OPT_SEARCH_FL))
-        if ((match = search_pkg_files(pkg, pt)))
+        if ((match = search_pkg_files(pkg, pt, idx, doc)))
             goto l_end;
 
     if (flags & (OPT_SEARCH_SUMM | OPT_SEARCH_DESC | OPT_SEARCH_CHANGELOG)) {
@@ -540,9 +689,15 @@ static int pkg_match(struct pkg *pkg, struct pattern *pt, unsigned flags)
         const char *s;
 
         if ((pkgu = pkg_uinf(pkg)) == NULL) {
-            logn(LOGERR, _("%s: load package info failed"), pkg_snprintf_s(pkg));
+            *failed = 1;
 
         } else {
+            if (doc) {
+                idx_lock();
+                uinf_index(pkgu, flags, idx, doc);
+                idx_unlock();
+            }
+
             if (flags & OPT_SEARCH_SUMM) {
                 if ((s = pkguinf_get(pkgu, PKGUINF_SUMMARY)))
                     match = pattern_match(pt, s, strlen(s));
@@ -577,15 +732,90 @@ l_end:
 }
 
 
+struct search_job {
+    tn_array               *pkgs;
+    struct pattern         *pt;
+    struct search_idx      *idx;
+    struct search_idx_doc  **docs;
+    unsigned               *flags;  /* per package search flags */
+    char                   *matched;
+    char                   *failed; /* package info load failed */
+    int                    offset;  /* of current batch */
+};
+
+/* matches packages [offset + from, offset + to); runs in worker
+   threads, so errors are recorded to be reported by the caller */
+static void search_worker(void *arg, int from, int to, int nth)
+{
+    struct search_job *job = arg;
+    int i;
+
+    nth = nth;
+    for (i = job->offset + from; i < job->offset + to; i++) {
+        struct pkg *pkg = n_array_nth(job->pkgs, i);
+
+        job->matched[i] = pkg_match(pkg, job->pt, job->flags[i], job->idx,
+                                    job->docs ? job->docs[i] : NULL,
+                                    &job->failed[i]);
+    }
+}
+
+static struct search_idx *get_search_idx(struct poclidek_ctx *cctx)
+{
+    if (cctx->search_idx == NULL) {
+        const char *cachedir = cctx->ctx->ts->cachedir;
+        char path[PATH_MAX], *p = NULL;
+
+        if (cachedir) {
+            n_snprintf(path, sizeof(path), "%s/search.trigrams", cachedir);
+            p = path;
+        }
+        cctx->search_idx = search_idx_load(p);
+    }
+
+    return cctx->search_idx;
+}
+
+static void save_search_idx(struct poclidek_ctx *cctx)
+{
+    struct search_idx *idx = cctx->search_idx;
+    const tn_array *arrs[2];
+    int i, j;
+
+    if (idx == NULL || !search_idx_isdirty(idx))
+        return;
+
+    arrs[0] = cctx->pkgs_available;
+    arrs[1] = cctx->pkgs_installed;
+
+    for (i=0; i < 2; i++) {
+        if (arrs[i] == NULL)
+            continue;
+
+        for (j=0; j < n_array_size(arrs[i]); j++)
+            search_idx_keep(idx, n_array_nth(arrs[i], j));
+    }
+
+    search_idx_prune(idx);
+    search_idx_save(idx);
+}
+
 static int search(struct cmdctx *cmdctx)
 {
     struct poclidek_ctx   *cctx = NULL;
     tn_array               *pkgs = NULL;
     tn_array               *matched_pkgs = NULL;
-    int                    i, err = 0, display_bar = 0, bar_v;
+    int                    i, n, err = 0, display_bar = 0, bar_v = 0;
     int                    term_height;
     struct pattern         *pt;
+    struct search_idx      *idx = NULL;
+    struct search_idx_query *q = NULL;
+    struct search_job      job;
     unsigned               flags;
+    int                    npkgs, min_per_worker, nworkers, batch;
+    int                    interrupted = 0;
+
+    memset(&job, 0, sizeof(job));
 
     if ((pt = cmdctx->_data) == NULL) {
         logn(LOGERR, _("search: no pattern given"));
@@ -601,12 +831,6 @@ static int search(struct cmdctx *cmdctx)
     if (flags == 0)
         cmdctx->_flags |= OPT_SEARCH_DEFAULT;
 
-    init_pcre();
-    if (!pattern_compile(pt, poldek_ts_get_arg_count(cmdctx->ts))) {
-        err++;
-        goto l_end;
-    }
-
     if (poldek_ts_get_arg_count(cmdctx->ts) == 0) {
         pkgs = poclidek_get_dent_packages(cctx, NULL, 0);
     } else {
@@ -617,13 +841,31 @@ static int search(struct cmdctx *cmdctx)
         return 0;
 
     n_assert(n_array_size(pkgs) > 0);
+    npkgs = n_array_size(pkgs);
+
+    init_pcre();
+    if (!pattern_compile(pt, npkgs)) {
+        err++;
+        goto l_end;
+    }
+
+    /* narrow packages.dir fields to search with trigram index */
+    if (cmdctx->_flags & OPT_SEARCH_HDD) {
+        tn_array *literals;
+
+        idx = get_search_idx(cctx);
+        if ((literals = pattern_literals(pt))) {
+            q = search_idx_query_new(idx, literals,
+                                     cmdctx->_flags & OPT_SEARCH_HDD);
+            n_array_free(literals);
+        }
+    }
 
     matched_pkgs = n_array_new(32, NULL, NULL);
-    if (n_array_size(pkgs) > 5 && (cmdctx->_flags & OPT_SEARCH_HDD)) {
+    if (npkgs > 5 && (cmdctx->_flags & OPT_SEARCH_HDD)) {
         display_bar = 1;
         msg(0, _("Searching packages..."));
     }
-    bar_v = 0;
 
     /*
        sort by sequence number avoids index backward seeks
@@ -636,27 +878,79 @@ static int search(struct cmdctx *cmdctx)
             n_array_sort_ex(pkgs, (tn_fn_cmp)pkg_cmp_seqno);
     }
 
-    for (i=0; i < n_array_size(pkgs); i++) {
-        struct pkg *pkg = n_array_nth(pkgs, i);
+    job.pkgs = pkgs;
+    job.pt = pt;
+    job.idx = idx;
+    job.matched = n_calloc(npkgs, sizeof(*job.matched));
+    job.failed = n_calloc(npkgs, sizeof(*job.failed));
+    job.flags = n_malloc(npkgs * sizeof(*job.flags));
+    if (idx)
+        job.docs = n_malloc(npkgs * sizeof(*job.docs));
+
+    /* index documents are looked up (and created) before workers start */
+    for (i=0; i < npkgs; i++) {
+        job.flags[i] = cmdctx->_flags;
+
+        if (idx) {
+            job.docs[i] = search_idx_doc(idx, n_array_nth(pkgs, i));
+            if (q)
+                job.flags[i] &= ~search_idx_query_skip(q, job.docs[i]);
+        }
+    }
+
+    min_per_worker = SEARCH_MIN_PER_WORKER_MEM;
+    if (cmdctx->_flags & OPT_SEARCH_HDD)
+        min_per_worker = SEARCH_MIN_PER_WORKER;
+
+    /* workers' debug messages would be mixed up */
+    if (poldek_VERBOSE > 3)
+        min_per_worker = INT_MAX;
+
+    /* workers neither log nor poll for ^C, so they are run in batches
+       and progress, errors and interrupt are handled in between */
+    nworkers = poldek__parallel_nworkers(npkgs, min_per_worker);
+    batch = npkgs / SEARCH_PROGRESS_STEPS;
+    if (nworkers > 1 && batch < nworkers * min_per_worker)
+        batch = nworkers * min_per_worker;
+    if (batch < 1)
+        batch = 1;
 
-        if (pkg_match(pkg, pt, cmdctx->_flags))
-            n_array_push(matched_pkgs, pkg);
+    for (i=0; i < npkgs && !interrupted; i += n) {
+        int j;
+
+        n = npkgs - i;
+        if (n > batch)
+            n = batch;
+
+        job.offset = i;
+        poldek__parallel_for(n, min_per_worker, search_worker, &job);
+
+        for (j = i; j < i + n; j++)
+            if (job.failed[j])
+                logn(LOGERR, _("%s: load package info failed"),
+                     pkg_id(n_array_nth(pkgs, j)));
 
         if (display_bar) {
-            int v, j;
+            int v = (i + n) * SEARCH_PROGRESS_STEPS / npkgs;
 
-            v = i * 40 / n_array_size(pkgs);
-            for (j = bar_v; j < v; j++)
+            for (; bar_v < v; bar_v++)
                 msg(0, "_.");
-            bar_v = v;
         }
 
-        if (sigint_reached()) {
-            msgn(0, _("_interrupted."));
-            goto l_end;
-        }
+        if (sigint_reached())
+            interrupted = 1;
+    }
+
+    if (interrupted) {
+        msgn(0, _("_interrupted."));
+        goto l_end;
     }
 
+    /* merge in original order */
+    for (i=0; i < npkgs; i++)
+        if (job.matched[i])
+            n_array_push(matched_pkgs, n_array_nth(pkgs, i));
+
     if (display_bar)
         msgn(0, _("_done."));
 
@@ -683,6 +977,23 @@ static int search(struct cmdctx *cmdctx)
                         n_array_size(matched_pkgs));
 
 l_end:
+    if (job.matched)
+        free(job.matched);
+
+    if (job.failed)
+        free(job.failed);
+
+    if (job.flags)
+        free(job.flags);
+
+    if (job.docs)
+        free(job.docs);
+
+    if (q)
+        search_idx_query_free(q);
+
+    if (idx)
+        save_search_idx(cctx);
 
     if (pkgs)
         n_array_free(pkgs);
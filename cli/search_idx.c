@@ -0,0 +1,928 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Trigram index used by search to skip packages whose summaries,
+  descriptions or file lists cannot match a pattern. It is built lazily
+  as search loads these fields and persisted in cachedir. Documents are
+  keyed by package's NEVRA and index path, so an index entry never gets
+  stale nor is shared by other arch or other repository builds of the
+  same NVR; packages not indexed yet are simply searched in a regular
+  way.
+
+  Only ASCII trigrams are indexed, case folded, so index answers are
+  valid for both fnmatch() and pcre, case sensitive or not.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <trurl/nassert.h>
+#include <trurl/narray.h>
+#include <trurl/nhash.h>
+#include <trurl/nmalloc.h>
+#include <trurl/n_snprintf.h>
+
+#include "i18n.h"
+#include "log.h"
+#include "pkg.h"
+#include "pkgdir/pkgdir.h"
+#include "search_idx.h"
+
+#define SIDX_MAGIC      0x50534932 /* "PSI2" */
+#define SIDX_MAXIDLEN   1024
+#define SIDX_MAXFIELDS  16
+#define SIDX_MAXDOCS    (1 << 24)
+
+struct search_idx_doc {
+    uint32_t   no;
+    uint16_t   fields;          /* indexed fields */
+    uint16_t   qfields;         /* ones indexed when last query was built */
+    int        keep;
+    char       id[0];
+};
+
+struct sidx_post {
+    uint32_t   key;             /* field no << 24 | trigram */
+    uint32_t   n;
+    uint32_t   size;
+    uint32_t   *docs;
+};
+
+struct search_idx {
+    char              *path;
+    int               dirty;
+    tn_array          *docs;    /* indexed by doc->no */
+    tn_hash           *docs_h;  /* doc_id() => doc */
+    uint32_t          nposts;
+    uint32_t          size;     /* posts table size, power of 2 */
+    struct sidx_post  *posts;
+};
+
+struct search_idx_query {
+    uint32_t          ndocs;
+    unsigned          fields;
+    unsigned char     *bitmaps[SIDX_MAXFIELDS]; /* NULL - not narrowed */
+};
+
+static inline unsigned field_no(unsigned field)
+{
+    unsigned no = 0;
+
+    n_assert(field);
+    while ((field & 1) == 0) {
+        field >>= 1;
+        no++;
+    }
+    n_assert(no < SIDX_MAXFIELDS);
+    return no + 1;
+}
+
+/* returns 0 for non-ASCII trigrams */
+static inline uint32_t trigram(const char *s)
+{
+    uint32_t tri = 0;
+    int i;
+
+    for (i=0; i < 3; i++) {
+        unsigned c = (unsigned char)s[i];
+
+        if (c == 0 || c >= 0x80)
+            return 0;
+
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+        tri = (tri << 8) | c;
+    }
+
+    return tri;
+}
+
+static inline uint32_t post_hash(uint32_t key)
+{
+    key ^= key >> 15;
+    key *= 0x2c1b3c6d;
+    key ^= key >> 12;
+    return key;
+}
+
+static void posts_grow(struct search_idx *idx)
+{
+    struct sidx_post *posts = idx->posts;
+    uint32_t i, size = idx->size;
+
+    idx->size = size ? size * 2 : 4096;
+    idx->posts = n_calloc(idx->size, sizeof(*idx->posts));
+
+    for (i=0; i < size; i++) {
+        uint32_t h;
+
+        if (posts[i].key == 0)
+            continue;
+
+        h = post_hash(posts[i].key) & (idx->size - 1);
+        while (idx->posts[h].key != 0)
+            h = (h + 1) & (idx->size - 1);
+
+        idx->posts[h] = posts[i];
+    }
+
+    if (posts)
+        free(posts);
+}
+
+static struct sidx_post *post_get(struct search_idx *idx, uint32_t key,
+                                  int create)
+{
+    uint32_t h;
+
+    if (idx->size == 0) {
+        if (!create)
+            return NULL;
+        posts_grow(idx);
+    }
+
+    h = post_hash(key) & (idx->size - 1);
+    while (idx->posts[h].key != 0) {
+        if (idx->posts[h].key == key)
+            return &idx->posts[h];
+        h = (h + 1) & (idx->size - 1);
+    }
+
+    if (!create)
+        return NULL;
+
+    if ((idx->nposts + 1) * 2 > idx->size) {
+        posts_grow(idx);
+        return post_get(idx, key, create);
+    }
+
+    idx->posts[h].key = key;
+    idx->nposts++;
+    return &idx->posts[h];
+}
+
+static void post_push(struct sidx_post *post, uint32_t docno)
+{
+    if (post->n == post->size) {
+        post->size = post->size ? post->size * 2 : 4;
+        post->docs = n_realloc(post->docs, post->size * sizeof(*post->docs));
+    }
+    post->docs[post->n++] = docno;
+}
+
+static struct search_idx_doc *doc_new(struct search_idx *idx,
+                                      const char *id, int idlen)
+{
+    struct search_idx_doc *doc;
+
+    doc = n_malloc(sizeof(*doc) + idlen + 1);
+    doc->no = n_array_size(idx->docs);
+    doc->fields = doc->qfields = 0;
+    doc->keep = 0;
+    memcpy(doc->id, id, idlen);
+    doc->id[idlen] = '\0';
+
+    n_array_push(idx->docs, doc);
+    n_hash_insert(idx->docs_h, doc->id, doc);
+    return doc;
+}
+
+static struct search_idx *search_idx_new(const char *path)
+{
+    struct search_idx *idx;
+
+    idx = n_calloc(1, sizeof(*idx));
+    idx->path = path ? n_strdup(path) : NULL;
+    idx->docs = n_array_new(1024, free, NULL);
+    idx->docs_h = n_hash_new(1024, NULL);
+    return idx;
+}
+
+void search_idx_free(struct search_idx *idx)
+{
+    uint32_t i;
+
+    for (i=0; i < idx->size; i++)
+        if (idx->posts[i].docs)
+            free(idx->posts[i].docs);
+
+    if (idx->posts)
+        free(idx->posts);
+
+    n_hash_free(idx->docs_h);
+    n_array_free(idx->docs);
+
+    if (idx->path)
+        free(idx->path);
+    free(idx);
+}
+
+int search_idx_isdirty(const struct search_idx *idx)
+{
+    return idx->dirty;
+}
+
+/*
+  File layout (host byte order):
+    magic, ndocs, nposts
+    ndocs  * { uint16 fields, uint16 idlen, id }
+    nposts * { uint32 key, uint32 n, n * uint32 docno }
+*/
+static int do_load(struct search_idx *idx, FILE *stream)
+{
+    uint32_t hdr[3], i;
+    char id[SIDX_MAXIDLEN];
+
+    if (fread(hdr, sizeof(hdr), 1, stream) != 1 || hdr[0] != SIDX_MAGIC ||
+        hdr[1] > SIDX_MAXDOCS)
+        return 0;
+
+    for (i=0; i < hdr[1]; i++) {
+        struct search_idx_doc *doc;
+        uint16_t dhdr[2];
+
+        if (fread(dhdr, sizeof(dhdr), 1, stream) != 1 ||
+            dhdr[1] == 0 || dhdr[1] >= sizeof(id) ||
+            fread(id, dhdr[1], 1, stream) != 1)
+            return 0;
+
+        doc = doc_new(idx, id, dhdr[1]);
+        doc->fields = dhdr[0];
+    }
+
+    for (i=0; i < hdr[2]; i++) {
+        struct sidx_post *post;
+        uint32_t phdr[2], j;
+
+        if (fread(phdr, sizeof(phdr), 1, stream) != 1 || phdr[0] == 0 ||
+            phdr[1] == 0 || phdr[1] > hdr[1])
+            return 0;
+
+        post = post_get(idx, phdr[0], 1);
+        if (post->n > 0)        /* duplicated key */
+            return 0;
+
+        post->size = post->n = phdr[1];
+        post->docs = n_malloc(post->size * sizeof(*post->docs));
+        if (fread(post->docs, sizeof(*post->docs), post->n, stream) != post->n)
+            return 0;
+
+        for (j=0; j < post->n; j++)
+            if (post->docs[j] >= hdr[1])
+                return 0;
+    }
+
+    return 1;
+}
+
+struct search_idx *search_idx_load(const char *path)
+{
+    struct search_idx *idx;
+    FILE *stream;
+
+    idx = search_idx_new(path);
+    if (path == NULL || (stream = fopen(path, "r")) == NULL)
+        return idx;
+
+    if (!do_load(idx, stream)) {
+        logn(LOGWARN, _("%s: broken search index, rebuilding"), path);
+        search_idx_free(idx);
+        idx = search_idx_new(path);
+        idx->dirty = 1;
+    }
+
+    fclose(stream);
+    msgn(3, "search index %s: %d packages", path, n_array_size(idx->docs));
+    return idx;
+}
+
+static int do_save(struct search_idx *idx, FILE *stream)
+{
+    uint32_t hdr[3], i;
+
+    hdr[0] = SIDX_MAGIC;
+    hdr[1] = n_array_size(idx->docs);
+    hdr[2] = 0;
+
+    for (i=0; i < idx->size; i++)
+        if (idx->posts[i].n > 0)
+            hdr[2]++;
+
+    if (fwrite(hdr, sizeof(hdr), 1, stream) != 1)
+        return 0;
+
+    for (i=0; i < hdr[1]; i++) {
+        struct search_idx_doc *doc = n_array_nth(idx->docs, i);
+        uint16_t dhdr[2];
+
+        dhdr[0] = doc->fields;
+        dhdr[1] = strlen(doc->id);
+
+        if (fwrite(dhdr, sizeof(dhdr), 1, stream) != 1 ||
+            fwrite(doc->id, dhdr[1], 1, stream) != 1)
+            return 0;
+    }
+
+    for (i=0; i < idx->size; i++) {
+        struct sidx_post *post = &idx->posts[i];
+        uint32_t phdr[2];
+
+        if (post->n == 0)
+            continue;
+
+        phdr[0] = post->key;
+        phdr[1] = post->n;
+        if (fwrite(phdr, sizeof(phdr), 1, stream) != 1 ||
+            fwrite(post->docs, sizeof(*post->docs), post->n, stream) != post->n)
+            return 0;
+    }
+
+    return 1;
+}
+
+int search_idx_save(struct search_idx *idx)
+{
+    char tmpath[PATH_MAX];
+    FILE *stream;
+    int ok;
+
+    if (idx->path == NULL || !idx->dirty)
+        return 1;
+
+    n_snprintf(tmpath, sizeof(tmpath), "%s.tmp", idx->path);
+    if ((stream = fopen(tmpath, "w")) == NULL) {
+        logn(LOGERR, _("%s: open failed: %m"), tmpath);
+        return 0;
+    }
+
+    ok = do_save(idx, stream);
+    if (fclose(stream) != 0)
+        ok = 0;
+
+    if (ok && rename(tmpath, idx->path) != 0)
+        ok = 0;
+
+    if (!ok) {
+        logn(LOGERR, _("%s: write failed: %m"), idx->path);
+        unlink(tmpath);
+        return 0;
+    }
+
+    msgn(3, "search index %s: %d packages saved", idx->path,
+         n_array_size(idx->docs));
+    idx->dirty = 0;
+    return 1;
+}
+
+/* name-epoch:version-release.arch@idxpath#lang:lang...; summaries and
+   descriptions are loaded in pkgdir's languages, so index made with
+   other ones is not valid for them */
+static int doc_id(char *buf, int size, const struct pkg *pkg)
+{
+    const char *arch = pkg_arch(pkg), *idxpath = NULL;
+    tn_array *langs = NULL;
+    int i, n;
+
+    if (pkg->pkgdir) {
+        idxpath = pkg->pkgdir->idxpath;
+        langs = pkg->pkgdir->langs;
+    }
+
+    n = n_snprintf(buf, size, "%s-%d:%s-%s.%s@%s#", pkg->name, pkg->epoch,
+                   pkg->ver, pkg->rel, arch ? arch : "",
+                   idxpath ? idxpath : "");
+
+    for (i=0; langs && i < n_array_size(langs); i++)
+        n += n_snprintf(&buf[n], size - n, "%s%s", i > 0 ? ":" : "",
+                        (char*)n_array_nth(langs, i));
+
+    return n;
+}
+
+struct search_idx_doc *search_idx_doc(struct search_idx *idx,
+                                      const struct pkg *pkg)
+{
+    struct search_idx_doc *doc;
+    char id[SIDX_MAXIDLEN];
+    int len;
+
+    len = doc_id(id, sizeof(id), pkg);
+    if ((doc = n_hash_get(idx->docs_h, id)) == NULL)
+        doc = doc_new(idx, id, len);
+
+    return doc;
+}
+
+int search_idx_doc_needs(const struct search_idx_doc *doc, unsigned field)
+{
+    return (doc->fields & field) == 0;
+}
+
+/*
+  Case folding fnmatch() turns U+0130 and U+212A into ASCII 'i' and 'k';
+  returns copy of s with these replaced or NULL if s has none of them.
+*/
+static char *fold_to_ascii(const char *s, int len)
+{
+    char *folded = NULL;
+    int i, n = 0;
+
+    for (i=0; i < len; i++) {
+        const unsigned char *p = (const unsigned char*)&s[i];
+        char c = 0;
+
+        if (i + 1 < len && p[0] == 0xc4 && p[1] == 0xb0) {
+            c = 'i';
+            i += 1;
+
+        } else if (i + 2 < len && p[0] == 0xe2 && p[1] == 0x84 && p[2] == 0xaa) {
+            c = 'k';
+            i += 2;
+        }
+
+        if (c && folded == NULL) {
+            folded = n_malloc(len + 1);
+            memcpy(folded, s, n);
+        }
+
+        if (folded)
+            folded[n] = c ? c : s[i];
+        n++;
+    }
+
+    if (folded)
+        folded[n] = '\0';
+
+    return folded;
+}
+
+void search_idx_add(struct search_idx *idx, struct search_idx_doc *doc,
+                    unsigned field, const char *s, int len)
+{
+    uint32_t fno = field_no(field) << 24;
+    char *folded;
+    int i;
+
+    if (len == 0)
+        len = strlen(s);
+
+    if ((folded = fold_to_ascii(s, len))) {
+        search_idx_add(idx, doc, field, folded, 0);
+        free(folded);
+    }
+
+    for (i=0; i + 2 < len; i++) {
+        struct sidx_post *post;
+        uint32_t tri;
+
+        if ((tri = trigram(&s[i])) == 0)
+            continue;
+
+        post = post_get(idx, fno | tri, 1);
+
+        /* doc's trigrams are pushed one field at once */
+        if (post->n > 0 && post->docs[post->n - 1] == doc->no)
+            continue;
+
+        post_push(post, doc->no);
+    }
+}
+
+void search_idx_doc_done(struct search_idx *idx, struct search_idx_doc *doc,
+                         unsigned field)
+{
+    doc->fields |= field;
+    idx->dirty = 1;
+}
+
+void search_idx_keep(struct search_idx *idx, const struct pkg *pkg)
+{
+    struct search_idx_doc *doc;
+    char id[SIDX_MAXIDLEN];
+
+    doc_id(id, sizeof(id), pkg);
+    if ((doc = n_hash_get(idx->docs_h, id)))
+        doc->keep = 1;
+}
+
+void search_idx_prune(struct search_idx *idx)
+{
+    tn_array *docs;
+    uint32_t *remap, i, j, ndocs;
+
+    ndocs = n_array_size(idx->docs);
+    remap = n_malloc(sizeof(*remap) * (ndocs + 1));
+
+    docs = n_array_new(ndocs, free, NULL);
+    n_hash_clean(idx->docs_h);
+
+    for (i=0; i < ndocs; i++) {
+        struct search_idx_doc *doc = n_array_nth(idx->docs, i);
+
+        if (!doc->keep) {
+            remap[i] = UINT32_MAX;
+            continue;
+        }
+
+        remap[i] = doc->no = n_array_size(docs);
+        doc->keep = 0;
+        n_array_push(docs, doc);
+        n_hash_insert(idx->docs_h, doc->id, doc);
+    }
+
+    if (n_array_size(docs) == ndocs) {
+        n_array_ctl_set_freefn(docs, NULL);
+        n_array_free(docs);
+        free(remap);
+        return;
+    }
+
+    msgn(3, "search index: %d outdated packages removed",
+         ndocs - n_array_size(docs));
+
+    /* free only dropped ones */
+    for (i=0; i < ndocs; i++)
+        if (remap[i] == UINT32_MAX)
+            free(n_array_nth(idx->docs, i));
+
+    n_array_ctl_set_freefn(idx->docs, NULL);
+    n_array_free(idx->docs);
+    idx->docs = docs;
+
+    for (i=0; i < idx->size; i++) {
+        struct sidx_post *post = &idx->posts[i];
+        uint32_t n = 0;
+
+        if (post->key == 0)
+            continue;
+
+        for (j=0; j < post->n; j++)
+            if (remap[post->docs[j]] != UINT32_MAX)
+                post->docs[n++] = remap[post->docs[j]];
+
+        post->n = n;            /* empty ones are not saved */
+    }
+
+    free(remap);
+    idx->dirty = 1;
+}
+
+static void bitmap_set(unsigned char *bm, const struct sidx_post *post)
+{
+    uint32_t i;
+
+    for (i=0; i < post->n; i++)
+        bm[post->docs[i] >> 3] |= 1 << (post->docs[i] & 7);
+}
+
+static unsigned char *query_field(struct search_idx *idx,
+                                  const tn_array *literals, unsigned field)
+{
+    unsigned char *bm = NULL, *tmp;
+    uint32_t fno = field_no(field) << 24;
+    size_t bmsize;
+    int i, j;
+
+    bmsize = n_array_size(idx->docs) / 8 + 1;
+    tmp = n_malloc(bmsize);
+
+    for (i=0; i < n_array_size(literals); i++) {
+        const char *s = n_array_nth(literals, i);
+
+        for (j=0; s[j] && s[j + 1] && s[j + 2]; j++) {
+            struct sidx_post *post;
+            uint32_t tri;
+            size_t k;
+
+            if ((tri = trigram(&s[j])) == 0)
+                continue;
+
+            post = post_get(idx, fno | tri, 0);
+
+            if (bm == NULL) {
+                bm = n_calloc(bmsize, 1);
+                if (post)
+                    bitmap_set(bm, post);
+                continue;
+            }
+
+            memset(tmp, 0, bmsize);
+            if (post)
+                bitmap_set(tmp, post);
+
+            for (k=0; k < bmsize; k++)
+                bm[k] &= tmp[k];
+        }
+    }
+
+    free(tmp);
+    return bm;
+}
+
+struct search_idx_query *search_idx_query_new(struct search_idx *idx,
+                                              const tn_array *literals,
+                                              unsigned fields)
+{
+    struct search_idx_query *q;
+    int i, nnarrowed = 0;
+
+    q = n_calloc(1, sizeof(*q));
+    q->ndocs = n_array_size(idx->docs);
+    q->fields = fields;
+
+    for (i=0; i < SIDX_MAXFIELDS; i++) {
+        if ((fields & (1 << i)) == 0)
+            continue;
+
+        if ((q->bitmaps[i] = query_field(idx, literals, 1 << i)))
+            nnarrowed++;
+    }
+
+    if (nnarrowed == 0) {
+        free(q);
+        return NULL;
+    }
+
+    for (i=0; i < n_array_size(idx->docs); i++) {
+        struct search_idx_doc *doc = n_array_nth(idx->docs, i);
+        doc->qfields = doc->fields;
+    }
+
+    return q;
+}
+
+void search_idx_query_free(struct search_idx_query *q)
+{
+    int i;
+
+    for (i=0; i < SIDX_MAXFIELDS; i++)
+        if (q->bitmaps[i])
+            free(q->bitmaps[i]);
+
+    free(q);
+}
+
+unsigned search_idx_query_skip(const struct search_idx_query *q,
+                               const struct search_idx_doc *doc)
+{
+    unsigned skip = 0;
+    int i;
+
+    if (doc->no >= q->ndocs)   /* added after query was built */
+        return 0;
+
+    for (i=0; i < SIDX_MAXFIELDS; i++) {
+        const unsigned char *bm = q->bitmaps[i];
+        unsigned field = 1 << i;
+
+        if (bm == NULL || (doc->qfields & field) == 0)
+            continue;
+
+        if ((bm[doc->no >> 3] & (1 << (doc->no & 7))) == 0)
+            skip |= field;
+    }
+
+    return skip;
+}
+
+#define LITERALS_MAXGROUPS 32
+
+static void add_literal(tn_array *literals, const char *s, int len)
+{
+    if (len >= 3)
+        n_array_push(literals, n_strdupl(s, len));
+}
+
+int search_idx_fmask_literals(tn_array *literals, const char *p)
+{
+    char *buf = alloca(strlen(p) + 1);
+    int n = 0;
+
+    for (; *p; p++) {
+        switch (*p) {
+            case '*':
+            case '?':
+                add_literal(literals, buf, n);
+                n = 0;
+                break;
+
+            case '[':
+                add_literal(literals, buf, n);
+                n = 0;
+                p++;
+                if (*p == '!' || *p == '^')
+                    p++;
+                if (*p == ']')
+                    p++;
+                while (*p && *p != ']')
+                    p++;
+                if (*p == '\0')    /* unmatched '[' */
+                    return 0;
+                break;
+
+            case '\\':
+                if (*(p + 1))
+                    p++;
+                /* fallthrough */
+
+            default:
+                buf[n++] = *p;
+                break;
+        }
+    }
+
+    add_literal(literals, buf, n);
+    return 1;
+}
+
+/*
+  Returns length of quantifier at p (0 if there is none, -1 if not
+  understood), optional is set if it allows zero occurrences.
+*/
+static int pcre_quantifier(const char *p, int *optional)
+{
+    const char *s = p;
+
+    *optional = 0;
+    switch (*p) {
+        case '*':
+        case '?':
+            *optional = 1;
+            /* fallthrough */
+        case '+':
+            p++;
+            break;
+
+        case '{':
+            if (!isdigit(*(p + 1)))
+                return -1;
+            *optional = (*(p + 1) == '0' && !isdigit(*(p + 2)));
+            while (*p && *p != '}')
+                p++;
+            if (*p == '\0')
+                return -1;
+            p++;
+            break;
+
+        default:
+            return 0;
+    }
+
+    if (*p == '?' || *p == '+')   /* lazy or possessive */
+        p++;
+
+    return p - s;
+}
+
+/* conservative, anything not understood makes it give up */
+int search_idx_pcre_literals(tn_array *literals, const char *p)
+{
+    char *buf = alloca(strlen(p) + 1);
+    int groups[LITERALS_MAXGROUPS], ngroups = 0, n = 0;
+
+    for (; *p; p++) {
+        switch (*p) {
+            case '|':
+                return 0;
+
+            case '\\':
+                p++;
+                if (*p == '\0')
+                    return 0;
+
+                if (isalnum(*p)) {  /* one char class or assertion only */
+                    if (strchr("dDwWsShHvVRNXntrfeabBAzZGK", *p) == NULL)
+                        return 0;
+                    add_literal(literals, buf, n);
+                    n = 0;
+                    break;
+                }
+                buf[n++] = *p;
+                break;
+
+            case '[':
+                add_literal(literals, buf, n);
+                n = 0;
+                p++;
+                if (*p == '^')
+                    p++;
+                if (*p == ']')
+                    p++;
+                while (*p && *p != ']') {
+                    if (*p == '[' && *(p + 1) == ':') {
+                        if ((p = strstr(p, ":]")) == NULL)
+                            return 0;
+                        p++;
+                    } else if (*p == '\\' && *(p + 1)) {
+                        p++;
+                    }
+                    p++;
+                }
+                if (*p == '\0')
+                    return 0;
+                break;
+
+            case '(':
+                add_literal(literals, buf, n);
+                n = 0;
+                if (ngroups == LITERALS_MAXGROUPS)
+                    return 0;
+
+                /* negative lookaround contents are never required */
+                if (strncmp(p, "(?!", 3) == 0 || strncmp(p, "(?<!", 4) == 0)
+                    groups[ngroups++] = -1 - n_array_size(literals);
+                else
+                    groups[ngroups++] = n_array_size(literals);
+
+                if (*(p + 1) == '?') {
+                    if (strncmp(p, "(?:", 3) == 0 || strncmp(p, "(?=", 3) == 0 ||
+                        strncmp(p, "(?!", 3) == 0)
+                        p += 2;
+                    else if (strncmp(p, "(?<=", 4) == 0 ||
+                             strncmp(p, "(?<!", 4) == 0)
+                        p += 3;
+                    else
+                        return 0;
+                }
+                break;
+
+            case ')': {
+                int start, optional, len;
+
+                add_literal(literals, buf, n);
+                n = 0;
+                if (ngroups == 0)
+                    return 0;
+
+                if ((len = pcre_quantifier(p + 1, &optional)) < 0)
+                    return 0;
+                p += len;
+
+                start = groups[--ngroups];
+                if (start < 0) {
+                    start = -1 - start;
+                    optional = 1;
+                }
+
+                if (optional)
+                    while (n_array_size(literals) > start)
+                        n_array_remove_nth(literals, n_array_size(literals) - 1);
+                break;
+            }
+
+            case '.':
+            case '^':
+            case '$':
+                add_literal(literals, buf, n);
+                n = 0;
+                break;
+
+            case '*':
+            case '?':
+            case '+':
+            case '{': {
+                int optional, len;
+
+                if ((len = pcre_quantifier(p, &optional)) < 0)
+                    return 0;
+                p += len - 1;
+
+                if (optional && n > 0) /* previous char is optional */
+                    n--;
+                add_literal(literals, buf, n);
+                n = 0;
+                break;
+            }
+
+            default:
+                buf[n++] = *p;
+                break;
+        }
+    }
+
+    if (ngroups)
+        return 0;
+
+    add_literal(literals, buf, n);
+    return 1;
+}
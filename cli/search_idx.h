@@ -0,0 +1,67 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef POCLIDEK_SEARCH_IDX_H
+#define POCLIDEK_SEARCH_IDX_H
+
+#include <trurl/narray.h>
+
+struct pkg;
+
+/*
+  Trigram index of package texts. Fields are caller defined bit flags
+  (up to 16 of them), packages are identified by NEVRA, index path and
+  languages of their descriptions.
+*/
+struct search_idx;
+struct search_idx_doc;
+struct search_idx_query;
+
+/* path may be NULL, index is not persisted then */
+struct search_idx *search_idx_load(const char *path);
+void search_idx_free(struct search_idx *idx);
+int search_idx_isdirty(const struct search_idx *idx);
+int search_idx_save(struct search_idx *idx);
+
+struct search_idx_doc *search_idx_doc(struct search_idx *idx,
+                                      const struct pkg *pkg);
+/* returns non-zero if field of doc is not indexed yet */
+int search_idx_doc_needs(const struct search_idx_doc *doc, unsigned field);
+void search_idx_add(struct search_idx *idx, struct search_idx_doc *doc,
+                    unsigned field, const char *s, int len);
+void search_idx_doc_done(struct search_idx *idx, struct search_idx_doc *doc,
+                         unsigned field);
+
+/* drops documents of packages not passed to search_idx_keep() since
+   last pruning */
+void search_idx_keep(struct search_idx *idx, const struct pkg *pkg);
+void search_idx_prune(struct search_idx *idx);
+
+/* literals - strings every matching text contains */
+struct search_idx_query *search_idx_query_new(struct search_idx *idx,
+                                              const tn_array *literals,
+                                              unsigned fields);
+void search_idx_query_free(struct search_idx_query *q);
+/* returns fields of doc which cannot match query */
+unsigned search_idx_query_skip(const struct search_idx_query *q,
+                               const struct search_idx_doc *doc);
+
+/*
+  Strings (3 chars at least) every text matched by fnmatch() pattern or
+  perl regexp must contain, to build a query from; return 0 if pattern
+  is not understood. Perl regexp is taken as compiled without
+  PCRE_EXTENDED.
+*/
+int search_idx_fmask_literals(tn_array *literals, const char *pattern);
+int search_idx_pcre_literals(tn_array *literals, const char *pattern);
+
+#endif
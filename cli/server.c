@@ -0,0 +1,461 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Server mode: packages are loaded once and commands are read from
+  clients connected to a UNIX socket. Client sends command lines (the
+  shell syntax, pipes included) terminated by '\n', for each of them
+  server replies with
+
+     "OK <length>\n" or "ERR <length>\n" followed by <length> bytes
+     of command output
+
+  Empty line or EOF ends the session. Clients are served one by one,
+  each session starts in the home directory; client idle for
+  SERVER_CLIENT_TIMEOUT is disconnected.
+
+  Installed packages are reloaded before a command if rpm database
+  has been changed. Sources could not be unloaded, so if a local copy
+  of any loaded index is changed (by --up, etc) server re-executes
+  itself keeping the listening socket open.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <trurl/trurl.h>
+#include <sigint/sigint.h>
+#include <vfile/vfile.h>
+
+#include "compiler.h"
+#include "i18n.h"
+#include "log.h"
+#include "pkgdir/pkgdir.h"
+#include "cli.h"
+#include "poldek_intern.h"      /* for ctx->pkgdirs */
+
+#define SERVER_FD_ENV       "POLDEK_SERVER_FD"
+#define SERVER_MAXLINE      8192
+#define SERVER_POLL_TIMEOUT 2000 /* ms, how often indexes are checked */
+#define SERVER_CLIENT_TIMEOUT 30 /* s, for client's command line or reply */
+
+struct idx_stamp {
+    time_t  mtime;
+    off_t   size;
+    char    path[0];
+};
+
+static volatile sig_atomic_t srvDone = 0;
+
+static void server_end(int sig)
+{
+    sig = sig;
+    srvDone = 1;
+}
+
+static void stamp_stat(struct idx_stamp *st, time_t *mtime, off_t *size)
+{
+    struct stat sb;
+
+    *mtime = 0;
+    *size = 0;
+
+    if (stat(st->path, &sb) == 0) {
+        *mtime = sb.st_mtime;
+        *size = sb.st_size;
+    }
+}
+
+static tn_array *idx_stamps(struct poclidek_ctx *cctx)
+{
+    tn_array *stamps, *pkgdirs = cctx->ctx->pkgdirs;
+    int i;
+
+    stamps = n_array_new(8, free, NULL);
+
+    for (i=0; pkgdirs && i < n_array_size(pkgdirs); i++) {
+        struct pkgdir *pkgdir = n_array_nth(pkgdirs, i);
+        struct idx_stamp *st;
+        char path[PATH_MAX];
+        const char *p;
+
+        if ((p = pkgdir->idxpath) == NULL)
+            continue;
+
+        if ((vf_url_type(p) & VFURL_LOCAL) == 0) { /* watch its local copy */
+            vf_localpath(path, sizeof(path), p);
+            p = path;
+        }
+
+        st = n_malloc(sizeof(*st) + strlen(p) + 1);
+        strcpy(st->path, p);
+        stamp_stat(st, &st->mtime, &st->size);
+        DBGF("%s %ld\n", st->path, st->mtime);
+        n_array_push(stamps, st);
+    }
+
+    return stamps;
+}
+
+static int idx_changed(tn_array *stamps)
+{
+    int i;
+
+    for (i=0; i < n_array_size(stamps); i++) {
+        struct idx_stamp *st = n_array_nth(stamps, i);
+        time_t mtime;
+        off_t size;
+
+        stamp_stat(st, &mtime, &size);
+        if (mtime != st->mtime || size != st->size) {
+            msgn(1, _("%s: index changed"), st->path);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* nobody listens on it */
+static int socket_is_stale(const struct sockaddr_un *addr)
+{
+    int fd, stale = 0;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        logn(LOGERR, "socket: %m");
+        return 0;
+    }
+
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == 0)
+        logn(LOGERR, _("%s: server is already running"), addr->sun_path);
+
+    else if (errno == ECONNREFUSED || errno == ENOENT)
+        stale = 1;
+
+    else
+        logn(LOGERR, "%s: %m", addr->sun_path);
+
+    close(fd);
+    return stale;
+}
+
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    const char *s;
+    mode_t mask;
+    int fd, rc;
+
+    if ((s = getenv(SERVER_FD_ENV))) { /* re-executed, socket is inherited */
+        fd = atoi(s);
+        unsetenv(SERVER_FD_ENV);
+
+        if (fd > 2 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0)
+            return fd;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        logn(LOGERR, _("%s: socket path too long"), path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    n_snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        logn(LOGERR, "socket: %m");
+        return -1;
+    }
+
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (!socket_is_stale(&addr)) {
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    mask = umask(077);          /* commands may install packages */
+    rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+
+    if (rc != 0 || listen(fd, 16) != 0) {
+        logn(LOGERR, "%s: %m", path);
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+static void server_reexec(int fd, char **argv)
+{
+    char tmp[32];
+
+    msgn(1, _("Restarting server..."));
+
+    n_snprintf(tmp, sizeof(tmp), "%d", fd);
+    setenv(SERVER_FD_ENV, tmp, 1);
+    fcntl(fd, F_SETFD, 0);
+
+    execv("/proc/self/exe", argv);
+    execvp(argv[0], argv);
+
+    logn(LOGERR, "%s: %m", argv[0]);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    unsetenv(SERVER_FD_ENV);
+}
+
+static int write_all(int fd, const char *buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        buf += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+static int reply(int fd, int rc, const char *buf, int size)
+{
+    char hdr[64];
+    int n;
+
+    n = n_snprintf(hdr, sizeof(hdr), "%s %d\n", rc ? "OK" : "ERR", size);
+    if (!write_all(fd, hdr, n))
+        return 0;
+
+    return size == 0 || write_all(fd, buf, size);
+}
+
+static int exec_line(struct poclidek_ctx *cctx, int fd, const char *line)
+{
+    struct poclidek_rcmd *rcmd;
+    tn_buf *nbuf;
+    int rc;
+
+    if (poclidek__installed_changed(cctx)) {
+        msgn(1, _("Reloading installed packages..."));
+        poclidek_load_packages(cctx, POCLIDEK_LOAD_INSTALLED |
+                               POCLIDEK_LOAD_RELOAD);
+    }
+
+    DBGF("(%s)\n", line);
+    sigint_reset();
+
+    rcmd = poclidek_rcmd_new(cctx, NULL);
+    rc = poclidek_rcmd_execline(rcmd, line);
+
+    nbuf = poclidek_rcmd_get_buf(rcmd);
+    rc = reply(fd, rc, n_buf_ptr(nbuf), n_buf_size(nbuf));
+
+    n_buf_free(nbuf);
+    poclidek_rcmd_free(rcmd);
+    return rc;
+}
+
+struct client {
+    int   fd;
+    int   len;                  /* bytes in buf */
+    int   llen;                 /* length of last returned line */
+    char  buf[SERVER_MAXLINE];
+};
+
+/* returns next command line, NULL on EOF, timeout or error */
+static char *client_getline(struct client *cl)
+{
+    if (cl->llen > 0) {         /* drop previous one */
+        cl->len -= cl->llen;
+        memmove(cl->buf, &cl->buf[cl->llen], cl->len);
+        cl->llen = 0;
+    }
+
+    while (!srvDone) {
+        struct pollfd pfd;
+        char *nl;
+        int n;
+
+        if ((nl = memchr(cl->buf, '\n', cl->len))) {
+            *nl = '\0';
+            cl->llen = nl - cl->buf + 1;
+            return cl->buf;
+        }
+
+        if (cl->len == sizeof(cl->buf) - 1) {
+            logn(LOGERR, _("command line too long"));
+            reply(cl->fd, 0, NULL, 0);
+            return NULL;
+        }
+
+        pfd.fd = cl->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if ((n = poll(&pfd, 1, SERVER_CLIENT_TIMEOUT * 1000)) == 0) {
+            msgn(1, _("Client timed out"));
+            return NULL;
+        }
+
+        if (n > 0)
+            n = read(cl->fd, &cl->buf[cl->len], sizeof(cl->buf) - 1 - cl->len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+
+        if (n == 0) {           /* EOF, last line may be not terminated */
+            if (cl->len == 0)
+                return NULL;
+
+            cl->buf[cl->len] = '\0';
+            cl->llen = cl->len;
+            return cl->buf;
+        }
+
+        cl->len += n;
+    }
+
+    return NULL;
+}
+
+static void serve(struct poclidek_ctx *cctx, int fd)
+{
+    struct client *cl;
+    struct timeval tv;
+    char *line;
+
+    /* do not get stuck on client which does not read replies */
+    tv.tv_sec = SERVER_CLIENT_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (cctx->homedir)
+        cctx->currdir = cctx->homedir;
+
+    cl = n_malloc(sizeof(*cl));
+    cl->fd = fd;
+    cl->len = cl->llen = 0;
+
+    while ((line = client_getline(cl))) {
+        char *s = n_str_strip_ws(line);
+
+        if (*s == '\0')
+            break;
+
+        if (!exec_line(cctx, fd, s))
+            break;
+    }
+
+    free(cl);
+    close(fd);
+}
+
+int poclidek_server(struct poclidek_ctx *cctx, const char *path, char **argv)
+{
+    struct sigaction act;
+    tn_array *stamps;
+    unsigned ldflags = POCLIDEK_LOAD_ALL;
+    int fd, restart = 0;
+
+    if ((fd = server_listen(path)) < 0)
+        return 0;
+
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = server_end; /* no SA_RESTART, poll() must be broken */
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGQUIT, &act, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    cctx->_flags |= POLDEKCLI_UNDERIMODE;
+
+    if (cctx->flags & POCLIDEK_SKIP_INSTALLED)
+        ldflags &= ~POCLIDEK_LOAD_INSTALLED;
+
+    poclidek_load_packages(cctx, ldflags);
+    stamps = idx_stamps(cctx);
+
+    msgn(1, _("Listening on %s"), path);
+
+    while (!srvDone) {
+        struct pollfd pfd;
+        int cfd, n;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        n = poll(&pfd, 1, SERVER_POLL_TIMEOUT);
+        if (n < 0 && errno != EINTR) {
+            logn(LOGERR, "poll: %m");
+            break;
+        }
+
+        if (srvDone)
+            break;
+
+        if (idx_changed(stamps)) {
+            restart = 1;
+            break;
+        }
+
+        if (n <= 0)
+            continue;
+
+        if ((cfd = accept(fd, NULL, NULL)) < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                logn(LOGERR, "accept: %m");
+            continue;
+        }
+
+        fcntl(cfd, F_SETFD, FD_CLOEXEC);
+        serve(cctx, cfd);
+    }
+
+    n_array_free(stamps);
+
+    if (restart)
+        server_reexec(fd, argv); /* returns on failure only */
+
+    close(fd);
+    unlink(path);
+    return !restart;
+}
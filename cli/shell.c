@@ -67,12 +67,22 @@ static char *histfile;
 #define COMPLETITION_CTX_WHAT_SUGGESTS   6
 #define COMPLETITION_CTX_DIRNAME         7
 
+/* sorted capability/requirement names of directory packages */
+struct sh_names {
+    int        completion_ctx;  /* context names were collected for */
+    tn_array   *ents;           /* referenced directory entries */
+    unsigned   dent_gen;        /* and cctx->dent_gen at that time */
+    tn_array   *names;
+    tn_alloc   *na;             /* names are stored here */
+};
+
 struct sh_ctx {
     int completion_ctx;
     struct poclidek_ctx  *cctx;
+    struct sh_names      deps;
 };
 
-static struct sh_ctx sh_ctx = { COMPLETITION_CTX_NONE, NULL };
+static struct sh_ctx sh_ctx = { COMPLETITION_CTX_NONE, NULL, { 0 } };
 
 inline static int option_is_end (const struct argp_option *__opt)
 {
@@ -327,74 +337,137 @@ static char *arg_generator(const char *text, int state, int genpackages)
     return NULL;
 }
 
-/* TODO: use internal capreqs indexes instead of iterating over packages */
-static char *deps_generator(const char *text, int state)
+static void sh_names_reset(struct sh_names *nv)
 {
-    static tn_array *deps_table = NULL; /* XXX static variable */
+    n_array_cfree(&nv->names);
+    n_array_cfree(&nv->ents);
+    if (nv->na)
+        n_alloc_free(nv->na);
+    memset(nv, 0, sizeof(*nv));
+}
 
-    if (state == 0) {
-        int i, j, len;
+/*
+  Collects names of capabilities (requirements, suggests) of packages
+  in ents into sorted array. Names are copied, so packages may be gone
+  before the view is rebuilt.
+*/
+static void sh_names_build(struct sh_names *nv, tn_array *ents, int ctx,
+                           unsigned dent_gen)
+{
+    tn_array *tmp;
+    int i, j;
 
-        const char *pwd = poclidek_pwd(sh_ctx.cctx);
-        tn_array *ents = silent_get_dents(sh_ctx.cctx, pwd, 0);
+    sh_names_reset(nv);
 
-        if (ents == NULL)
-            return NULL;
+    tmp = n_array_new(n_array_size(ents) * 4, NULL, (tn_fn_cmp)strcmp);
+    for (i = 0; i < n_array_size(ents); i++) {
+        struct pkg_dent *ent = n_array_nth(ents, i);
+        struct pkg *pkg = ent->pkg_dent_pkg;
+        tn_array *caps = NULL;
 
-        len = strlen(text);
-        n_assert(deps_table == NULL);
+        if (pkg_dent_isdir(ent))
+            continue;
 
-        /* create deps_table */
-        deps_table = n_array_new(n_array_size(ents) * 4, NULL, (tn_fn_cmp)strcmp);
+        switch (ctx) {
+            case COMPLETITION_CTX_WHAT_PROVIDES:
+                caps = pkg->caps;
+                break;
 
-        /* fill deps_table with data */
-        for (i = 0; i < n_array_size(ents); i++) {
-            struct pkg_dent *ent = n_array_nth(ents, i);
-            struct pkg *pkg = ent->pkg_dent_pkg;
-            tn_array *caps = NULL;
+            case COMPLETITION_CTX_WHAT_REQUIRES:
+                caps = pkg->reqs;
+                break;
 
-            if (pkg_dent_isdir(ent))
-                continue;
+            case COMPLETITION_CTX_WHAT_SUGGESTS:
+                caps = pkg->sugs;
+                break;
+        }
 
-            switch (sh_ctx.completion_ctx) {
-                case COMPLETITION_CTX_WHAT_PROVIDES:
-                    caps = pkg->caps;
-                    break;
+        if (caps == NULL)
+            continue;
 
-                case COMPLETITION_CTX_WHAT_REQUIRES:
-                    caps = pkg->reqs;
-                    break;
+        for (j = 0; j < n_array_size(caps); j++) {
+            struct capreq *cr = n_array_nth(caps, j);
+            const char *name = capreq_name(cr);
 
-		case COMPLETITION_CTX_WHAT_SUGGESTS:
-		    caps = pkg->sugs;
-		    break;
+            /* skip self-caps */
+            if (ctx == COMPLETITION_CTX_WHAT_PROVIDES) {
+                if (strcmp(pkg->name, name) == 0 && pkg_evr_match_req(pkg, cr, 1))
+                    continue;
             }
 
-            if (caps == NULL)
-                continue;
+            n_array_push(tmp, (void*)name);
+        }
+    }
 
-            for (j = 0; j < n_array_size(caps); j++) {
-                struct capreq *cr = n_array_nth(caps, j);
-                const char *name = capreq_name(cr);
+    n_array_sort(tmp);
+    n_array_uniq(tmp);
 
-                /* skip self-caps */
-                if (sh_ctx.completion_ctx == COMPLETITION_CTX_WHAT_PROVIDES) {
-                    if (strcmp(pkg->name, name) == 0 && pkg_evr_match_req(pkg, cr, 1))
-                        continue;
-                }
+    nv->na = n_alloc_new(64, TN_ALLOC_OBSTACK);
+    nv->names = n_array_new(n_array_size(tmp) + 1, NULL, (tn_fn_cmp)strcmp);
+    for (i = 0; i < n_array_size(tmp); i++) {
+        const char *name = n_array_nth(tmp, i);
+        int len = strlen(name) + 1;
+        char *s = nv->na->na_malloc(nv->na, len);
 
-                if (len == 0 || strncmp(name, text, len) == 0)
-                    n_array_push(deps_table, (void*)name);
-            }
-        }
+        memcpy(s, name, len);
+        n_array_push(nv->names, s);
     }
+    n_array_free(tmp);
 
-    if (state >= n_array_size(deps_table)) {
-        n_array_cfree(&deps_table);
-        return NULL;
+    nv->completion_ctx = ctx;
+    nv->ents = n_ref(ents);
+    nv->dent_gen = dent_gen;
+}
+
+/* index of the first name not less than prefix */
+static int sh_names_lower_bound(tn_array *names, const char *prefix)
+{
+    int l = 0, r = n_array_size(names);
+
+    while (l < r) {
+        int m = l + (r - l) / 2;
+
+        if (strcmp(n_array_nth(names, m), prefix) < 0)
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    return l;
+}
+
+static char *deps_generator(const char *text, int state)
+{
+    struct sh_names *nv = &sh_ctx.deps;
+    static int i, len;
+    const char *name;
+
+    if (state == 0) {
+        const char *pwd = poclidek_pwd(sh_ctx.cctx);
+        tn_array *ents = silent_get_dents(sh_ctx.cctx, pwd, 0);
+
+        if (ents == NULL)
+            return NULL;
+
+        /* rebuilt only if directory content or context changed */
+        if (nv->names == NULL || nv->ents != ents ||
+            nv->dent_gen != sh_ctx.cctx->dent_gen ||
+            nv->completion_ctx != sh_ctx.completion_ctx)
+            sh_names_build(nv, ents, sh_ctx.completion_ctx,
+                           sh_ctx.cctx->dent_gen);
+
+        len = strlen(text);
+        i = sh_names_lower_bound(nv->names, text);
     }
 
-    return n_strdup(n_array_nth(deps_table, state));
+    if (nv->names == NULL || i >= n_array_size(nv->names))
+        return NULL;
+
+    name = n_array_nth(nv->names, i++);
+    if (len > 0 && strncmp(name, text, len) != 0)
+        return NULL;
+
+    return n_strdup(name);
 }
 
 static char *pkgname_generator(const char *text, int state)
@@ -607,6 +680,7 @@ int poclidek_shell(struct poclidek_ctx *cctx)
     if (histfile)
         write_history(histfile);
 
+    sh_names_reset(&sh_ctx.deps);
     sigint_pop();
     msg(0, "\n");
     return 1;
@@ -205,6 +205,7 @@ void i3ctx_init(struct i3ctx *ictx, struct poldek_ts *ts)
     ictx->processed = pkgmark_set_new(0, PKGMARK_SET_IDPTR);
 
     ictx->multi_obsoleted = n_hash_new(8, (tn_fn_free)n_array_free);
+    ictx->obsoleted = NULL;
     ictx->errors = n_hash_new(8, (tn_fn_free)n_array_free);
     ictx->abort = 0;
 }
@@ -220,6 +221,8 @@ void i3ctx_destroy(struct i3ctx *ictx)
     pkgmark_set_free(ictx->processed);
 
     n_hash_free(ictx->multi_obsoleted);
+    if (ictx->obsoleted)
+        n_hash_free(ictx->obsoleted);
     n_hash_free(ictx->errors);
     memset(ictx, 0, sizeof(*ictx));
 }
@@ -238,6 +241,10 @@ void i3ctx_reset(struct i3ctx *ictx)
     ictx->processed = pkgmark_set_new(0, PKGMARK_SET_IDPTR);
 
     n_hash_clean(ictx->multi_obsoleted);
+    if (ictx->obsoleted) {
+        n_hash_free(ictx->obsoleted);
+        ictx->obsoleted = NULL;
+    }
     n_hash_clean(ictx->errors);
     ictx->abort = 0;
 }
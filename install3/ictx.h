@@ -103,6 +103,8 @@ struct i3ctx {
     struct pkgmark_set *processed;  /* to mark pkg processed path */
 
     tn_hash           *multi_obsoleted; /* pkg_id => real obsoleted packages (muli-instances upgrade) */
+    tn_hash           *obsoleted;   /* pkg_id => installed packages matched by pkg's
+                                       Obsoletes, see i3_index_obsoletes() */
 
     unsigned           ma_flags;    /* match flags (POLDEK_MA_*) */
     int                abort;       /* abort processing? */
@@ -170,6 +172,10 @@ struct orphan {
     tn_array   *reqs;
 };
 
+/* joins available packages Obsoletes with installed set into ictx->obsoleted */
+#define I3_OBSOLETES_INDEX_MIN 64 /* worth for that many packages to install */
+int i3_index_obsoletes(struct i3ctx *ictx);
+
 int i3_process_pkg_obsoletes(int indent, struct i3ctx *ictx,
                              struct i3pkg *i3pkg);
 
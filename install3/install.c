@@ -54,16 +54,45 @@ static int verify_held_packages(struct i3ctx *ictx)
     return rc;
 }
 
+/* pm is asked once per arch/os index, cache is -1 filled */
+static int machine_fits(struct poldek_ts *ts, signed char *cache,
+                        enum pm_machine_score_tag tag, int index,
+                        const char *val)
+{
+    if (cache[index] < 0)
+        cache[index] = (pm_machine_score(ts->pmctx, tag, val) != 0);
+
+    return cache[index];
+}
+
 static int valid_arch_os(struct poldek_ts *ts, const tn_array *pkgs)
 {
-    int i, nerr = 0;
+    int i, nerr = 0, maxarch = 0, maxos = 0;
+    signed char *arch_fits, *os_fits;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (pkg->_arch > maxarch)
+            maxarch = pkg->_arch;
+
+        if (pkg->_os > maxos)
+            maxos = pkg->_os;
+    }
+
+    arch_fits = alloca(maxarch + 1);
+    memset(arch_fits, -1, maxarch + 1);
+
+    os_fits = alloca(maxos + 1);
+    memset(os_fits, -1, maxos + 1);
 
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *pkg = n_array_nth(pkgs, i);
 
         if (!poldek_conf_MULTILIB &&
             !ts->getop(ts, POLDEK_OP_IGNOREARCH) && pkg->_arch &&
-            !pm_machine_score(ts->pmctx, PMMSTAG_ARCH, pkg_arch(pkg)))
+            !machine_fits(ts, arch_fits, PMMSTAG_ARCH, pkg->_arch,
+                          pkg_arch(pkg)))
          {
              logn(LOGERR, _("%s: package is for a different architecture (%s)"),
                   pkg_id(pkg), pkg_arch(pkg));
@@ -71,7 +100,7 @@ static int valid_arch_os(struct poldek_ts *ts, const tn_array *pkgs)
          }
 
         if (!ts->getop(ts, POLDEK_OP_IGNOREOS) && pkg->_os &&
-            !pm_machine_score(ts->pmctx, PMMSTAG_OS, pkg_os(pkg)))
+            !machine_fits(ts, os_fits, PMMSTAG_OS, pkg->_os, pkg_os(pkg)))
          {
              logn(LOGERR, _("%s: package is for a different operating "
                             "system (%s)"), pkg_id(pkg), pkg_os(pkg));
@@ -241,6 +270,11 @@ static int install_packages(struct i3ctx *ictx)
     msgn(1, _("Processing dependencies..."));
     //pkgs_array_dump(toinstall, "inset");
 
+    /* big upgrades: match obsoletes in memory instead of querying rpmdb */
+    if (poldek_ts_issetf(ts, POLDEK_TS_UPGRADE) &&
+        n_array_size(toinstall) >= I3_OBSOLETES_INDEX_MIN)
+        i3_index_obsoletes(ictx);
+
     for (i = 0; i < n_array_size(toinstall); i++) {
         struct pkg *pkg = n_array_nth(toinstall, i);
 
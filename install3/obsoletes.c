@@ -102,6 +102,27 @@ static int get_orphaned(int indent, struct i3ctx *ictx,
     return norphaned;
 }
 
+/* is dbpkg coloured to be obsoleted by pkg? */
+static int obs_colored_like(const struct pkg *dbpkg, const struct pkg *pkg)
+{
+    if (!poldek_conf_MULTILIB)
+        return 1;
+
+    tracef(4, "%s.%s (c=%d) colored like %s (c=%d) => %s\n",
+           pkg_evr_snprintf_s(dbpkg), pkg_arch(dbpkg), dbpkg->color,
+           pkg_id(pkg), pkg->color,
+           pkg_is_colored_like(dbpkg, pkg) ? "yes" : "no");
+
+    if (pkg_is_colored_like(dbpkg, pkg))
+        return 1;
+
+    /* any uncolored -> rpm allows upgrade */
+    if (dbpkg->color == 0 || pkg->color == 0)
+        return 1;
+
+    return 0;
+}
+
 /* filter out obsoletes packages not coloured like new one  */
 static
 int obs_filter(struct pkgdb *db, const struct pm_dbrec *dbrec, void *apkg)
@@ -121,38 +142,147 @@ int obs_filter(struct pkgdb *db, const struct pm_dbrec *dbrec, void *apkg)
     if (arch)
         pkg_set_arch(&dbpkg, arch);
 
-    if (!poldek_conf_MULTILIB)
-        return 1;
+    return obs_colored_like(&dbpkg, pkg);
+}
 
-    tracef(4, "%s.%s (c=%d) colored like %s (c=%d) => %s\n",
-           pkg_evr_snprintf_s(&dbpkg), arch, dbpkg.color,
-           pkg_id(pkg), pkg->color,
-           pkg_is_colored_like(&dbpkg, pkg) ? "yes" : "no");
+/*
+  Installed packages obsoleted by available ones, computed once by
+  joining ps->obs_idx with installed packages index, so per package
+  obsoletes processing is a hash lookup instead of rpmdb queries for
+  every Obsoletes. Index may lack file lists (PKGDB_IDX_NOFL), so it is
+  probed without them first and matched packages only are loaded with
+  file lists, maybe from rpmdb.
+*/
+int i3_index_obsoletes(struct i3ctx *ictx)
+{
+    struct pkgdb     *db = ictx->ts->db;
+    tn_hash_it       it;
+    const char       *name;
+    unsigned         ldflags = PKG_LDWHOLE_FLDEPDIRS;
+    tn_array         *probe;
+    int              n = 0;
 
-    if (pkg_is_colored_like(&dbpkg, pkg))
+    if (ictx->obsoleted)
         return 1;
 
-    /* any uncolored -> rpm allows upgrade */
-    if (dbpkg.color == 0 || pkg->color == 0)
-        return 1;
+    if (!ictx->ts->getop(ictx->ts, POLDEK_OP_OBSOLETES))
+        return 0;
 
-    return 0;
+    if (!pkgdb_build_index(db)) /* without it the join costs the same as lookups */
+        return 0;
+
+    ictx->obsoleted = n_hash_new(512, (tn_fn_free)n_array_free);
+    probe = pkgs_array_new_ex(4, pkg_cmp_recno);
+
+    n_hash_it_init(&it, ictx->ps->obs_idx.ht);
+    while (n_hash_it_get(&it, &name) != NULL) {
+        struct pkg *const *pkgs = NULL;
+        int i, j, npkgs;
+
+        npkgs = capreq_idx_lookup_pkgs(&ictx->ps->obs_idx, name, strlen(name),
+                                       &pkgs);
+
+        for (i=0; i < npkgs; i++) {
+            struct pkg *pkg = pkgs[i];
+            tn_array *dbpkgs;
+
+            dbpkgs = n_hash_get(ictx->obsoleted, pkg_id(pkg));
+
+            for (j=0; j < n_array_size(pkg->cnfls); j++) {
+                struct capreq *cnfl = n_array_nth(pkg->cnfls, j);
+
+                if (!capreq_is_obsl(cnfl) || strcmp(capreq_name(cnfl), name) != 0)
+                    continue;
+
+                n_array_clean(probe);
+                if (pkgdb_q_obsoletedby_cap(db, probe, cnfl, NULL,
+                                            PKG_LDCAPREQS) == 0)
+                    continue;
+
+                if (dbpkgs == NULL)
+                    dbpkgs = pkgs_array_new_ex(4, pkg_cmp_recno);
+
+                pkgdb_q_obsoletedby_cap(db, dbpkgs, cnfl, NULL, ldflags);
+            }
+
+            if (dbpkgs == NULL || n_hash_exists(ictx->obsoleted, pkg_id(pkg)))
+                continue;
+
+            if (n_array_size(dbpkgs) == 0) {
+                n_array_free(dbpkgs);
+                continue;
+            }
+
+            n_hash_insert(ictx->obsoleted, pkg_id(pkg), dbpkgs);
+            n++;
+        }
+
+        if (sigint_reached())
+            break;
+    }
+    n_array_free(probe);
+
+    msgn(3, "%d package(s) obsolete installed ones", n);
+    return 1;
 }
 
-static tn_array *get_obsoletedby_pkg(struct pkgdb *db, const tn_array *unpkgs,
+/* adds ictx->obsoleted entries of pkg not already in obsoleted */
+static void get_indexed_obsoletedby_pkg(struct i3ctx *ictx,
+                                        tn_array *obsoleted,
+                                        const tn_array *unpkgs,
+                                        struct pkg *pkg)
+{
+    tn_array *dbpkgs;
+    int i;
+
+    if ((dbpkgs = n_hash_get(ictx->obsoleted, pkg_id(pkg))) == NULL)
+        return;
+
+    for (i=0; i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+
+        if (n_array_bsearch(unpkgs, dbpkg) || n_array_bsearch(obsoleted, dbpkg))
+            continue;
+
+        n_array_push(obsoleted, pkg_link(dbpkg));
+        n_array_sort(obsoleted);
+    }
+}
+
+static tn_array *get_obsoletedby_pkg(struct i3ctx *ictx, const tn_array *unpkgs,
                                      struct pkg *pkg, unsigned getflags,
                                      unsigned ldflags)
 {
+    struct pkgdb *db = ictx->ts->db;
     tn_array *obsoleted;
-
-    if (poldek_conf_MULTILIB)
-        pkgdb_set_filter(db, obs_filter, pkg);
+    int i;
 
     obsoleted = pkgs_array_new_ex(16, pkg_cmp_recno);
-    pkgdb_q_obsoletedby_pkg(db, obsoleted, pkg, getflags, unpkgs, ldflags);
 
-    if (poldek_conf_MULTILIB)
-        pkgdb_set_filter(db, NULL, NULL);
+    if (ictx->obsoleted) {     /* indexed, pkgdb's filter is not applied */
+        pkgdb_q_obsoletedby_pkg(db, obsoleted, pkg,
+                                getflags & ~PKGDB_GETF_OBSOLETEDBY_OBSL,
+                                unpkgs, ldflags);
+
+        if (getflags & PKGDB_GETF_OBSOLETEDBY_OBSL)
+            get_indexed_obsoletedby_pkg(ictx, obsoleted, unpkgs, pkg);
+
+        for (i=0; i < n_array_size(obsoleted); i++) {
+            if (!obs_colored_like(n_array_nth(obsoleted, i), pkg)) {
+                n_array_remove_nth(obsoleted, i);
+                i--;
+            }
+        }
+
+    } else {
+        if (poldek_conf_MULTILIB)
+            pkgdb_set_filter(db, obs_filter, pkg);
+
+        pkgdb_q_obsoletedby_pkg(db, obsoleted, pkg, getflags, unpkgs, ldflags);
+
+        if (poldek_conf_MULTILIB)
+            pkgdb_set_filter(db, NULL, NULL);
+    }
 
     if (n_array_size(obsoleted) == 0)
         n_array_cfree(&obsoleted);
@@ -357,7 +487,6 @@ int process_multiinsts(int indent, struct i3ctx *ictx, struct i3pkg *i3pkg, tn_a
 int i3_process_pkg_obsoletes(int indent, struct i3ctx *ictx, struct i3pkg *i3pkg)
 {
     struct pkg       *pkg = i3pkg->pkg;
-    struct pkgdb     *db = ictx->ts->db;
     struct iset      *unset = ictx->unset;
     unsigned         getflags = PKGDB_GETF_OBSOLETEDBY_NEVR;
     tn_array         *obsoleted = NULL, *orphaned = NULL, *orphans = NULL;
@@ -379,7 +508,7 @@ int i3_process_pkg_obsoletes(int indent, struct i3ctx *ictx, struct i3pkg *i3pkg
         getflags |= PKGDB_GETF_OBSOLETEDBY_REV;
 
 
-    obsoleted = get_obsoletedby_pkg(db, iset_packages_by_recno(unset), pkg,
+    obsoleted = get_obsoletedby_pkg(ictx, iset_packages_by_recno(unset), pkg,
                                     getflags, PKG_LDWHOLE_FLDEPDIRS);
 
     n = obsoleted ? n_array_size(obsoleted) : 0;
@@ -1131,6 +1131,10 @@ void poldek_destroy(struct poldek_ctx *ctx)
 {
     ctx = ctx;
 
+    /* while packages are still there, failure is logged by PM */
+    if (ctx->pmctx)
+        pm_dbflush(ctx->pmctx);
+
     vfile_destroy();
 
     if (ctx->htconf)
@@ -1150,6 +1154,10 @@ void poldek_destroy(struct poldek_ctx *ctx)
 
     poldek_ts_free(ctx->ts);
     n_hash_free(ctx->_cnf);
+
+    if (ctx->dbidx)
+        pkgdb_idx_free(ctx->dbidx);
+
     if (ctx->pmctx)
         pm_free(ctx->pmctx);
 
@@ -1687,6 +1695,10 @@ static int setup_pm(struct poldek_ctx *ctx)
 
         if ((op = poldek_conf_get(htcnf, "sudo command", NULL)))
             pm_configure(ctx->pmctx, "sudocmd", (void*)op);
+
+        if (strcmp(pm, "rpm") == 0 &&
+            poldek_conf_get_bool(htcnf, "native transaction", 0))
+            pm_configure(ctx->pmctx, "nativets", NULL);
     }
 
     return ctx->pmctx != NULL;
@@ -0,0 +1,141 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef ENABLE_THREADS
+# include <pthread.h>
+#endif
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "compiler.h"
+#include "log.h"
+#include "parallel.h"
+
+#define MAX_WORKERS 16
+
+static int ncpus(void)
+{
+    static int n = 0;
+
+    if (n == 0) {
+        long v = sysconf(_SC_NPROCESSORS_ONLN);
+
+        n = v > 0 ? (int)v : 1;
+        if (n > MAX_WORKERS)
+            n = MAX_WORKERS;
+    }
+
+    return n;
+}
+
+int poldek__parallel_nworkers(int nitems, int min_per_worker)
+{
+#ifndef ENABLE_THREADS
+    nitems = nitems;
+    min_per_worker = min_per_worker;
+    return 1;
+#else
+    int n;
+
+    if (min_per_worker < 1)
+        min_per_worker = 1;
+
+    n = nitems / min_per_worker;
+    if (n > ncpus())
+        n = ncpus();
+
+    return n > 1 ? n : 1;
+#endif
+}
+
+#ifdef ENABLE_THREADS
+struct worker {
+    pthread_t          tid;
+    poldek_parallel_fn fn;
+    void               *arg;
+    int                from;
+    int                to;
+    int                nth;
+    int                started;
+};
+
+static void *worker_main(void *ptr)
+{
+    struct worker *w = ptr;
+
+    w->fn(w->arg, w->from, w->to, w->nth);
+    return NULL;
+}
+#endif
+
+int poldek__parallel_for(int nitems, int min_per_worker,
+                         poldek_parallel_fn fn, void *arg)
+{
+    int nworkers;
+
+    if (nitems <= 0)
+        return 0;
+
+    nworkers = poldek__parallel_nworkers(nitems, min_per_worker);
+
+#ifdef ENABLE_THREADS
+    if (nworkers > 1) {
+        struct worker *workers;
+        int i, chunk, from = 0;
+
+        workers = n_calloc(sizeof(*workers), nworkers);
+        chunk = nitems / nworkers;
+
+        for (i=0; i < nworkers; i++) {
+            struct worker *w = &workers[i];
+
+            w->fn = fn;
+            w->arg = arg;
+            w->nth = i;
+            w->from = from;
+            w->to = (i == nworkers - 1) ? nitems : from + chunk;
+            from = w->to;
+
+            /* worker 0 runs in the calling thread */
+            if (i == 0)
+                continue;
+
+            if (pthread_create(&w->tid, NULL, worker_main, w) == 0) {
+                w->started = 1;
+            } else {
+                logn(LOGERR, "pthread_create failed, running serially");
+                worker_main(w);
+            }
+        }
+
+        worker_main(&workers[0]);
+
+        for (i=1; i < nworkers; i++)
+            if (workers[i].started)
+                pthread_join(workers[i].tid, NULL);
+
+        free(workers);
+        return nworkers;
+    }
+#endif
+
+    fn(arg, 0, nitems, 0);
+    return 1;
+}
@@ -0,0 +1,40 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef POLDEK_PARALLEL_H
+#define POLDEK_PARALLEL_H
+
+/*
+  Worker function: processes items [from, to) as worker no. nth.
+  Workers must not call back into code that is not thread-safe
+  (logging, pkg_link(), pm, vfile, etc). Package loaders (pkg_uinf(),
+  pkg_get_nodep_flist(), ...) run under a lock, so messages they may
+  log are serialized, provided the caller does not log until
+  poldek__parallel_for() returns.
+*/
+typedef void (*poldek_parallel_fn)(void *arg, int from, int to, int nth);
+
+/* number of workers poldek__parallel_for() would use for nitems */
+int poldek__parallel_nworkers(int nitems, int min_per_worker);
+
+/*
+  Splits [0, nitems) into contiguous chunks of at least min_per_worker
+  items and runs fn over them in worker threads; the chunk of worker
+  N always precedes the chunk of worker N + 1. Falls back to calling
+  fn(arg, 0, nitems, 0) directly if threads are not available or
+  not worth it.
+  RET: number of workers used
+*/
+int poldek__parallel_for(int nitems, int min_per_worker,
+                         poldek_parallel_fn fn, void *arg);
+
+#endif
@@ -23,6 +23,10 @@
 #include <time.h>
 #include <sys/param.h>
 
+#ifdef ENABLE_THREADS
+# include <pthread.h>
+#endif
+
 
 #include <trurl/nstr.h>
 #include <trurl/nassert.h>
@@ -50,8 +54,19 @@ static tn_array *architecture_a = NULL;
 static tn_hash *operatingsystem_h = NULL;
 static tn_array *operatingsystem_a = NULL;
 
+int *pkg__arch_scores = NULL;
+
+/* pkgdir modules are not reentrant, lazy loads must be serialized */
+#ifdef ENABLE_THREADS
+static pthread_mutex_t pkg_ld_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define pkg_ld_lock()    pthread_mutex_lock(&pkg_ld_mutex)
+# define pkg_ld_unlock()  pthread_mutex_unlock(&pkg_ld_mutex)
+#else
+# define pkg_ld_lock()
+# define pkg_ld_unlock()
+#endif
+
 struct an_arch {
-    int score;
     int index;
     char arch[0];
 };
@@ -68,13 +83,13 @@ int pkgmod_register_arch(const char *arch)
     }
 
     if ((an_arch = n_hash_get(architecture_h, arch)) == NULL) {
-        int len = strlen(arch);
+        int len = strlen(arch), score;
 
         an_arch = n_malloc(sizeof(*an_arch) + len + 1);
 
-        an_arch->score = pm_architecture_score(arch);
-        n_assert(an_arch->score >= 0);
-        if (!an_arch->score) an_arch->score = INT_MAX - 1;
+        score = pm_architecture_score(arch);
+        n_assert(score >= 0);
+        if (!score) score = INT_MAX - 1;
 
         memcpy(an_arch->arch, arch, len + 1);
         n_array_push(architecture_a, an_arch);
@@ -83,6 +98,11 @@ int pkgmod_register_arch(const char *arch)
         an_arch->index = n_array_size(architecture_a);
         n_assert(an_arch->index < UINT16_MAX);
         n_hash_insert(architecture_h, an_arch->arch, an_arch);
+
+        pkg__arch_scores = n_realloc(pkg__arch_scores, (an_arch->index + 1) *
+                                     sizeof(*pkg__arch_scores));
+        pkg__arch_scores[0] = 0;
+        pkg__arch_scores[an_arch->index] = score;
     }
 
     return an_arch->index;
@@ -98,15 +118,9 @@ const char *pkg_arch(const struct pkg *pkg)
     return NULL;
 }
 
-int pkg_arch_score(const struct pkg *pkg)
+int (pkg_arch_score)(const struct pkg *pkg)
 {
-    struct an_arch *a;
-
-    if (!pkg->_arch)
-        return 0;
-
-    a = n_array_nth(architecture_a, pkg->_arch - 1);
-    return a->score;
+    return pkg_arch_score(pkg);
 }
 
 int pkg_set_arch(struct pkg *pkg, const char *arch)
@@ -920,11 +934,13 @@ struct pkguinf *pkg_xuinf(const struct pkg *pkg, tn_array *langs)
 {
     struct pkguinf *pkgu = NULL;
 
+    pkg_ld_lock();
     if (pkg->load_pkguinf)
         pkgu = pkg->load_pkguinf(NULL, pkg, pkg->pkgdir_data, langs);
 
     else if (pkg_has_ldpkguinf(pkg))
         pkgu = pkguinf_link(pkg->pkg_pkguinf);
+    pkg_ld_unlock();
 
     return pkgu;
 }
@@ -932,11 +948,14 @@ struct pkguinf *pkg_xuinf(const struct pkg *pkg, tn_array *langs)
 struct pkguinf *pkg_uinf(const struct pkg *pkg)
 {
     struct pkguinf *pkgu = NULL;
+
+    pkg_ld_lock();
     if (pkg_has_ldpkguinf(pkg))
         pkgu = pkguinf_link(pkg->pkg_pkguinf);
 
     else if (pkg->load_pkguinf)
         pkgu = pkg->load_pkguinf(NULL, pkg, pkg->pkgdir_data, NULL);
+    pkg_ld_unlock();
 
     return pkgu;
 }
@@ -974,11 +993,13 @@ static tn_tuple *do_pkg_other_fl(tn_alloc *na, const struct pkg *pkg)
 {
     tn_tuple *fl = NULL;
 
+    pkg_ld_lock();
     if (pkg->load_nodep_fl)
         fl = pkg->load_nodep_fl(na, pkg,
                                 pkg->pkgdir_data,
                                 pkg->pkgdir ?
                                 pkg->pkgdir->foreign_depdirs : NULL);
+    pkg_ld_unlock();
 
     return fl;
 }
@@ -1055,6 +1076,97 @@ struct pkgflist *pkg_get_flist(const struct pkg *pkg)
     return flist;
 }
 
+struct flist_map {
+    tn_tuple  *fl;              /* pkg->fl */
+    int       i;
+    int       n;                /* number of entries passed */
+    int       stop;
+    int       locked;           /* pkg_ld_lock() is held */
+    int       (*fn)(struct pkgfl_ent *, void *);
+    void      *arg;
+};
+
+/* fn() may take long (printing) or load other package data */
+static int flist_map_ent(struct flist_map *m, struct pkgfl_ent *flent)
+{
+    int rc;
+
+    if (m->locked)
+        pkg_ld_unlock();
+
+    rc = m->fn(flent, m->arg);
+
+    if (m->locked)
+        pkg_ld_lock();
+
+    m->n++;
+    if (!rc)
+        m->stop = 1;
+    return !m->stop;
+}
+
+/* passes pkg->fl entries preceding flent (both lists are sorted) first */
+static int flist_map_merge(struct pkgfl_ent *flent, void *ptr)
+{
+    struct flist_map *m = ptr;
+
+    while (!m->stop && m->fl && m->i < n_tuple_size(m->fl)) {
+        struct pkgfl_ent *ent = n_tuple_nth(m->fl, m->i);
+
+        if (pkgfl_ent_cmp(ent, flent) > 0)
+            break;
+
+        m->i++;
+        flist_map_ent(m, ent);
+    }
+
+    if (m->stop)
+        return 0;
+
+    return flist_map_ent(m, flent);
+}
+
+int pkg_flist_map(const struct pkg *pkg, unsigned flags,
+                  int (*fn)(struct pkgfl_ent *flent, void *arg), void *arg)
+{
+    struct pkgflist *flist;
+    struct flist_map m;
+    int rc, i;
+
+    memset(&m, 0, sizeof(m));
+    m.fl = pkg->fl;
+    m.fn = fn;
+    m.arg = arg;
+
+    pkg_ld_lock();
+    m.locked = 1;
+    rc = pkgdir_map_nodep_fl(pkg, flags, flist_map_merge, &m);
+    m.locked = 0;
+    pkg_ld_unlock();
+
+    if (rc < 0 && m.n > 0) {    /* read error, the rest cannot be passed */
+        logn(LOGERR, _("%s: error reading file list, it is incomplete"),
+             pkg_id(pkg));
+        return -1;
+    }
+
+    if (rc >= 0) {              /* streamed, pass the rest of pkg->fl */
+        while (!m.stop && m.fl && m.i < n_tuple_size(m.fl))
+            flist_map_ent(&m, n_tuple_nth(m.fl, m.i++));
+
+        return m.n;
+    }
+
+    if ((flist = pkg_get_flist(pkg)) == NULL)
+        return 0;
+
+    for (i=0; !m.stop && i < n_tuple_size(flist->fl); i++)
+        flist_map_ent(&m, n_tuple_nth(flist->fl, i));
+
+    pkgflist_free(flist);
+    return m.n;
+}
+
 void pkgflist_free(struct pkgflist *flist)
 {
     DBGF("FRE %p, fl = %p, na = %p\n", flist, flist ? flist->fl : NULL,
@@ -33,6 +33,7 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 #define PKG_HAS_SRCFN       (1 << 4) /* set source package filename? */
 #define PKG_HAS_PKGUINF     (1 << 5) /* user-level info (pkgu.c) */
 #define PKG_HAS_SELFCAP     (1 << 6) /* name = e:v-r cap */
+#define PKG_HAS_SECTIME     (1 << 7) /* sectime is known (pndir index) */
 
 #define PKG_HELD            (1 << 12) /* non upgradable */
 #define PKG_IGNORED         (1 << 13) /* invisible      */
@@ -42,6 +43,7 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 
 #define PKG_DBPKG           (1 << 16) /* loaded from database, i.e. installed */
 #define PKG_INCLUDED_DIRREQS (1 << 17) /* auto-dir-reqs added directly to reqs */
+#define PKG_PMCAPS          (1 << 18) /* virtual, carries PM's internal caps */
 
 #ifdef POLDEK_PKG_DAG_COLOURS
 /* DAG node colours (pkgset-order.c, split.c) */
@@ -59,6 +61,7 @@ struct pkgdir;                  /* defined in pkgdir/pkgdir.h */
 #endif  /* POLDEK_PKG_DAG_COLOURS */
 
 #define pkg_is_noarch(pkg)  (0 == strcmp(pkg_arch((pkg)), "noarch"))
+#define pkg_is_pmcaps(pkg)  ((pkg)->flags & PKG_PMCAPS)
 
 #define pkg_set_prereqed(pkg) ((pkg)->flags |= PKG_ORDER_PREREQ)
 #define pkg_clr_prereqed(pkg)  ((pkg)->flags &= ~PKG_ORDER_PREREQ)
@@ -88,6 +91,8 @@ struct pkg {
     char         *srcfn;      /* package filename */
 
     uint32_t     fmtime;      /* package file mtime */
+    uint32_t     sectime;     /* time of last security fix in changelog,
+                                 0 if none; valid with PKG_HAS_SECTIME */
     char         *_nvr;       /* NAME-VERSION-RELEASE */
 
     uint16_t      _arch;
@@ -172,6 +177,13 @@ EXPORT int pkg_set_arch(struct pkg *pkg, const char *arch);
 EXPORT const char *pkg_arch(const struct pkg *pkg);
 EXPORT int pkg_arch_score(const struct pkg *pkg);
 
+/* arch scores indexed by pkg->_arch, computed once per registered arch */
+EXPORT int *pkg__arch_scores;
+#ifndef SWIG
+# define pkg_arch_score(pkg) \
+    ((pkg)->_arch ? pkg__arch_scores[(pkg)->_arch] : 0)
+#endif
+
 EXPORT const char *pkg_os(const struct pkg *pkg);
 EXPORT int pkg_set_os(struct pkg *pkg, const char *os);
 
@@ -254,7 +266,9 @@ EXPORT int pkg_evr_snprintf(char *str, size_t size, const struct pkg *pkg);
 EXPORT char *pkg_evr_snprintf_s(const struct pkg *pkg);
 
 
-/* must be free()d by pkguinf_free(); see pkgu.h */
+/* must be free()d by pkguinf_free(); see pkgu.h
+   pkg_uinf() and pkg_get_[nodep_]flist() may be called from worker
+   threads, provided a package is not shared between them */
 EXPORT struct pkguinf *pkg_uinf(const struct pkg *pkg);
 EXPORT struct pkguinf *pkg_xuinf(const struct pkg *pkg, tn_array *langs);
 
@@ -274,6 +288,18 @@ EXPORT struct pkgflist *pkg_get_flist(const struct pkg *pkg);
 
 EXPORT void pkgflist_free(struct pkgflist *flist);
 
+/* passes whole file list to fn() in pkg_get_flist() order, but, if
+   package index allows that, without loading it into memory; entries
+   are valid during fn() call only, fn() returning 0 stops the walk.
+   fn() is called without any lock held, so it may load other package
+   data. With PKGFL_MAP_DIRNAMES streamed entries carry no files, only
+   dirnames are read. Returns number of entries passed, -1 if list could
+   not be read whole after some entries have been passed already. */
+struct pkgfl_ent;
+EXPORT int pkg_flist_map(const struct pkg *pkg, unsigned flags,
+                         int (*fn)(struct pkgfl_ent *flent, void *arg),
+                         void *arg);
+
 
 /* whole file list as iterator */
 struct pkgflist_it;
@@ -15,6 +15,7 @@
 #endif
 
 #include <dirent.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -22,6 +23,9 @@
 #include <string.h>
 #include <time.h>
 #include <fnmatch.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>          /* for ntohl() */
 #include <sys/param.h>          /* for PATH_MAX */
 
 #include <trurl/trurl.h>
@@ -31,6 +35,7 @@
 #include "i18n.h"
 #include "log.h"
 #include "misc.h"
+#include "parallel.h"
 
 #ifdef HAVE_RPMORG
 # include "pm/rpmorg/pm_rpm.h"
@@ -180,6 +185,212 @@ struct pkguinf *load_pkguinf(tn_alloc *na, const struct pkg *pkg,
     return pkgu;
 }
 
+/* package file found in scanned directory */
+struct scan_ent {
+    const char   *fn;           /* basename, points to path */
+    struct stat  st;
+    Header       h;
+    void         *blob;         /* raw header read by read_headers() */
+    size_t       blobsize;
+    struct pkg   *pkg;
+    int          rc;            /* header read status, -errno if read failed */
+    char         path[0];
+};
+
+#define SCAN_BATCH           512 /* max number of headers held in memory */
+#define SCAN_MIN_PER_WORKER  16
+
+#define RPMLEAD_SIZE         96
+#define RPMHDR_MAXINDEX      0xffff
+#define RPMHDR_MAXDATA       (256 * 1024 * 1024)
+
+static struct scan_ent *scan_ent_new(const char *dirpath, const char *sepchr,
+                                     const char *fn)
+{
+    struct scan_ent *ent;
+    int len = strlen(dirpath) + strlen(sepchr) + strlen(fn) + 1;
+
+    ent = n_malloc(sizeof(*ent) + len);
+    memset(ent, 0, sizeof(*ent));
+    n_snprintf(ent->path, len, "%s%s%s", dirpath, sepchr, fn);
+    ent->fn = n_basenam(ent->path);
+    return ent;
+}
+
+static int read_full(int fd, void *buf, size_t size, off_t off)
+{
+    while (size > 0) {
+        ssize_t n = pread(fd, buf, size, off);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+            return 0;
+
+        buf = (char *)buf + n;
+        size -= n;
+        off += n;
+    }
+
+    return 1;
+}
+
+/* reads header section intro at off, returns its size without magic */
+static size_t read_hdr_intro(int fd, off_t off, uint32_t *il, uint32_t *dl)
+{
+    static const unsigned char magic[] = { 0x8e, 0xad, 0xe8, 0x01 };
+    unsigned char intro[16];
+
+    if (!read_full(fd, intro, sizeof(intro), off))
+        return 0;
+
+    if (memcmp(intro, magic, sizeof(magic)) != 0)
+        return 0;
+
+    memcpy(il, intro + 8, sizeof(*il));
+    memcpy(dl, intro + 12, sizeof(*dl));
+    *il = ntohl(*il);
+    *dl = ntohl(*dl);
+
+    if (*il == 0 || *il > RPMHDR_MAXINDEX || *dl > RPMHDR_MAXDATA)
+        return 0;
+
+    return 8 + (*il * 16) + *dl;
+}
+
+/*
+  Reads raw main header of package file: lead and signature are
+  skipped, header is parsed later, serially, by load_ent() as librpm
+  (rpmio, rpmlog and poldek's rpmlog() hook) is not thread-safe.
+*/
+static int read_header_blob(struct scan_ent *ent)
+{
+    uint32_t il = 0, dl = 0;
+    size_t size;
+    off_t off = RPMLEAD_SIZE;
+    int fd, rc = 0;
+
+    if ((fd = open(ent->path, O_RDONLY)) < 0)
+        return errno ? -errno : -EIO;
+
+    if ((size = read_hdr_intro(fd, off, &il, &dl)) == 0) /* signature */
+        goto l_end;
+
+    off += 8 + size;
+    off = (off + 7) & ~7;       /* signature is padded to 8 bytes */
+
+    if ((size = read_hdr_intro(fd, off, &il, &dl)) == 0)
+        goto l_end;
+
+    ent->blob = n_malloc(size);
+    il = htonl(il);
+    dl = htonl(dl);
+    memcpy(ent->blob, &il, sizeof(il));
+    memcpy((char *)ent->blob + 4, &dl, sizeof(dl));
+
+    if (!read_full(fd, (char *)ent->blob + 8, size - 8, off + 16)) {
+        free(ent->blob);
+        ent->blob = NULL;
+        goto l_end;
+    }
+
+    ent->blobsize = size;
+    rc = 1;
+
+l_end:
+    close(fd);
+    return rc;
+}
+
+/* worker, reads raw headers of ents[from, to), no librpm calls here */
+static void read_headers(void *ents, int from, int to, int nth)
+{
+    int i;
+
+    nth = nth;
+    for (i = from; i < to; i++) {
+        struct scan_ent *ent = n_array_nth(ents, i);
+
+        if (ent->pkg)           /* got from previous index */
+            continue;
+
+        ent->rc = read_header_blob(ent); /* logged by caller */
+    }
+}
+
+/* builds package from header read by read_headers() */
+static struct pkg *load_ent(struct pkgdir *pkgdir, struct scan_ent *ent,
+                            struct pkgroup_idx *pkgroups, unsigned ldflags,
+                            struct pkgdir *prev_pkgdir, tn_alloc *na,
+                            int *nnew)
+{
+    struct pkg *pkg = NULL;
+    tn_array *langs;
+    Header h;
+
+    if (ent->rc > 0) {
+        ent->h = pm_rpmhdr_loadblob(ent->blob, ent->blobsize);
+        if (ent->h == NULL)
+            ent->rc = 0;
+    }
+
+    free(ent->blob);
+    ent->blob = NULL;
+
+    if (ent->rc <= 0) {
+        if (ent->rc < 0)
+            logn(LOGERR, "open %s: %s", ent->path, strerror(-ent->rc));
+        logn(LOGWARN, _("%s: read header failed, skipped"), ent->path);
+        return NULL;
+    }
+
+    h = ent->h;
+
+    //if (rpmhdr_issource(h)) /* omit src.rpms */
+    //    continue;
+
+    if (prev_pkgdir) { /* mtime changed, but try compare content */
+        pkg = search_in_prev(prev_pkgdir, h, ent->fn, &ent->st);
+        if (pkg) {
+            msgn(3, _("%s: seems untouched, loaded from previous index"),
+                 pkg_snprintf_s(pkg));
+            pkg = pkg_link(pkg);
+            remap_groupid(pkg, pkgroups, prev_pkgdir);
+            return pkg;
+        }
+    }
+
+    /* not exists in previous index */
+    (*nnew)++;
+    msgn(3, _("%s: loading header..."), ent->fn);
+    pkg = pm_rpm_ldhdr(na, h, ent->fn, ent->st.st_size, PKG_LDWHOLE);
+    n_assert(pkg);
+
+    pkg->load_pkguinf = load_pkguinf;
+
+    if ((langs = pm_rpmhdr_langs(h))) {
+        int i;
+        for (i=0; i < n_array_size(langs); i++)
+            pkgdir__update_avlangs(pkgdir, n_array_nth(langs, i), 1);
+        n_array_free(langs);
+    }
+    pkg->groupid = pkgroup_idx_update_rpmhdr(pkgroups, h);
+
+    if (ldflags & PKGDIR_LD_DESC) {
+        pkg->pkg_pkguinf = pkguinf_ldrpmhdr(na, h, NULL);
+        pkg_set_ldpkguinf(pkg);
+    }
+
+    return pkg;
+}
+
+/*
+  Raw headers of new and changed files are read by worker threads in
+  batches; they are parsed and packages are built from them sequentially,
+  in readdir() order, as librpm, pkgroups, avlangs and allocator are not
+  thread-safe.
+*/
 static
 int load_dir(struct pkgdir *pkgdir,
              const char *dirpath, tn_array *pkgs, struct pkgroup_idx *pkgroups,
@@ -187,10 +398,10 @@ int load_dir(struct pkgdir *pkgdir,
              tn_alloc *na)
 {
     tn_hash        *mtime_index = NULL;
+    tn_array       *ents, *batch;
     struct dirent  *ent;
-    struct stat    st;
     DIR            *dir;
-    int            n, nnew = 0;
+    int            i, n, nnew = 0;
     char           *sepchr = "/";
 
     if ((dir = opendir(dirpath)) == NULL) {
@@ -204,11 +415,9 @@ int load_dir(struct pkgdir *pkgdir,
     if (dirpath[strlen(dirpath) - 1] == '/')
         sepchr = "";
 
-    n = 0;
+    ents = n_array_new(1024, free, NULL);
     while ((ent = readdir(dir))) {
-        char path[PATH_MAX];
-        struct pkg *pkg = NULL;
-        Header h = NULL;
+        struct scan_ent *sent;
 
         if (fnmatch("*.rpm", ent->d_name, 0) != 0)
             continue;
@@ -216,85 +425,70 @@ int load_dir(struct pkgdir *pkgdir,
         //if (fnmatch("*.src.rpm", ent->d_name, 0) == 0)
         //    continue;
 
-        snprintf(path, sizeof(path), "%s%s%s", dirpath, sepchr, ent->d_name);
-
-        if (!is_rpmfile(path, &st))
+        sent = scan_ent_new(dirpath, sepchr, ent->d_name);
+        if (!is_rpmfile(sent->path, &sent->st)) {
+            free(sent);
             continue;
+        }
 
         if (mtime_index) {
-            pkg = search_in_mtime_index(mtime_index, ent->d_name, &st);
+            struct pkg *pkg = search_in_mtime_index(mtime_index, sent->fn,
+                                                    &sent->st);
             if (pkg) {
                 msgn(3, _("%s: file seems untouched, loaded from previous index"),
                      pkg_filename_s(pkg));
-                pkg = pkg_link(pkg);
-                remap_groupid(pkg, pkgroups, prev_pkgdir);
+                sent->pkg = pkg_link(pkg);
+                remap_groupid(sent->pkg, pkgroups, prev_pkgdir);
             }
         }
 
-        if (pkg == NULL) {  /* mtime changed, but try compare content */
-            if (!pm_rpmhdr_loadfile(path, &h)) {
-                logn(LOGWARN, _("%s: read header failed, skipped"), path);
-                continue;
-            }
+        n_array_push(ents, sent);
+    }
+    closedir(dir);
 
-            //if (rpmhdr_issource(h)) /* omit src.rpms */
-            //    continue;
-
-            if (prev_pkgdir) {
-                pkg = search_in_prev(prev_pkgdir, h, ent->d_name, &st);
-                if (pkg) {
-                    msgn(3, _("%s: seems untouched, loaded from previous index"),
-                         pkg_snprintf_s(pkg));
-                    pkg = pkg_link(pkg);
-                    remap_groupid(pkg, pkgroups, prev_pkgdir);
-                }
-            }
-        }
+    n = 0;
+    batch = n_array_new(SCAN_BATCH, NULL, NULL);
+    for (i=0; i < n_array_size(ents); i += SCAN_BATCH) {
+        int j;
 
-        if (pkg == NULL) {  /* not exists in previous index */
-            tn_array *langs;
+        n_array_clean(batch);
+        for (j = i; j < n_array_size(ents) && j < i + SCAN_BATCH; j++)
+            n_array_push(batch, n_array_nth(ents, j));
 
-            nnew++;
-            n_assert(h);        /* loaded in previous if block */
-            msgn(3, _("%s: loading header..."), n_basenam(path));
-            pkg = pm_rpm_ldhdr(na, h, n_basenam(path), st.st_size, PKG_LDWHOLE);
-            n_assert(pkg);
+        poldek__parallel_for(n_array_size(batch), SCAN_MIN_PER_WORKER,
+                             read_headers, batch);
 
-            pkg->load_pkguinf = load_pkguinf;
+        for (j=0; j < n_array_size(batch); j++) {
+            struct scan_ent *sent = n_array_nth(batch, j);
+            struct pkg *pkg = sent->pkg;
 
-            if ((langs = pm_rpmhdr_langs(h))) {
-                int i;
-                for (i=0; i < n_array_size(langs); i++)
-                    pkgdir__update_avlangs(pkgdir, n_array_nth(langs, i), 1);
-                n_array_free(langs);
-            }
-            pkg->groupid = pkgroup_idx_update_rpmhdr(pkgroups, h);
+            if (pkg == NULL)
+                pkg = load_ent(pkgdir, sent, pkgroups, ldflags, prev_pkgdir,
+                               na, &nnew);
 
-            if (ldflags & PKGDIR_LD_DESC) {
-                pkg->pkg_pkguinf = pkguinf_ldrpmhdr(na, h, NULL);
-                pkg_set_ldpkguinf(pkg);
-            }
-        }
+            if (sent->h)
+                pm_rpmhdr_free(sent->h);
+            sent->h = NULL;
 
-        if (h)
-            pm_rpmhdr_free(h);
+            if (pkg) {
+                pkg->fmtime = sent->st.st_mtime;
+                n_array_push(pkgs, pkg);
+                n++;
 
-        if (pkg) {
-            pkg->fmtime = st.st_mtime;
-            n_array_push(pkgs, pkg);
-            n++;
+                if (n % 200 == 0)
+                    msg(1, "_%d..", n);
+            }
         }
-
-        if (n && n % 200 == 0)
-            msg(1, "_%d..", n);
     }
+    n_array_free(batch);
+    n_array_free(ents);
 
     /* if there are packages from prev_pkgdir then assume that
        they provide all avlangs */
 
     if (prev_pkgdir && n_array_size(pkgs) - nnew > 0) {
         tn_array *langs = n_hash_keys(prev_pkgdir->avlangs_h);
-        int i, nprev;
+        int nprev;
 
         nprev = n_array_size(pkgs) - nnew;
         for (i=0; i < n_array_size(langs); i++)
@@ -305,7 +499,6 @@ int load_dir(struct pkgdir *pkgdir,
     if (n && n > 200)
         msg(1, "_%d\n", n);
 
-    closedir(dir);
     if (mtime_index)
         n_hash_free(mtime_index);
 
@@ -313,6 +506,7 @@ int load_dir(struct pkgdir *pkgdir,
     return n;
 }
 
+
 static
 int do_load(struct pkgdir *pkgdir, unsigned ldflags)
 {
@@ -237,6 +237,8 @@ struct pkg *pkg_restore_st(tn_stream *st, tn_alloc *na, struct pkg *pkg,
             pkg->recno = tmpkg.recno;
             pkg->fmtime = tmpkg.fmtime;
             pkg->color  = tmpkg.color;
+            pkg->sectime = tmpkg.sectime;
+            pkg->flags |= (tmpkg.flags & PKG_HAS_SECTIME);
             pkg_loaded = 1;
             msgn(3, "Loaded %s, color=%d", pkg_id(pkg), pkg->color);
             break;
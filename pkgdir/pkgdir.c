@@ -877,6 +877,20 @@ const char *pkgdir_localidxpath(const struct pkgdir *pkgdir)
     return pkgdir->idxpath;
 }
 
+int pkgdir_map_nodep_fl(const struct pkg *pkg, unsigned flags,
+                        int (*fn)(struct pkgfl_ent *, void *), void *arg)
+{
+    const struct pkgdir *pkgdir = pkg->pkgdir;
+
+    if (pkg->load_nodep_fl == NULL || pkgdir == NULL || pkgdir->mod == NULL ||
+        pkgdir->mod->map_nodep_fl == NULL)
+        return -1;
+
+    return pkgdir->mod->map_nodep_fl(pkg, pkg->pkgdir_data,
+                                     pkgdir->foreign_depdirs, flags,
+                                     fn, arg);
+}
+
 time_t pkgdir_mtime(const struct pkgdir *pkgdir)
 {
     const char *path = pkgdir_localidxpath(pkgdir);
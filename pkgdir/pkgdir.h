@@ -194,6 +194,13 @@ EXPORT int pkgdir_add_package(struct pkgdir *pkgdir, struct pkg *pkg);
 EXPORT int pkgdir_add_packages(struct pkgdir *pkgdir, tn_array *pkgs);
 EXPORT int pkgdir_remove_package(struct pkgdir *pkgdir, struct pkg *pkg);
 
+/* streams pkg's not loaded file list to fn(), without loading it whole;
+   flags are PKGFL_MAP_*; returns -1 if pkg's pkgdir does not support that */
+struct pkgfl_ent;
+EXPORT int pkgdir_map_nodep_fl(const struct pkg *pkg, unsigned flags,
+                               int (*fn)(struct pkgfl_ent *, void *),
+                               void *arg);
+
 
 /* Prototypes of pkgdir_dirindex.c */
 /* returns packages having path */
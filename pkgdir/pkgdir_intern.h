@@ -84,6 +84,16 @@ typedef const char *(*pkgdir_fn_localidxpath)(const struct pkgdir *pkgdir);
 typedef int (*pkgdir_fn_setpaths)(struct pkgdir *pkgdir,
                                   const char *path, const char *pkg_prefix);
 
+struct pkg;
+struct pkgfl_ent;
+/* passes not loaded file list entries of pkg to fn() one by one,
+   flags are PKGFL_MAP_* */
+typedef int (*pkgdir_fn_map_nodep_fl)(const struct pkg *pkg, void *pkgdir_data,
+                                      tn_array *foreign_depdirs,
+                                      unsigned flags,
+                                      int (*fn)(struct pkgfl_ent *, void *),
+                                      void *arg);
+
 struct pkgdir_module {
     struct pkgdir_module* (*init_module)(struct pkgdir_module *);
     unsigned                    cap_flags;
@@ -103,6 +113,7 @@ struct pkgdir_module {
 
     pkgdir_fn_localidxpath  localidxpath;
     int (*posthook_diff) (struct pkgdir*, struct pkgdir*, struct pkgdir*);
+    pkgdir_fn_map_nodep_fl  map_nodep_fl;
 };
 
 //int pkgdir_mod_register(const struct pkgdir_module *mod);
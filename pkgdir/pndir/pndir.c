@@ -69,6 +69,11 @@ static void do_free(struct pkgdir *pkgdir);
 static
 int posthook_diff(struct pkgdir *pd1, struct pkgdir* pd2, struct pkgdir *diff);
 
+static
+int map_nodep_fl(const struct pkg *pkg, void *ptr, tn_array *foreign_depdirs,
+                 unsigned flags, int (*fn)(struct pkgfl_ent *, void *),
+                 void *arg);
+
 struct pkgdir_module pkgdir_module_pndir = {
     NULL,
     PKGDIR_CAP_UPDATEABLE_INC | PKGDIR_CAP_UPDATEABLE |
@@ -87,6 +92,7 @@ struct pkgdir_module pkgdir_module_pndir = {
     do_free,
     pndir_localidxpath,
     posthook_diff,
+    map_nodep_fl,
 };
 
 
@@ -676,6 +682,25 @@ tn_tuple *pndir_load_nodep_fl(tn_alloc *na, const struct pkg *pkg, void *ptr,
     return fl;
 }
 
+static
+int map_nodep_fl(const struct pkg *pkg, void *ptr, tn_array *foreign_depdirs,
+                 unsigned flags, int (*fn)(struct pkgfl_ent *, void *),
+                 void *arg)
+{
+    struct pkg_data *pd = ptr;
+    tn_stream *st;
+
+    if (pkg->load_nodep_fl != pndir_load_nodep_fl) /* not ours */
+        return -1;
+
+    if (pd->db == NULL || pd->off_nodep_files <= 0)
+        return 0;
+
+    st = tndb_tn_stream(pd->db);
+    n_stream_seek(st, pd->off_nodep_files, SEEK_SET);
+    return pkgfl_map_st(st, foreign_depdirs, 0, flags, fn, arg);
+}
+
 static
 int do_load(struct pkgdir *pkgdir, unsigned ldflags)
 {
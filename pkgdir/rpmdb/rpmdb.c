@@ -42,6 +42,7 @@
 #endif
 #include "pm/pm.h"
 #include "pkgroup.h"
+#include "pkgcmp.h"
 
 static int do_open(struct pkgdir *pkgdir, unsigned flags);
 static void do_free(struct pkgdir *pkgdir);
@@ -172,6 +173,60 @@ int load_package(unsigned int recno, void *header, struct pkgdir *pkgdir)
     return 1;
 }
 
+/*
+  Package of previous index (outdated rpmdbcache) still valid for the
+  record, i.e. record is not reused nor package reinstalled. Only
+  NEVR and install time are read from header, building package from
+  it is what costs.
+*/
+static
+struct pkg *search_in_prev(tn_array *prev_pkgs, unsigned int recno, Header h)
+{
+    struct pkg  tmp, *pkg;
+    const char  *name, *ver, *rel;
+    int32_t     epoch;
+    uint32_t    itime;
+
+    tmp.recno = recno;
+    if ((pkg = n_array_bsearch(prev_pkgs, &tmp)) == NULL)
+        return NULL;
+
+    if (!pm_rpmhdr_get_int(h, RPMTAG_INSTALLTIME, &itime))
+        return NULL;
+
+    if ((int32_t)itime != pkg->itime)
+        return NULL;
+
+    if (!pm_rpmhdr_nevr(h, &name, &epoch, &ver, &rel, NULL, NULL))
+        return NULL;
+
+    if (pkg->epoch != epoch || strcmp(pkg->name, name) != 0 ||
+        strcmp(pkg->ver, ver) != 0 || strcmp(pkg->rel, rel) != 0)
+        return NULL;
+
+    return pkg;
+}
+
+/* take package from previous index */
+static
+void load_prev_package(struct pkg *pkg, struct pkgdir *pkgdir)
+{
+    struct pkgdir *prev_pkgdir = pkgdir->prev_pkgdir;
+
+    pkg = pkg_link(pkg);
+    pkg->load_pkguinf = load_pkguinf;
+    pkg->load_nodep_fl = load_nodep_fl;
+
+    if (pkg->groupid > 0 && prev_pkgdir->pkgroups)
+        pkg->groupid = pkgroup_idx_remap_groupid(pkgdir->pkgroups,
+                                                 prev_pkgdir->pkgroups,
+                                                 pkg->groupid, 1);
+    if (poldek_VERBOSE > 3)
+        msgn(4, "rpmdb: %s untouched, loaded from cache", pkg_id(pkg));
+
+    n_array_push(pkgdir->pkgs, pkg);
+}
+
 static
 int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
                      const char *rootdir)
@@ -179,8 +234,9 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     struct pkgdb       *db;
     struct pkgdb_it    it;
     const struct pm_dbrec *dbrec;
+    tn_array           *prev_pkgs = NULL;
     char               dbfull_path[PATH_MAX];
-    int                n;
+    int                n, nprev = 0;
 
     snprintf(dbfull_path, sizeof(dbfull_path), "%s%s",
              *(rootdir + 1) == '\0' ? "" : rootdir,
@@ -193,13 +249,37 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     msg(3, _("Loading db packages%s%s%s..."), *dbfull_path ? " [":"",
         dbfull_path, *dbfull_path ? "]":"");
 
+    if (pkgdir->prev_pkgdir) {
+        int i;
+
+        prev_pkgs = pkgs_array_new_ex(n_array_size(pkgdir->prev_pkgdir->pkgs),
+                                      pkg_cmp_recno);
+        for (i=0; i < n_array_size(pkgdir->prev_pkgdir->pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgdir->prev_pkgdir->pkgs, i);
+            if (pkg->recno)
+                n_array_push(prev_pkgs, pkg_link(pkg));
+        }
+        n_array_sort(prev_pkgs);
+    }
+
     pkgdb_it_init(db, &it, PMTAG_RECNO, NULL);
 
     n = 0;
     while ((dbrec = pkgdb_it_get(&it))) {
         if (dbrec->hdr) {
-            if (load_package(dbrec->recno, dbrec->hdr, pkgdir))
+            struct pkg *pkg = NULL;
+
+            if (prev_pkgs)
+                pkg = search_in_prev(prev_pkgs, dbrec->recno, dbrec->hdr);
+
+            if (pkg) {
+                load_prev_package(pkg, pkgdir);
+                nprev++;
+                n++;
+
+            } else if (load_package(dbrec->recno, dbrec->hdr, pkgdir)) {
                 n++;
+            }
         }
 
         if (n % 100 == 0)
@@ -215,6 +295,22 @@ int load_db_packages(struct pm_ctx *pmctx, struct pkgdir *pkgdir,
     pkgdb_it_destroy(&it);
     pkgdb_free(db);
 
+    if (prev_pkgs) {
+        msgn(3, "rpmdb: %d package(s) loaded from cache, %d from database",
+             nprev, n - nprev);
+        n_array_free(prev_pkgs);
+    }
+
+    /* as in dir module, assume that cached packages provide all avlangs */
+    if (n > 0 && nprev > 0) {
+        tn_array *langs = n_hash_keys(pkgdir->prev_pkgdir->avlangs_h);
+        int i;
+
+        for (i=0; i < n_array_size(langs); i++)
+            pkgdir__update_avlangs(pkgdir, n_array_nth(langs, i), nprev);
+        n_array_free(langs);
+    }
+
     if (n == 0)
         n_array_clean(pkgdir->pkgs);
 
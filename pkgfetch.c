@@ -22,10 +22,13 @@
 #include <sys/param.h>          /* for PATH_MAX */
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <trurl/nassert.h>
 #include <trurl/narray.h>
 #include <trurl/nhash.h>
+#include <trurl/nmalloc.h>
 #include <trurl/nstr.h>
 #include <trurl/n_snprintf.h>
 
@@ -57,13 +60,269 @@ unsigned pkg_get_verify_signflags(struct pkg *pkg)
     return verify_flags;
 }
 
+/*
+  Digest verification pool. pm's verify_signature() is not thread-safe
+  (rpmlib, logging, global verbosity), so packages are verified by
+  forked workers, each reporting one status byte per package through
+  a pipe. Parent may go on (i.e. fetch next packages) meanwhile.
+*/
+#define VRFY_MAX_WORKERS     8
+#define VRFY_MIN_PER_WORKER  4
+
+#define VRFY_PENDING  0
+#define VRFY_OK       1
+#define VRFY_FAILED   2
+
+struct vrfy_pool {
+    tn_array  *paths;
+    uint8_t   *status;                 /* VRFY_* per path */
+    int       nfailed;
+    int       nworkers;
+    pid_t     pids[VRFY_MAX_WORKERS];
+    int       fds[VRFY_MAX_WORKERS];   /* -1 when worker is done */
+    int       pos[VRFY_MAX_WORKERS];   /* next path reported by worker */
+    int       to[VRFY_MAX_WORKERS];
+};
+
+static int vrfy_nworkers(int npaths)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = npaths / VRFY_MIN_PER_WORKER;
+
+    if (ncpus < 1)
+        ncpus = 1;
+
+    if (n > ncpus)
+        n = ncpus;
+
+    if (n > VRFY_MAX_WORKERS)
+        n = VRFY_MAX_WORKERS;
+
+    return n > 1 ? n : 1;
+}
+
+static void vrfy_chunk(struct pm_ctx *pmctx, struct vrfy_pool *vp,
+                       int from, int to, int fd)
+{
+    int i;
+
+    for (i = from; i < to; i++) {
+        const char *path = n_array_nth(vp->paths, i);
+        uint8_t st = VRFY_FAILED;
+
+        if (pm_verify_signature(pmctx, path, PKGVERIFY_MD))
+            st = VRFY_OK;
+
+        if (fd < 0) {
+            vp->status[i] = st;
+            if (st == VRFY_FAILED)
+                vp->nfailed++;
+
+        } else if (write(fd, &st, 1) != 1) {
+            break;
+        }
+    }
+}
+
+/* starts verification of paths (not copied, must live until vrfy_free()) */
+static struct vrfy_pool *vrfy_start(struct pm_ctx *pmctx, tn_array *paths)
+{
+    struct vrfy_pool *vp;
+    int i, npaths, chunk;
+
+    npaths = n_array_size(paths);
+    vp = n_calloc(sizeof(*vp), 1);
+    vp->paths = paths;
+    vp->status = n_calloc(npaths + 1, sizeof(*vp->status));
+    vp->nworkers = vrfy_nworkers(npaths);
+
+    if (vp->nworkers == 1) {   /* not worth forking */
+        vrfy_chunk(pmctx, vp, 0, npaths, -1);
+        vp->nworkers = 0;
+        return vp;
+    }
+
+    fflush(NULL);               /* do not duplicate buffered output */
+
+    chunk = (npaths + vp->nworkers - 1) / vp->nworkers;
+    for (i=0; i < vp->nworkers; i++) {
+        int fd[2], from = i * chunk, to = from + chunk;
+        pid_t pid = -1;
+
+        if (to > npaths)
+            to = npaths;
+
+        vp->fds[i] = -1;
+        vp->pos[i] = vp->to[i] = to;
+        vp->pids[i] = 0;
+
+        if (from >= to)
+            continue;
+
+        if (pipe(fd) != 0) {    /* no pipe, do it myself */
+            logn(LOGERR, "pipe: %m");
+            vrfy_chunk(pmctx, vp, from, to, -1);
+            continue;
+        }
+
+        if ((pid = fork()) < 0) { /* no fork, do it myself */
+            logn(LOGERR, "fork: %m");
+            close(fd[0]);
+            close(fd[1]);
+            vrfy_chunk(pmctx, vp, from, to, -1);
+            continue;
+        }
+
+        if (pid == 0) {         /* worker */
+            close(fd[0]);
+            vrfy_chunk(pmctx, vp, from, to, fd[1]);
+            close(fd[1]);
+            fflush(NULL);
+            _exit(0);
+        }
+
+        close(fd[1]);
+        vp->fds[i] = fd[0];
+        vp->pids[i] = pid;
+        vp->pos[i] = from;
+    }
+
+    return vp;
+}
+
+static void vrfy_stop_worker(struct vrfy_pool *vp, int i, int kill_it)
+{
+    if (vp->fds[i] < 0)
+        return;
+
+    close(vp->fds[i]);
+    vp->fds[i] = -1;
+
+    if (kill_it)
+        kill(vp->pids[i], SIGTERM);
+
+    while (waitpid(vp->pids[i], NULL, 0) < 0 && errno == EINTR)
+        ;
+}
+
+/*
+  Collects workers reports waiting up to timeout ms (-1 means until
+  all are done). RET: number of failed verifications so far
+*/
+static int vrfy_poll(struct vrfy_pool *vp, int timeout, int stop_on_failure)
+{
+    struct pollfd pfds[VRFY_MAX_WORKERS];
+    int i, n, nfds;
+
+    while (1) {
+        int idx[VRFY_MAX_WORKERS];
+
+        if (stop_on_failure && vp->nfailed)
+            break;
+
+        nfds = 0;
+        for (i=0; i < vp->nworkers; i++) {
+            if (vp->fds[i] < 0)
+                continue;
+
+            pfds[nfds].fd = vp->fds[i];
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            idx[nfds++] = i;
+        }
+
+        if (nfds == 0)
+            break;
+
+        if ((n = poll(pfds, nfds, timeout < 0 ? 500 : timeout)) < 0) {
+            if (errno != EINTR)
+                break;
+            n = 0;
+        }
+
+        if (sigint_reached())
+            break;
+
+        if (n == 0) {
+            if (timeout < 0)
+                continue;
+            break;
+        }
+
+        for (i=0; i < nfds; i++) {
+            int w = idx[i], nread;
+            uint8_t buf[256];
+
+            if (pfds[i].revents == 0)
+                continue;
+
+            nread = read(vp->fds[w], buf, sizeof(buf));
+            if (nread < 0 && errno == EINTR)
+                continue;
+
+            if (nread <= 0) {   /* done or died */
+                while (vp->pos[w] < vp->to[w]) {
+                    vp->status[vp->pos[w]++] = VRFY_FAILED;
+                    vp->nfailed++;
+                }
+                vrfy_stop_worker(vp, w, 0);
+                continue;
+            }
+
+            for (int j=0; j < nread && vp->pos[w] < vp->to[w]; j++) {
+                vp->status[vp->pos[w]++] = buf[j];
+                if (buf[j] != VRFY_OK)
+                    vp->nfailed++;
+            }
+        }
+    }
+
+    return vp->nfailed;
+}
+
+static int vrfy_wait(struct vrfy_pool *vp, int stop_on_failure)
+{
+    return vrfy_poll(vp, -1, stop_on_failure);
+}
+
+static void vrfy_free(struct vrfy_pool *vp)
+{
+    int i;
+
+    for (i=0; i < vp->nworkers; i++)
+        vrfy_stop_worker(vp, i, 1);
+
+    free(vp->status);
+    free(vp);
+}
+
+/* waits for pool, logs failures; RET: number of failed */
+static int vrfy_finish(struct vrfy_pool *vp)
+{
+    int i, nfailed;
+
+    nfailed = vrfy_wait(vp, 1);
+    for (i=0; i < n_array_size(vp->paths); i++) {
+        if (vp->status[i] == VRFY_FAILED)
+            logn(LOGERR, _("%s: MD5 signature verification failed"),
+                 n_basenam(n_array_nth(vp->paths, i)));
+    }
+
+    vrfy_free(vp);
+    return nfailed;
+}
+
 void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
                             const char *destdir, int is_destdir_custom)
 {
     long bytesget = 0, bytesdownload = 0, bytesused = 0;
+    tn_array *cached, *cached_pkgs;
     int i;
 
     n_assert(is_destdir_custom == 0); /* not implemented */
+    cached = n_array_new(16, free, NULL);
+    cached_pkgs = n_array_new(16, NULL, NULL);
+
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg  *pkg = n_array_nth(pkgs, i);
         char        path[PATH_MAX + 512]; /* -Wformat-truncation */
@@ -79,14 +338,29 @@ void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
                     bytesdownload += pkg->fsize;
 
                 } else {
-                    if (!pm_verify_signature(pmctx, path, PKGVERIFY_MD)) {
-                        vf_unlink(path);
-                        bytesdownload += pkg->fsize;
-                    }
+                    n_array_push(cached, n_strdup(path));
+                    n_array_push(cached_pkgs, pkg);
                 }
             }
         }
     }
+
+    if (n_array_size(cached) > 0 && !sigint_reached()) {
+        struct vrfy_pool *vp = vrfy_start(pmctx, cached);
+
+        vrfy_wait(vp, 0);
+        for (i=0; i < n_array_size(cached); i++) {
+            if (vp->status[i] != VRFY_OK) {
+                struct pkg *pkg = n_array_nth(cached_pkgs, i);
+                vf_unlink(n_array_nth(cached, i));
+                bytesdownload += pkg->fsize;
+            }
+        }
+        vrfy_free(vp);
+    }
+    n_array_free(cached);
+    n_array_free(cached_pkgs);
+
     if (bytesget) {
         char buf[64];
         n_assert(bytesget);
@@ -107,23 +381,59 @@ void packages_fetch_summary(struct pm_ctx *pmctx, const tn_array *pkgs,
     msg(1, "_\n");
 }
 
+struct fetch_groups {
+    tn_array  *urls_arr;        /* package dirs in order of appearance */
+    tn_hash   *urls_h;          /* pkgdir path => urls[] */
+    tn_hash   *pkgs_h;          /* pkgdir path => pkgs[] */
+    tn_hash   *labels_h;        /* pkgdir path => pkgdir name */
+};
+
+static void fetch_groups_add(struct fetch_groups *fg, struct pkg *pkg)
+{
+    char        *pkgpath = pkg->pkgdir->path;
+    char        path[PATH_MAX + 128];
+    tn_array    *urls, *packages;
+
+    if ((urls = n_hash_get(fg->urls_h, pkgpath)) == NULL) {
+        urls = n_array_new(16, free, NULL);
+        n_hash_insert(fg->urls_h, pkgpath, urls);
+
+        packages = n_array_new(16, NULL, NULL);
+        n_hash_insert(fg->pkgs_h, pkgpath, packages);
+
+        n_array_push(fg->urls_arr, pkgpath);
+        n_hash_insert(fg->labels_h, pkgpath, pkg->pkgdir->name);
+    }
+
+    packages = n_hash_get(fg->pkgs_h, pkgpath);
+
+    n_snprintf(path, sizeof(path), "%s/%s", pkgpath, pkg_filename_s(pkg));
+    n_array_push(urls, n_strdup(path));
+    n_array_push(packages, pkg);
+}
+
 int packages_fetch(struct pm_ctx *pmctx,
                    tn_array *pkgs, const char *destdir, int is_destdir_custom)
 {
     int       i, nerr, urltype, ncdroms;
-    tn_array  *urls = NULL, *packages = NULL;
-    tn_array  *urls_arr = NULL;
-    tn_hash   *urls_h, *pkgs_h = NULL;
-    tn_hash   *pkgdir_labels_h = NULL;
+    tn_array  *urls = NULL;
+    tn_array  *local, *cached, *cached_pkgs, *fetched = NULL;
+    struct fetch_groups fg;
+    struct vrfy_pool *vp = NULL;
+    unsigned char *verified = NULL;
 
     n_assert(destdir);
-    urls_h = n_hash_new(21, (tn_fn_free)n_array_free);
-    pkgs_h = n_hash_new(21, (tn_fn_free)n_array_free);
-    pkgdir_labels_h = n_hash_new(21, NULL);
-    n_hash_ctl(urls_h, TN_HASH_NOCPKEY);
-    n_hash_ctl(pkgs_h, TN_HASH_NOCPKEY);
+    fg.urls_h = n_hash_new(21, (tn_fn_free)n_array_free);
+    fg.pkgs_h = n_hash_new(21, (tn_fn_free)n_array_free);
+    fg.labels_h = n_hash_new(21, NULL);
+    n_hash_ctl(fg.urls_h, TN_HASH_NOCPKEY);
+    n_hash_ctl(fg.pkgs_h, TN_HASH_NOCPKEY);
     int pkgs_count = n_array_size(pkgs);
-    urls_arr = n_array_new(pkgs_count, NULL, (tn_fn_cmp)strcmp);
+    fg.urls_arr = n_array_new(pkgs_count, NULL, (tn_fn_cmp)strcmp);
+
+    local = n_array_new(16, free, NULL);
+    cached = n_array_new(16, free, NULL);
+    cached_pkgs = n_array_new(16, NULL, NULL);
 
     // group by URL
     ncdroms = 0;
@@ -131,9 +441,8 @@ int packages_fetch(struct pm_ctx *pmctx,
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg  *pkg = n_array_nth(pkgs, i);
         char        *pkgpath = pkg->pkgdir->path;
-        char        path[PATH_MAX + 128], *s;
+        char        path[PATH_MAX + 128];
         const char  *pkg_basename;
-        int         len;
 
         if (sigint_reached())
             break;
@@ -152,12 +461,9 @@ int packages_fetch(struct pm_ctx *pmctx,
                 nerr++;
 
             } else {
-                if (!pm_verify_signature(pmctx, path, PKGVERIFY_MD)) {
-                    logn(LOGERR, _("%s: MD5 signature verification failed"),
-                         n_basenam(path));
-                    nerr++;
-                }
+                n_array_push(local, n_strdup(path));
             }
+
             if (is_destdir_custom)
                 poldek_util_copy_file(path, destdir);
 
@@ -177,36 +483,41 @@ int packages_fetch(struct pm_ctx *pmctx,
                      pkg_basename);
         }
 
-        if (access(path, R_OK) == 0) {
-            int pkg_ok;
-
-            pkg_ok = pm_verify_signature(pmctx, path, PKGVERIFY_MD);
-            if (pkg_ok) {         /* we got it  */
-		pkgs_count--;
-                continue;
-	    }
-            else
-                vf_unlink(path);
+        if (access(path, R_OK) == 0) { /* verified below */
+            n_array_push(cached, n_strdup(path));
+            n_array_push(cached_pkgs, pkg);
+            continue;
         }
 
-        if ((urls = n_hash_get(urls_h, pkgpath)) == NULL) {
-            urls = n_array_new(n_array_size(pkgs), NULL, NULL);
-            n_hash_insert(urls_h, pkgpath, urls);
+        fetch_groups_add(&fg, pkg);
+    }
 
-            packages = n_array_new(n_array_size(pkgs), NULL, NULL);
-            n_hash_insert(pkgs_h, pkgpath, packages);
+    if (sigint_reached())
+        goto l_end;
 
-            n_array_push(urls_arr, pkgpath);
-            n_hash_insert(pkgdir_labels_h, pkgpath, pkg->pkgdir->name);
-        }
+    /* local packages, any failure breaks the whole thing */
+    if (n_array_size(local) > 0) {
+        nerr += vrfy_finish(vrfy_start(pmctx, local));
+        if (nerr)
+            goto l_end;
+    }
+
+    /* already fetched ones, broken are fetched again */
+    if (n_array_size(cached) > 0) {
+        vp = vrfy_start(pmctx, cached);
+        vrfy_wait(vp, 0);
 
-        len = n_snprintf(path, sizeof(path), "%s/%s", pkgpath, pkg_basename);
+        for (i=0; i < n_array_size(cached); i++) {
+            if (vp->status[i] == VRFY_OK) { /* we got it  */
+                pkgs_count--;
+                continue;
+            }
 
-        s = alloca(len + 1);
-        memcpy(s, path, len);
-        s[len] = '\0';
-        n_array_push(urls, s);
-        n_array_push(packages, pkg);
+            vf_unlink(n_array_nth(cached, i));
+            fetch_groups_add(&fg, n_array_nth(cached_pkgs, i));
+        }
+        vrfy_free(vp);
+        vp = NULL;
     }
 
     if (sigint_reached())
@@ -223,17 +534,24 @@ int packages_fetch(struct pm_ctx *pmctx,
     else if (ncdroms == 1)
         putenv("POLDEK_VFJUGGLE_CPMODE=link");
 
+    /*
+      Digests of packages fetched by internal modules are checked while
+      downloading; the rest is verified by the pool while next ones are
+      being downloaded. On the first failure fetching stops.
+    */
     int counter = 0;
-    for (i=0; i < n_array_size(urls_arr); i++) {
+    for (i=0; i < n_array_size(fg.urls_arr); i++) {
         char path[PATH_MAX];
         const char *real_destdir, *pkgdir_name;
-        char *pkgpath = n_array_nth(urls_arr, i);
+        char *pkgpath = n_array_nth(fg.urls_arr, i);
 
         if (sigint_reached())
             break;
 
-        urls = n_hash_get(urls_h, pkgpath);
-        packages = n_hash_get(pkgs_h, pkgpath);
+        if (vp && vrfy_poll(vp, 0, 1) > 0)
+            break;
+
+        urls = n_hash_get(fg.urls_h, pkgpath);
         real_destdir = destdir;
         if (is_destdir_custom == 0) {
             char buf[1024];
@@ -243,34 +561,57 @@ int packages_fetch(struct pm_ctx *pmctx,
             real_destdir = path;
         }
 
-        pkgdir_name = n_hash_get(pkgdir_labels_h, pkgpath);
-        if (!vf_fetcha(urls, real_destdir, 0, pkgdir_name, counter, pkgs_count)) {
+        pkgdir_name = n_hash_get(fg.labels_h, pkgpath);
+        verified = n_realloc(verified, n_array_size(urls));
+        if (!vf_fetcha_ex(urls, real_destdir, VF_FETCH_RPMDIGEST, pkgdir_name,
+                          counter, pkgs_count, verified)) {
             nerr++;
-        } else {
-            for (int j=0; j < n_array_size(urls); j++) {
-                char localpath[PATH_MAX];
-                n_snprintf(localpath, sizeof(localpath), "%s/%s", real_destdir,
-                         n_basenam(n_array_nth(urls, j)));
-
-                if (!pm_verify_signature(pmctx, localpath, PKGVERIFY_MD)) {
-                    logn(LOGERR, _("%s: MD5 signature verification failed"),
-                         n_basenam(localpath));
-                    nerr++;
-                }
+            break;
+        }
 
-		counter++;
-            }
+        if (vp) {
+            nerr += vrfy_finish(vp);
+            vp = NULL;
+            n_array_cfree(&fetched);
+
+            if (nerr)
+                break;
         }
+
+        fetched = n_array_new(n_array_size(urls), free, NULL);
+        for (int j=0; j < n_array_size(urls); j++) {
+            char localpath[PATH_MAX];
+
+            counter++;
+            if (verified[j])
+                continue;
+
+            n_snprintf(localpath, sizeof(localpath), "%s/%s", real_destdir,
+                       n_basenam(n_array_nth(urls, j)));
+
+            n_array_push(fetched, n_strdup(localpath));
+        }
+
+        if (n_array_size(fetched) > 0)
+            vp = vrfy_start(pmctx, fetched);
     }
 
  l_end:
+    if (vp)
+        nerr += vrfy_finish(vp);
+
     if (sigint_reached())
         nerr++;
 
-    n_array_free(urls_arr);
-    n_hash_free(urls_h);
-    n_hash_free(pkgs_h);
-    n_hash_free(pkgdir_labels_h);
+    n_array_cfree(&fetched);
+    n_cfree(&verified);
+    n_array_free(local);
+    n_array_free(cached);
+    n_array_free(cached_pkgs);
+    n_array_free(fg.urls_arr);
+    n_hash_free(fg.urls_h);
+    n_hash_free(fg.pkgs_h);
+    n_hash_free(fg.labels_h);
     return nerr == 0;
 }
 
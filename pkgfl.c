@@ -517,6 +517,116 @@ int pkgfl_restore_st(tn_alloc *na, tn_tuple **fl,
 }
 
 
+/*
+  Like pkgfl_restore_st() but read entries are passed to fn() one by
+  one instead of being collected, so memory used does not depend on
+  the file list size. An entry (with its dirname) is valid during fn()
+  call only; reading is stopped if fn() returns 0, stream position is
+  undefined then. With PKGFL_MAP_DIRNAMES files are skipped, not
+  loaded. Returns number of entries passed or -1 on error.
+*/
+int pkgfl_map_st(tn_stream *st, tn_array *dirs, int include,
+                 unsigned flags,
+                 int (*fn)(struct pkgfl_ent *flent, void *arg), void *arg)
+{
+    struct pkgfl_ent dnent;
+    uint32_t bsize = 0, ndirs = 0;
+    unsigned default_loadir;
+    int n = 0;
+
+    default_loadir = 1;
+    if (dirs)
+        default_loadir = include ? 0 : 1;
+
+    if (!n_stream_read_uint32(st, &bsize) || !n_stream_read_uint32(st, &ndirs))
+        return -1;
+
+    while (ndirs--) {
+        struct pkgfl_ent  *flent = NULL;
+        tn_alloc          *na = NULL;
+        char              dn[256], *dirname;
+        uint8_t           dnl = 0;
+        uint32_t          j, nfiles = 0;
+        int               loadir, dirname_len;
+
+        if (!n_stream_read_uint8(st, &dnl) || dnl == 0 ||
+            n_stream_read(st, dn, dnl) != dnl ||
+            !n_stream_read_uint32(st, &nfiles))
+            return -1;
+
+        dn[dnl - 1] = '\0';
+
+        loadir = default_loadir;
+        if (dirs && n_array_bsearch(dirs, dn))
+            loadir = include;
+
+        if (loadir) {
+            if (flags & PKGFL_MAP_DIRNAMES) {
+                flent = &dnent;
+
+            } else {
+                na = n_alloc_new(16, TN_ALLOC_OBSTACK);
+                flent = na->na_malloc(na, sizeof(*flent) +
+                                      (nfiles * sizeof(struct flfile*)));
+            }
+            dirname_len = dnl - 1;
+            dirname = prepare_dirname(dn, &dirname_len);
+            flent->dirname = dirname;
+            flent->items = 0;
+        }
+
+        for (j=0; j < nfiles; j++) {
+            char               bn[256], linkto[256];
+            uint8_t            bnl = 0, slen = 0;
+            uint16_t           mode = 0;
+            uint32_t           size = 0;
+            int                ok;
+
+            *linkto = '\0';
+            ok = n_stream_read_uint8(st, &bnl) &&
+                n_stream_read(st, bn, bnl) == bnl &&
+                n_stream_read_uint16(st, &mode) &&
+                n_stream_read_uint32(st, &size);
+
+            if (ok && S_ISLNK(mode))
+                ok = n_stream_read_uint8(st, &slen) &&
+                    n_stream_read(st, linkto, slen) == slen;
+
+            if (!ok) {
+                if (na)
+                    n_alloc_free(na);
+                return -1;
+            }
+
+            if (na) {
+                struct flfile *file;
+                file = flfile_new(na, size, mode, bn, bnl,
+                                  S_ISLNK(mode) ? linkto : NULL, slen);
+                flent->files[flent->items++] = file;
+            }
+        }
+
+        if (loadir) {
+            off_t off = n_stream_tell(st);
+            int rc = fn(flent, arg);
+
+            /* st may be used by others during fn() */
+            if (rc && n_stream_tell(st) != off)
+                n_stream_seek(st, off, SEEK_SET);
+
+            if (na)
+                n_alloc_free(na);
+            n++;
+            if (!rc)
+                return n;
+        }
+    }
+
+    n_stream_seek(st, 1, SEEK_CUR); /* skip ending '\n' */
+    return n;
+}
+
+
 int pkgfl_skip_st(tn_stream *st)
 {
     n_buf_restore_skip(st, TN_BUF_STORE_32B);
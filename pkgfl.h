@@ -74,6 +74,13 @@ EXPORT int pkgfl_store(tn_tuple *fl, tn_buf *nbuf, tn_array *exclpath,
 EXPORT int pkgfl_restore_st(tn_alloc *na, tn_tuple **fl,
                      tn_stream *st, tn_array *dirs, int include);
 
+/* streaming pkgfl_restore_st(), fn() gets entries one by one; st may
+   be read by others during fn() call, its position is restored after */
+#define PKGFL_MAP_DIRNAMES (1 << 0) /* entries without files (items = 0) */
+EXPORT int pkgfl_map_st(tn_stream *st, tn_array *dirs, int include,
+                 unsigned flags,
+                 int (*fn)(struct pkgfl_ent *flent, void *arg), void *arg);
+
 EXPORT int pkgfl_skip_st(tn_stream *st);
 
 EXPORT tn_array *pkgfl_array_new(int size);
@@ -15,6 +15,7 @@
 #endif
 
 #include <limits.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
@@ -27,7 +28,6 @@
 #include "compiler.h"
 #include "i18n.h"
 #include "log.h"
-#define POLDEK_PKG_DAG_COLOURS 1  /* for pkg_*color */
 #include "pkg.h"
 #include "pkgset.h"
 #include "misc.h"
@@ -35,197 +35,287 @@
 
 /*
  * Ordering: sort packages topologically
+ *
+ * Requirements are flattened once into an adjacency array indexed by
+ * position in the input array (reqpkg alternatives in their original
+ * order), and both passes run an iterative Tarjan-style DFS over it.
+ * Packages are emitted in DFS post-order, i.e. exactly as the recursive
+ * walker used to; strongly connected components found in the prereq
+ * pass are reported as Requires(pre) loops.
  */
-struct visit_install_order_s {
-    tn_array *ordered_pkgs;
-    tn_array *stack;
-    int nerrors;
-    int verbose_level;
+struct order_graph {
+    int           npkgs;
+    struct pkg    **pkgs;       /* index -> package */
+    int           *adj_start;   /* npkgs + 1 offsets into adj */
+    int           *adj;         /* indexes of required packages */
+    uint8_t       *adj_flags;   /* reqpkg flags of each edge */
 };
 
+struct pkg_idx {
+    const struct pkg *pkg;
+    int              idx;
+};
 
-static
-int visit_install_order(struct visit_install_order_s *vs, struct pkg *pkg,
-                        unsigned reqpkg_flag, int deep)
+static int pkg_idx_cmp(const void *a, const void *b)
 {
-    int i, last_stack_i = -1;
-    int verb = vs->verbose_level;
+    const struct pkg *p1 = ((const struct pkg_idx*)a)->pkg;
+    const struct pkg *p2 = ((const struct pkg_idx*)b)->pkg;
 
-    deep += 2;
+    return p1 < p2 ? -1 : (p1 > p2 ? 1 : 0);
+}
 
-    pkg_set_color(pkg, PKG_COLOR_GRAY);
-    if (pkg->reqpkgs == NULL || n_array_size(pkg->reqpkgs) == 0) {
-        msg(verb, "_\n");
-        msg_i(verb, deep, "_ visit %s  (NO REQS)", pkg->name);
-        goto l_end;
-    }
+static int pkg_idx_find(const struct pkg_idx *map, int n, const struct pkg *pkg)
+{
+    struct pkg_idx tmp = { pkg, -1 }, *found;
 
-    n_array_push(vs->stack, pkg);
-    last_stack_i = n_array_size(vs->stack) - 1;
+    found = bsearch(&tmp, map, n, sizeof(*map), pkg_idx_cmp);
+    return found ? found->idx : -1;
+}
 
-    msg(verb, "_\n");
-    msg_i(verb, deep, "_ visit %s -> (", pkg->name);
-    for (i=0; i < n_array_size(pkg->reqpkgs); i++) {
-        struct reqpkg *rp;
+static int graph_count_edges(const struct pkg *pkg)
+{
+    int i, n = 0;
 
-        rp = n_array_nth(pkg->reqpkgs, i);
-        msg(verb, "_%s%s, ", (rp->flags & reqpkg_flag) ? "*" : "",
-            rp->pkg->name);
+    if (pkg->reqpkgs == NULL)
+        return 0;
 
+    for (i=0; i < n_array_size(pkg->reqpkgs); i++) {
+        struct reqpkg *rp = n_array_nth(pkg->reqpkgs, i);
+
+        n++;
         if (rp->flags & REQPKG_MULTI) {
-            int n = 0;
-            while (rp->adds[n]) {
-                msg(verb, "_%s%s, ",
-                    (rp->adds[n]->flags & reqpkg_flag) ? "*" : "",
-                    rp->adds[n]->pkg->name);
+            int j = 0;
+            while (rp->adds[j++])
                 n++;
-            }
         }
     }
-    msg(verb, "_) {");
+    return n;
+}
 
-    for (i=0; i < n_array_size(pkg->reqpkgs); i++) {
-        struct reqpkg *rpkg, *rp;
-        int np = 0;
+static void graph_add_edge(struct order_graph *g, int *nedges,
+                           const struct pkg_idx *map, struct reqpkg *rp)
+{
+    int idx = pkg_idx_find(map, g->npkgs, rp->pkg);
 
-        rpkg = rp = n_array_nth(pkg->reqpkgs, i);
+    if (idx < 0)                /* required package is not being ordered */
+        return;
 
-        while (rp != NULL) {
-            if (pkg_is_color(rp->pkg, PKG_COLOR_WHITE)) {
-                if (rp->flags & reqpkg_flag)
-                    pkg_set_prereqed(rp->pkg);
-                else
-                    pkg_clr_prereqed(rp->pkg);
+    g->adj[*nedges] = idx;
+    g->adj_flags[*nedges] = rp->flags;
+    (*nedges)++;
+}
 
-                if (reqpkg_flag == 0 || (rp->flags & reqpkg_flag))
-                    visit_install_order(vs, rp->pkg, reqpkg_flag, deep);
+static void order_graph_init(struct order_graph *g, tn_array *pkgs)
+{
+    struct pkg_idx *map;
+    int i, nedges = 0;
+
+    g->npkgs = n_array_size(pkgs);
+    g->pkgs = n_malloc(sizeof(*g->pkgs) * (g->npkgs + 1));
+    g->adj_start = n_malloc(sizeof(*g->adj_start) * (g->npkgs + 1));
+
+    map = n_malloc(sizeof(*map) * (g->npkgs + 1));
+    for (i=0; i < g->npkgs; i++) {
+        g->pkgs[i] = n_array_nth(pkgs, i);
+        map[i].pkg = g->pkgs[i];
+        map[i].idx = i;
+        nedges += graph_count_edges(g->pkgs[i]);
+    }
+    qsort(map, g->npkgs, sizeof(*map), pkg_idx_cmp);
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_BLACK)) {
-                msg(verb, "_\n");
-                msg_i(verb, deep, "_   visited %s", rp->pkg->name);
+    g->adj = n_malloc(sizeof(*g->adj) * (nedges + 1));
+    g->adj_flags = n_malloc(sizeof(*g->adj_flags) * (nedges + 1));
 
-            } else if (pkg_is_color(rp->pkg, PKG_COLOR_GRAY)) { /* cycle  */
-                int is_loop = 0;
+    nedges = 0;
+    for (i=0; i < g->npkgs; i++) {
+        struct pkg *pkg = g->pkgs[i];
+        int j;
 
-                if (rp->flags & reqpkg_flag) {
-                    int j, nn = 0, nprereqs = 0;
+        g->adj_start[i] = nedges;
+        if (pkg->reqpkgs == NULL)
+            continue;
 
-                    for (j=n_array_size(vs->stack)-1; j >= 0; j--) {
-                        struct pkg *p = n_array_nth(vs->stack, j);
+        for (j=0; j < n_array_size(pkg->reqpkgs); j++) {
+            struct reqpkg *rp = n_array_nth(pkg->reqpkgs, j);
 
-                        if (p == rp->pkg)
-                            break;
+            graph_add_edge(g, &nedges, map, rp);
+            if (rp->flags & REQPKG_MULTI) {
+                int n = 0;
+                while (rp->adds[n])
+                    graph_add_edge(g, &nedges, map, rp->adds[n++]);
+            }
+        }
+    }
+    g->adj_start[g->npkgs] = nedges;
+    free(map);
+}
 
-                        nn++;
-                        if (!pkg_is_prereqed(p))
-                            break;
+static void order_graph_destroy(struct order_graph *g)
+{
+    free(g->pkgs);
+    free(g->adj_start);
+    free(g->adj);
+    free(g->adj_flags);
+    memset(g, 0, sizeof(*g));
+}
 
-                        nprereqs++;
-                    }
+struct order_state {
+    const struct order_graph *g;
+    unsigned    reqpkg_flag;
+    int         verbose_level;
+
+    int         *dfs_index;     /* 0 = not visited yet (white) */
+    int         *lowlink;
+    uint8_t     *on_stack;      /* on SCC stack (gray) */
+    int         *scc_stack;
+    int         scc_top;
+    int         *frame_node;    /* explicit DFS stack: node + edge cursor */
+    int         *frame_edge;
+    int         counter;
+
+    int         *ordered;
+    int         nordered;
+    int         nerrors;
+};
 
-                    if (nn > 0 && nn == nprereqs)
-                        is_loop = 1;
-                }
+static void report_loop(struct order_state *st, int from)
+{
+    const struct order_graph *g = st->g;
+    char *error;
+    int size, ne = 0, i;
 
-                if (is_loop) {
-                    vs->nerrors++;
+    st->nerrors++;
 
-                    if (verb > 2) {
-                        msg(verb, "\n");
-                        msg_i(verb, deep, "   cycle   %s -> %s", pkg->name,
-                              rp->pkg->name);
+    size = (st->scc_top - from + 1) * 128;
+    error = n_malloc(size);
 
-                    } else {
-                        char *error;
-                        int size, ne = 0;
+    ne += n_snprintf(error, size, _("Requires(pre) loop: "));
+    ne += n_snprintf(&error[ne], size - ne, "%s",
+                     g->pkgs[st->scc_stack[st->scc_top - 1]]->name);
 
-                        size = n_array_size(vs->stack) * 128;
-                        error = alloca(size);
+    for (i = st->scc_top - 2; i >= from; i--)
+        ne += n_snprintf(&error[ne], size - ne, " <- %s",
+                         g->pkgs[st->scc_stack[i]]->name);
 
-                        ne += n_snprintf(error, size, _("Requires(pre) loop: "));
-                        ne += n_snprintf(&error[ne], size - ne, "%s", rp->pkg->name);
-                        for (int ii=n_array_size(vs->stack)-1; ii >= 0; ii--) {
-                            struct pkg *p = n_array_nth(vs->stack, ii);
-                            ne += n_snprintf(&error[ne], size - ne, " <- %s", p->name);
-                        }
-                        log(LOGERR, "%s\n", error);
-                    }
+    log(LOGERR, "%s\n", error);
+    free(error);
+}
 
-                } else {
-                    msg(verb, "\n");
-                    msg_i(verb, deep, "   fakecycle   %s -> %s", pkg->name,
-                          rp->pkg->name);
-                }
+/* pops the component rooted at node, emitting it into the ordering */
+static void pop_component(struct order_state *st, int node)
+{
+    int from = st->scc_top;
 
-            } else
-                n_assert(0);
+    do {
+        from--;
+    } while (st->scc_stack[from] != node);
 
-            if (rpkg->flags & REQPKG_MULTI)
-                rp = rpkg->adds[np++];
-            else
-                rp = NULL;
-        }
-    }
+    if (st->reqpkg_flag && st->scc_top - from > 1)
+        report_loop(st, from);
 
-    msg(verb, "\n");
-    msg_i(verb, deep, "_ } ");
-    msg(verb, "_%s",  pkg->name);
-    for (i=n_array_size(vs->stack)-2; i >= 0; i--) {
-        struct pkg *p = n_array_nth(vs->stack, i);
-        if (p != pkg)
-            msg(verb, "_ <- %s", p->name);
-    }
-    msg(verb, "_\n");
-
- l_end:
-    pkg_set_color(pkg, PKG_COLOR_BLACK);
-    pkg_clr_prereqed(pkg);
-    msgn(verb, "push %s", pkg_snprintf_s(pkg));
-    n_array_push(vs->ordered_pkgs, pkg);
-    if (last_stack_i != -1)
-        for (i=last_stack_i; i < n_array_size(vs->stack); i++) {
-            pkg = n_array_pop(vs->stack);
-            pkg_clr_prereqed(pkg);
-        }
+    while (st->scc_top > from)
+        st->on_stack[st->scc_stack[--st->scc_top]] = 0;
+}
+
+static inline void push_node(struct order_state *st, int *top, int node)
+{
+    st->counter++;
+    st->dfs_index[node] = st->lowlink[node] = st->counter;
+    st->on_stack[node] = 1;
+    st->scc_stack[st->scc_top++] = node;
 
-    return 0;
+    st->frame_node[*top] = node;
+    st->frame_edge[*top] = st->g->adj_start[node];
+    (*top)++;
+
+    msgn_i(st->verbose_level, *top * 2, "_ visit %s",
+           st->g->pkgs[node]->name);
 }
 
-static void mapfn_clean_pkg_color(struct pkg *pkg)
+static void visit_install_order(struct order_state *st, int root)
 {
-    pkg_set_color(pkg, PKG_COLOR_WHITE);
-    pkg_clr_prereqed(pkg);
+    const struct order_graph *g = st->g;
+    int top = 0;
+
+    push_node(st, &top, root);
+
+    while (top > 0) {
+        int node = st->frame_node[top - 1];
+        int *edge = &st->frame_edge[top - 1];
+
+        if (*edge < g->adj_start[node + 1]) {
+            int req = g->adj[*edge];
+            uint8_t flags = g->adj_flags[*edge];
+
+            (*edge)++;
+
+            if (st->reqpkg_flag && (flags & st->reqpkg_flag) == 0)
+                continue;
+
+            if (st->dfs_index[req] == 0) {
+                push_node(st, &top, req);
+
+            } else if (st->on_stack[req]) {
+                if (st->dfs_index[req] < st->lowlink[node])
+                    st->lowlink[node] = st->dfs_index[req];
+            }
+            continue;
+        }
+
+        /* all requirements visited */
+        top--;
+        st->ordered[st->nordered++] = node;
+        msgn(st->verbose_level, "push %s", pkg_snprintf_s(g->pkgs[node]));
+
+        if (top > 0) {
+            int parent = st->frame_node[top - 1];
+            if (st->lowlink[node] < st->lowlink[parent])
+                st->lowlink[parent] = st->lowlink[node];
+        }
+
+        if (st->lowlink[node] == st->dfs_index[node])
+            pop_component(st, node);
+    }
 }
 
-static int do_order(tn_array *pkgs, tn_array **ordered_pkgs,
+/* orders packages given by roots (indexes into g), result goes to ordered */
+static int do_order(const struct order_graph *g, const int *roots, int *ordered,
                     unsigned reqpkg_flag, int verbose_level)
 {
-    struct pkg *pkg;
-    struct visit_install_order_s vs;
-    int i;
-
-    vs.ordered_pkgs = n_array_new(n_array_size(pkgs), NULL, NULL);
-//                                  (tn_fn_free)pkg_free, NULL);
-    vs.nerrors = 0;
-    vs.stack = n_array_new(128, NULL, NULL);
-    vs.verbose_level = verbose_level;
-
-    n_array_map(pkgs, (tn_fn_map1)mapfn_clean_pkg_color);
-
-    for (i=0; i<n_array_size(pkgs); i++) {
-        pkg = n_array_nth(pkgs, i);
-        if (pkg_is_color(pkg, PKG_COLOR_WHITE)) {
-            visit_install_order(&vs, pkg, reqpkg_flag, reqpkg_flag ? 1 : 0);
-            n_array_clean(vs.stack);
-        }
+    struct order_state st;
+    int i, n = g->npkgs;
+
+    memset(&st, 0, sizeof(st));
+    st.g = g;
+    st.reqpkg_flag = reqpkg_flag;
+    st.verbose_level = verbose_level;
+    st.ordered = ordered;
+
+    st.dfs_index = n_calloc(sizeof(*st.dfs_index), n + 1);
+    st.lowlink = n_malloc(sizeof(*st.lowlink) * (n + 1));
+    st.on_stack = n_calloc(sizeof(*st.on_stack), n + 1);
+    st.scc_stack = n_malloc(sizeof(*st.scc_stack) * (n + 1));
+    st.frame_node = n_malloc(sizeof(*st.frame_node) * (n + 1));
+    st.frame_edge = n_malloc(sizeof(*st.frame_edge) * (n + 1));
+
+    for (i=0; i < n; i++) {
+        int root = roots ? roots[i] : i;
+
+        if (st.dfs_index[root] == 0)
+            visit_install_order(&st, root);
     }
 
-    n_assert(n_array_size(vs.ordered_pkgs) == n_array_size(pkgs));
+    n_assert(st.nordered == n);
+    n_assert(st.scc_top == 0);
 
-    n_assert(*ordered_pkgs == NULL);
-    n_array_free(vs.stack);
-    *ordered_pkgs = vs.ordered_pkgs;
-    return vs.nerrors;
+    free(st.dfs_index);
+    free(st.lowlink);
+    free(st.on_stack);
+    free(st.scc_stack);
+    free(st.frame_node);
+    free(st.frame_edge);
+
+    return st.nerrors;
 }
 
 
@@ -233,18 +323,25 @@ static int do_order(tn_array *pkgs, tn_array **ordered_pkgs,
 static int do_packages_order(tn_array *pkgs, tn_array **ordered_pkgs, int ordertype,
                              int verbose_level)
 {
-    tn_array *preordered = NULL;
+    struct order_graph graph;
+    int *preordered, *ordered;
     unsigned reqpkg_flag = 0;
-    int nloops;
+    int nloops, i;
 
     n_assert(n_array_ctl_get_cmpfn(pkgs) == (tn_fn_cmp)pkg_cmp_name_evr_rev);
     /* insertion sort - assuming pkgs is already sorted
        by pkg_cmp_pri_name_evr_rev() */
     n_array_isort_ex(pkgs, (tn_fn_cmp)pkg_cmp_pri_name_evr_rev);
 
+    order_graph_init(&graph, pkgs);
+    n_array_isort(pkgs);
+
+    preordered = n_malloc(sizeof(*preordered) * (graph.npkgs + 1));
+    ordered = n_malloc(sizeof(*ordered) * (graph.npkgs + 1));
+
     /* Preordering packages using Requires: */
     msgn(verbose_level + 2, "Preordering packages...");
-    do_order(pkgs, &preordered, 0, verbose_level + 2);
+    do_order(&graph, NULL, preordered, 0, verbose_level + 2);
 
     switch (ordertype) {
         case PKGORDER_INSTALL:
@@ -259,11 +356,17 @@ static int do_packages_order(tn_array *pkgs, tn_array **ordered_pkgs, int ordert
             n_assert(0);
     }
     msgn(verbose_level + 2, "Ordering packages...");
-    *ordered_pkgs = NULL;
-    nloops = do_order(preordered, ordered_pkgs, reqpkg_flag, verbose_level + 1);
+    nloops = do_order(&graph, preordered, ordered, reqpkg_flag,
+                      verbose_level + 1);
 
-    n_array_free(preordered);
-    n_array_isort(pkgs);
+    n_assert(*ordered_pkgs == NULL);
+    *ordered_pkgs = n_array_new(graph.npkgs, NULL, NULL);
+    for (i=0; i < graph.npkgs; i++)
+        n_array_push(*ordered_pkgs, graph.pkgs[ordered[i]]);
+
+    free(preordered);
+    free(ordered);
+    order_graph_destroy(&graph);
 
     return nloops;
 }
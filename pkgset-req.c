@@ -31,6 +31,7 @@
 #include "capreq.h"
 #include "pkgset-req.h"
 #include "fileindex.h"
+#include "parallel.h"
 
 extern int poldek_conf_MULTILIB;
 extern tn_array *pkgset_search_provdir(struct pkgset *ps, const char *dir);
@@ -49,6 +50,12 @@ int setup_cnfl_pkgs(struct pkg *pkg, struct capreq *cnfl, int strict,
 static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
                         struct pkg ***suspkgs, struct pkg **pkgsbuf, int *npkgs);
 
+static int psreq_match_pkgs(const struct pkg *pkg, const struct capreq *req,
+                            int strict,
+                            struct pkg *suspkgs[], int npkgs,
+                            struct pkg **matches, int *nmatched);
+static void isort_pkgs(struct pkg *pkgs[], size_t size);
+
 static struct reqpkg *reqpkg_new(struct pkg *pkg, struct capreq *req,
                                  uint8_t flags, int nadds)
 {
@@ -144,14 +151,157 @@ static int pkgset_add_unreq(struct pkgset *ps, struct pkg *pkg,
 }
 
 
+/*
+  Requirements are resolved in two phases: workers look up every
+  requirement of their part of ps->pkgs against read-only indexes
+  (cap_idx, file_idx) into a per-worker cache, then results are merged
+  into reqpkgs/revreqpkgs serially in ps->pkgs order, so the outcome
+  does not depend on the number of workers. Cached are packages matching
+  the requirement only, they are the same for every requiring package;
+  self and PM's virtual package matches are sorted out during merge. Requirements which need
+  pkgdir dirindexes or PM (rpmlib(), directory provides, etc) are
+  deferred to the merge phase.
+*/
+#define RMATCH_NOTFOUND  0
+#define RMATCH_FOUND     1
+#define RMATCH_DEFERRED  2
+
+#define VRFY_MIN_PKGS_PER_WORKER 512
+
+struct req_match {
+    tn_array *matches;          /* all matching packages, owned by worker's cache */
+    uint8_t  status;
+};
+
+struct vrfy_deps_s {
+    struct pkgset    *ps;
+    int              strict;
+    int              *reqoffs;  /* index of package's 1st req in rmatches */
+    struct req_match *rmatches;
+    tn_hash          **caches;  /* per worker */
+};
+
+static void req_match_free(struct req_match *rm)
+{
+    n_array_cfree(&rm->matches);
+    free(rm);
+}
+
+/* thread-safe part of pkgset_find_match_packages(), independent of
+   requiring package */
+static int psreq_match_quick(struct pkgset *ps, const struct capreq *req,
+                             int strict, tn_array **packages)
+{
+    struct pkg *const *suspkgs = NULL, *pkgsbuf[1024], **matches;
+    const char *reqname = capreq_name(req);
+    int nsuspkgs = 0, nmatches = 0, i;
+
+    if (capreq_is_rpmlib(req))
+        return RMATCH_DEFERRED;
+
+    nsuspkgs = capreq_idx_lookup_pkgs(&ps->cap_idx, reqname,
+                                      capreq_name_len(req), &suspkgs);
+
+    if (nsuspkgs == 0 && capreq_is_file(req)) {
+        nsuspkgs = file_index_lookup(ps->file_idx, reqname, 0, pkgsbuf, 1024);
+        suspkgs = pkgsbuf;
+    }
+
+    if (nsuspkgs == 0)          /* dirindex or PM lookup is needed */
+        return RMATCH_DEFERRED;
+
+    matches = alloca(sizeof(*matches) * nsuspkgs);
+    for (i=0; i < nsuspkgs; i++) {
+        struct pkg *spkg = suspkgs[i];
+
+        if (capreq_has_ver(req) && !pkg_match_req(spkg, req, strict))
+            continue;
+
+        matches[nmatches++] = spkg;
+    }
+
+    if (nmatches == 0)
+        return RMATCH_NOTFOUND;
+
+    if (nmatches > 1)
+        isort_pkgs(matches, nmatches);
+
+    *packages = n_array_new(nmatches, NULL,
+                            (tn_fn_cmp)pkg_cmp_name_evr_rev);
+
+    for (i=0; i < nmatches; i++)
+        n_array_push(*packages, matches[i]);
+
+    return RMATCH_FOUND;
+}
+
+/* like psreq_match_pkgs(): requirement matched by pkg itself or by PM's
+   virtual package is treated as self match */
+static int psreq_is_selfmatch(const struct pkg *pkg, const tn_array *matches)
+{
+    int i;
+
+    for (i=0; i < n_array_size(matches); i++) {
+        struct pkg *spkg = n_array_nth(matches, i);
+
+        if (spkg == pkg || pkg_is_pmcaps(spkg))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void vrfy_deps_worker(void *arg, int from, int to, int nth)
+{
+    struct vrfy_deps_s *vs = arg;
+    tn_hash *cache;
+    int i, j;
+
+    cache = n_hash_new((to - from) * 2 + 16, (tn_fn_free)req_match_free);
+    vs->caches[nth] = cache;
+
+    for (i = from; i < to; i++) {
+        struct pkg *pkg = n_array_nth(vs->ps->pkgs, i);
+        struct req_match *slot = &vs->rmatches[vs->reqoffs[i]];
+
+        if (pkg->reqs == NULL)
+            continue;
+
+        for (j=0; j < n_array_size(pkg->reqs); j++) {
+            struct capreq *req = n_array_nth(pkg->reqs, j);
+            struct req_match *rm;
+            char streq[256];
+            uint32_t khash;
+            int klen;
+
+            klen = capreq_snprintf(streq, sizeof(streq), req);
+            khash = n_hash_compute_hash(cache, streq, klen);
+
+            if ((rm = n_hash_hget(cache, streq, klen, khash))) {
+                slot[j] = *rm;
+                continue;
+            }
+
+            slot[j].matches = NULL;
+            slot[j].status = psreq_match_quick(vs->ps, req, vs->strict,
+                                               &slot[j].matches);
+
+            rm = n_malloc(sizeof(*rm));
+            *rm = slot[j];
+            n_hash_hinsert(cache, streq, klen, khash, rm);
+        }
+    }
+}
+
 int pkgset_verify_deps(struct pkgset *ps, int strict)
 {
+    struct vrfy_deps_s vs;
     struct pkgmark_set *pms;
-    int nerrors = 0;
+    int nerrors = 0, nworkers, nreqs = 0;
     tn_hash *cache;
     int i,j;
 
-    cache = n_hash_new(n_array_size(ps->pkgs), (tn_fn_free)n_array_free);
+    cache = n_hash_new(127, (tn_fn_free)n_array_free);
 
     n_assert(ps->_vrfy_unreqs == NULL);
     ps->_vrfy_unreqs = n_hash_new(127, (tn_fn_free)n_array_free);
@@ -159,6 +309,33 @@ int pkgset_verify_deps(struct pkgset *ps, int strict)
 
     msgn(4, _("\nVerifying dependencies..."));
 
+    memset(&vs, 0, sizeof(vs));
+    vs.ps = ps;
+    vs.strict = strict;
+    vs.reqoffs = n_malloc(sizeof(*vs.reqoffs) * (n_array_size(ps->pkgs) + 1));
+
+    for (i=0; i < n_array_size(ps->pkgs); i++) {
+        struct pkg *pkg = n_array_nth(ps->pkgs, i);
+
+        vs.reqoffs[i] = nreqs;
+        if (pkg->reqs)
+            nreqs += n_array_size(pkg->reqs);
+    }
+    vs.reqoffs[i] = nreqs;
+    vs.rmatches = n_malloc(sizeof(*vs.rmatches) * (nreqs + 1));
+
+    /* workers' debug messages would be mixed up */
+    if (poldek_VERBOSE > 3)
+        nworkers = 1;
+    else
+        nworkers = poldek__parallel_nworkers(n_array_size(ps->pkgs),
+                                             VRFY_MIN_PKGS_PER_WORKER);
+
+    vs.caches = n_calloc(sizeof(*vs.caches), nworkers);
+    poldek__parallel_for(n_array_size(ps->pkgs),
+                         nworkers > 1 ? VRFY_MIN_PKGS_PER_WORKER : INT_MAX,
+                         vrfy_deps_worker, &vs);
+
     for (i=0; i < n_array_size(ps->pkgs); i++) {
         struct pkg *pkg;
 
@@ -173,33 +350,40 @@ int pkgset_verify_deps(struct pkgset *ps, int strict)
         msgn(4, "%d. %s", i+1, pkg_id(pkg));
         for (j=0; j < n_array_size(pkg->reqs); j++) {
             struct capreq *req = n_array_nth(pkg->reqs, j);
-            char streq[256];
+            struct req_match *rm = &vs.rmatches[vs.reqoffs[i] + j];
             tn_array *matches = NULL;
-            uint32_t khash;
-            int klen;
 
-            klen = capreq_snprintf(streq, sizeof(streq), req);
-            //n_assert(klen == (int)strlen(streq));
-            khash = n_hash_compute_hash(cache, streq, klen);
+            if (rm->status == RMATCH_FOUND) {
+                if (poldek_VERBOSE > 3) {
+                    msg(4, " req %-35s --> ", capreq_snprintf_s(req));
+                    for (int ii=0; ii < n_array_size(rm->matches); ii++)
+                        msg(4, "_%s, ", pkg_id(n_array_nth(rm->matches, ii)));
+                    msg(4, "\n");
+                }
 
-            if (n_hash_hexists(cache, streq, klen, khash)) {
-                matches = n_hash_hget(cache, streq, klen, khash);
+                if (psreq_is_selfmatch(pkg, rm->matches))
+                    continue;
 
-                if (!matches)
-                    msgn(4, _(" req %-35s --> NOT FOUND"), streq);
-                else if (n_array_size(matches) > 0) {
-                    msg(4, " req %-35s --> ", streq);
-                    for (int ii=0; ii < n_array_size(matches); ii++)
-                        msg(4, "_%s, ", pkg_id(n_array_nth(matches, ii)));
-                    msg(4, "_\n");
-                }
+                matches = rm->matches;
 
-            } else {
-                int found = pkgset_find_match_packages(ps, pkg, req, &matches, strict);
-                if (found && matches == NULL)
-                    matches = pkgs_array_new(2);
+            } else if (rm->status == RMATCH_DEFERRED) {
+                char streq[256];
+                uint32_t khash;
+                int klen;
 
-                n_hash_hinsert(cache, streq, klen, khash, matches);
+                klen = capreq_snprintf(streq, sizeof(streq), req);
+                khash = n_hash_compute_hash(cache, streq, klen);
+
+                if (n_hash_hexists(cache, streq, klen, khash)) {
+                    matches = n_hash_hget(cache, streq, klen, khash);
+
+                } else {
+                    int found = pkgset_find_match_packages(ps, pkg, req, &matches, strict);
+                    if (found && matches == NULL)
+                        matches = pkgs_array_new(2);
+
+                    n_hash_hinsert(cache, streq, klen, khash, matches);
+                }
             }
 
             if (matches == NULL) /* not found / unmatched */
@@ -238,6 +422,13 @@ int pkgset_verify_deps(struct pkgset *ps, int strict)
         msgn(4, _("%d unsatisfied dependencies, %d packages cannot be installed"),
             nerrors, ps->nerrors);
 
+    for (i=0; i < nworkers; i++)
+        if (vs.caches[i])
+            n_hash_free(vs.caches[i]);
+
+    free(vs.caches);
+    free(vs.rmatches);
+    free(vs.reqoffs);
     n_hash_free(cache);
     pkgmark_set_free(pms);
     return nerrors == 0;
@@ -384,21 +575,34 @@ static int psreq_lookup(struct pkgset *ps, const struct capreq *req,
     */
 
     if (capreq_is_rpmlib(req) && matched) {
-        int i;
+        int i, pmcaps_matched = -1;
 
         for (i=0; i<*npkgs; i++) {
-            if (strcmp((*suspkgs)[i]->name, "rpm") != 0) {
+            struct pkg *spkg = (*suspkgs)[i];
+
+            if (pkg_is_pmcaps(spkg)) {
+                pmcaps_matched = !capreq_has_ver(req) ||
+                    pkg_match_req(spkg, req, 1);
+                continue;
+            }
+
+            if (strcmp(spkg->name, "rpm") != 0) {
                 logn(LOGERR, _("%s: provides rpmlib cap \"%s\""),
-                     pkg_id((*suspkgs)[i]), reqname);
+                     pkg_id(spkg), reqname);
                 matched = 0;
             }
         }
 
+        if (matched && pmcaps_matched == 0) /* PM has it, but too old */
+            matched = 0;
+
         *suspkgs = NULL;
         *npkgs = 0;
     }
 
-    if (!matched && pkgset_pm_satisfies(ps, req)) {
+    /* rpmlib() caps are resolved via ps->pmcaps_pkg if PM reports them */
+    if (!matched && (ps->pmcaps_pkg == NULL || !capreq_is_rpmlib(req)) &&
+        pkgset_pm_satisfies(ps, req)) {
         matched = 1;
         msgn(4, _(" req %-35s --> PM_CAP"), capreq_snprintf_s(req));
 
@@ -431,7 +635,8 @@ static int psreq_match_pkgs(const struct pkg *pkg, const struct capreq *req,
         msg(4, "_%s, ", pkg_id(spkg));
         nmatch++;
 
-        if (pkg && spkg != pkg) { /* do not add itself (pkg may be NULL) */
+        /* do not add itself (pkg may be NULL) nor PM's virtual package */
+        if (pkg && spkg != pkg && !pkg_is_pmcaps(spkg)) {
             matches[n++] = spkg;
 
         } else {
@@ -623,8 +828,8 @@ static int setup_cnfl_pkgs(struct pkg *pkg, struct capreq *cnfl, int strict,
             if (!pkg_match_req(spkg, cnfl, strict))
                 continue;
 
-        /* do not conflict with myself */
-        if (spkg == pkg)
+        /* do not conflict with myself nor with PM */
+        if (spkg == pkg || pkg_is_pmcaps(spkg))
             continue;
 
         /* multilib */
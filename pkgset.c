@@ -92,6 +92,9 @@ void pkgset_free(struct pkgset *ps)
         ps->flags &= (unsigned)~_PKGSET_INDEXES_INIT;
     }
 
+    if (ps->pmcaps_pkg)
+        pkg_free(ps->pmcaps_pkg);
+
     if (ps->_vrfy_unreqs)
         n_hash_free(ps->_vrfy_unreqs);
 
@@ -166,6 +169,33 @@ static int pkgfl2fidx(const struct pkg *pkg, struct file_index *fidx, int setup)
 }
 
 
+/*
+  PM's internal caps (rpmlib(), cpuinfo() etc) are indexed as provided
+  by a virtual package which is never a member of ps->pkgs; requirements
+  matched by it are satisfied without any package (see psreq_match_pkgs())
+*/
+static void index_pmcaps(struct pkgset *ps)
+{
+    struct pkg *pkg;
+    tn_array *caps;
+    int i;
+
+    if (ps->pmctx == NULL || (caps = pm_rpmlib_caps(ps->pmctx)) == NULL)
+        return;
+
+    pkg = pkg_new("rpmlib", 0, "0", "0", NULL, NULL);
+    pkg->flags |= PKG_PMCAPS;
+    pkg->caps = caps;
+
+    for (i=0; i < n_array_size(caps); i++) {
+        struct capreq *cap = n_array_nth(caps, i);
+        capreq_idx_add(&ps->cap_idx, capreq_name(cap), capreq_name_len(cap), pkg);
+    }
+
+    msgn(3, " indexed %d internal capabilities", n_array_size(caps));
+    ps->pmcaps_pkg = pkg;
+}
+
 static int pkgset_index(struct pkgset *ps)
 {
     if (ps->flags & _PKGSET_INDEXES_INIT)
@@ -192,6 +222,7 @@ static int pkgset_index(struct pkgset *ps)
 
         do_pkgset_add_package(ps, pkg, 0);
     }
+    index_pmcaps(ps);
     MEMINF("after index");
 
 #if ENABLE_TRACE
@@ -496,7 +527,8 @@ tn_array *find_capreq(struct pkgset *ps, tn_array *pkgs,
 
     if (ent && ent->items > 0) {
         for (unsigned i=0; i < ent->items; i++)
-            n_array_push(pkgs, pkg_link(ent->crent_pkgs[i]));
+            if (!pkg_is_pmcaps(ent->crent_pkgs[i]))
+                n_array_push(pkgs, pkg_link(ent->crent_pkgs[i]));
 
     }
 
@@ -33,6 +33,7 @@ struct pkgset {
     int                nerrors;
 
     struct pm_ctx      *pmctx;
+    struct pkg         *pmcaps_pkg;     /* PM's internal caps, in cap_idx only */
 
     tn_hash            *_vrfy_unreqs;
     tn_array           *_vrfy_file_conflicts;
@@ -498,6 +498,13 @@ static tn_array *get_parsed_changelog(struct pkguinf *inf, time_t since)
     return entries;
 }
 
+static int is_security_fix(const struct changelog_ent *ent)
+{
+    const char *m = ent->message;
+
+    return strstr(m, "CVE-20") || strstr(m, "CVE-19") || strcasestr(m, "security");
+}
+
 int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
 {
     tn_array *entries;
@@ -508,10 +515,7 @@ int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
         return 0;
 
     for (i=0; i < n_array_size(entries); i++) {
-        struct changelog_ent *ent = n_array_nth(entries, i);
-        const char *m = ent->message;
-
-        if (strstr(m, "CVE-20") || strstr(m, "CVE-19") || strcasestr(m, "security")) {
+        if (is_security_fix(n_array_nth(entries, i))) {
             yes = 1;
             break;
         }
@@ -520,6 +524,26 @@ int pkguinf_changelog_with_security_fixes(struct pkguinf *inf, time_t since)
     return yes;
 }
 
+/* returns timestamp of the newest security fix entry or 0 if none */
+time_t pkguinf_changelog_last_security_fix(struct pkguinf *inf)
+{
+    tn_array *entries;
+    time_t last = 0;
+    int i;
+
+    if ((entries = get_parsed_changelog(inf, 0)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(entries); i++) {
+        struct changelog_ent *ent = n_array_nth(entries, i);
+
+        if (ent->ts > last && is_security_fix(ent))
+            last = ent->ts;
+    }
+    n_array_free(entries);
+    return last;
+}
+
 const char *pkguinf_get_changelog(struct pkguinf *inf, time_t since)
 {
     tn_array *entries;
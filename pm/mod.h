@@ -90,6 +90,8 @@ struct pm_module {
                                    const char *dbpath, unsigned pkgdir_ldflags,
                                    tn_hash *kw);
     int (*machine_score)(void *modh, int tag, const char *val);
+    tn_array *(*rpmlib_caps)(void *modh);
+    int (*dbflush)(void *modh); /* writes changes deferred by dbtxcommit */
 };
 
 int pm_module_register(const struct pm_module *mod);
@@ -31,6 +31,29 @@
 #include "pm.h"
 #include "mod.h"
 #include "log.h"
+#include "pkgfl.h"
+
+/*
+  In-memory index of installed packages; once built, dependency queries
+  (pkgdb_search(), pkgdb_match_req(), pkgdb_q_what_requires() and
+  pkgdb_q_is_required()) are answered from it instead of rpmdb
+  iterators.
+
+  Index may be shared between pkgdb handles (see pkgdb_set_index()):
+  it remembers the database it was built from and the database mtime
+  it reflects, so changes made outside are detected by single stat().
+*/
+struct pkgdb_idx {
+    tn_array *pkgs;             /* installed packages sorted by recno */
+    tn_hash  *names;            /* name        => pkgs[] */
+    tn_hash  *caps;             /* cap name    => pkgs[] */
+    tn_hash  *reqs;             /* req name    => pkgs[] */
+    tn_hash  *dirs;             /* dirname     => pkgs[] having files in it */
+    unsigned flags;             /* PKGDB_IDX_* */
+    char     *dbpath;           /* full path of indexed database */
+    time_t   dbmtime;           /* its mtime index is up to date with */
+    int      _refcnt;
+};
 
 
 
@@ -119,6 +142,8 @@ pkgdb_filter_fn pkgdb_set_filter(struct pkgdb *db,
 
 void pkgdb_close(struct pkgdb *db)
 {
+    pkgdb_free_index(db);
+
     if (db->_opened) {
         n_assert(db->_ctx->mod->dbclose);
         db->_ctx->mod->dbclose(db->dbh);
@@ -163,6 +188,10 @@ int pkgdb_tx_commit(struct pkgdb *db)
 
     if (db->_txcnt == 0 && db->_ctx->mod->dbtxcommit)
         db->_ctx->mod->dbtxcommit(db->dbh);
+
+    /* database changed; shared index is updated by its owner */
+    if (db->_txcnt == 0 && db->_idx && db->_idx->_refcnt == 0)
+        pkgdb_free_index(db);
     return db->_txcnt;
 }
 
@@ -339,6 +368,498 @@ static int dbpkg_array_has(const tn_array *pkgs, int recno)
     return n_array_bsearch(pkgs, &tmp) != NULL;
 }
 
+#define PKGDB_IDX_LDFLAGS (PKG_LDNEVR | PKG_LDCAPREQS | PKG_LDFL_WHOLE)
+
+static char *db_fullpath(struct pm_ctx *ctx, const char *rootdir,
+                         const char *dbpath, char *path, size_t size)
+{
+    char tmp[PATH_MAX];
+
+    if (dbpath == NULL && (dbpath = pm_dbpath(ctx, tmp, sizeof(tmp))) == NULL)
+        return NULL;
+
+    if (rootdir && *rootdir == '/' && *(rootdir + 1) == '\0')
+        rootdir = NULL;
+
+    n_snprintf(path, size, "%s%s", rootdir ? rootdir : "", dbpath);
+    return path;
+}
+
+static void idx_add(tn_hash *ht, const char *key, struct pkg *pkg, int sort)
+{
+    tn_array *pkgs;
+
+    if ((pkgs = n_hash_get(ht, key)) == NULL) {
+        pkgs = n_array_new(2, NULL, (tn_fn_cmp)pkg_cmp_recno);
+        n_hash_insert(ht, key, pkgs);
+    }
+
+    n_array_push(pkgs, pkg);    /* not linked, idx->pkgs holds them */
+    if (sort)
+        n_array_sort(pkgs);
+}
+
+static void idx_del(tn_hash *ht, const char *key, struct pkg *pkg)
+{
+    tn_array *pkgs;
+    int i;
+
+    if ((pkgs = n_hash_get(ht, key)) == NULL)
+        return;
+
+    if ((i = n_array_bsearch_idx(pkgs, pkg)) >= 0)
+        n_array_remove_nth(pkgs, i);
+}
+
+static void idx_ent_setup(const char *key, void *pkgs)
+{
+    key = key;
+    n_array_sort(pkgs);
+    n_array_uniq(pkgs);
+}
+
+/* sort != 0 means index is already set up and touched entries are resorted */
+static void idx_add_pkg(struct pkgdb_idx *idx, struct pkg *pkg, int sort)
+{
+    int i;
+
+    n_array_push(idx->pkgs, pkg);
+    if (sort)
+        n_array_sort(idx->pkgs);
+
+    idx_add(idx->names, pkg->name, pkg, sort);
+
+    if (pkg->caps)
+        for (i=0; i < n_array_size(pkg->caps); i++) {
+            struct capreq *cap = n_array_nth(pkg->caps, i);
+            idx_add(idx->caps, capreq_name(cap), pkg, sort);
+        }
+
+    if (pkg->reqs)
+        for (i=0; i < n_array_size(pkg->reqs); i++) {
+            struct capreq *req = n_array_nth(pkg->reqs, i);
+            idx_add(idx->reqs, capreq_name(req), pkg, sort);
+        }
+
+    if (pkg->fl && (idx->flags & PKGDB_IDX_NOFL) == 0)
+        for (i=0; i < n_tuple_size(pkg->fl); i++) {
+            struct pkgfl_ent *flent = n_tuple_nth(pkg->fl, i);
+            if (flent->items > 0)
+                idx_add(idx->dirs, flent->dirname, pkg, sort);
+        }
+}
+
+static void idx_remove_pkg(struct pkgdb_idx *idx, struct pkg *pkg)
+{
+    int i;
+
+    idx_del(idx->names, pkg->name, pkg);
+
+    if (pkg->caps)
+        for (i=0; i < n_array_size(pkg->caps); i++) {
+            struct capreq *cap = n_array_nth(pkg->caps, i);
+            idx_del(idx->caps, capreq_name(cap), pkg);
+        }
+
+    if (pkg->reqs)
+        for (i=0; i < n_array_size(pkg->reqs); i++) {
+            struct capreq *req = n_array_nth(pkg->reqs, i);
+            idx_del(idx->reqs, capreq_name(req), pkg);
+        }
+
+    if (pkg->fl && (idx->flags & PKGDB_IDX_NOFL) == 0)
+        for (i=0; i < n_tuple_size(pkg->fl); i++) {
+            struct pkgfl_ent *flent = n_tuple_nth(pkg->fl, i);
+            idx_del(idx->dirs, flent->dirname, pkg);
+        }
+
+    if ((i = n_array_bsearch_idx(idx->pkgs, pkg)) >= 0)
+        n_array_remove_nth(idx->pkgs, i); /* frees pkg */
+}
+
+static struct pkgdb_idx *idx_new(unsigned flags)
+{
+    struct pkgdb_idx *idx;
+
+    idx = n_calloc(1, sizeof(*idx));
+    idx->pkgs = pkgs_array_new_ex(1024, pkg_cmp_recno);
+    idx->names = n_hash_new(1024, (tn_fn_free)n_array_free);
+    idx->caps = n_hash_new(4096, (tn_fn_free)n_array_free);
+    idx->reqs = n_hash_new(4096, (tn_fn_free)n_array_free);
+    idx->dirs = n_hash_new(4096, (tn_fn_free)n_array_free);
+    idx->flags = flags;
+    return idx;
+}
+
+static void idx_setup(struct pkgdb_idx *idx)
+{
+    n_array_sort(idx->pkgs);
+    n_hash_map(idx->names, idx_ent_setup);
+    n_hash_map(idx->caps, idx_ent_setup);
+    n_hash_map(idx->reqs, idx_ent_setup);
+    n_hash_map(idx->dirs, idx_ent_setup);
+}
+
+struct pkgdb_idx *pkgdb_idx_new(struct pm_ctx *ctx, const char *rootdir,
+                                time_t dbmtime, tn_array *pkgs,
+                                unsigned flags)
+{
+    struct pkgdb_idx *idx;
+    char path[PATH_MAX];
+    int i;
+
+    if (db_fullpath(ctx, rootdir, NULL, path, sizeof(path)) == NULL)
+        return NULL;
+
+    idx = idx_new(flags);
+    idx->dbpath = n_strdup(path);
+    idx->dbmtime = dbmtime;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (pkg->recno == 0) {  /* not a db package */
+            pkgdb_idx_free(idx);
+            return NULL;
+        }
+
+        /* rpmdbcache packages are not loaded by load_pkg(), so make
+           them look like ones, as cap lookups must agree with db */
+        pkg_add_selfcap(pkg);
+        pkg->flags |= PKG_DBPKG;
+
+        idx_add_pkg(idx, pkg_link(pkg), 0);
+    }
+
+    idx_setup(idx);
+    msgn(3, "Indexed %d installed packages", n_array_size(idx->pkgs));
+    return idx;
+}
+
+struct pkgdb_idx *pkgdb_idx_link(struct pkgdb_idx *idx)
+{
+    idx->_refcnt++;
+    return idx;
+}
+
+void pkgdb_idx_free(struct pkgdb_idx *idx)
+{
+    if (idx->_refcnt > 0) {
+        idx->_refcnt--;
+        return;
+    }
+
+    n_hash_free(idx->names);
+    n_hash_free(idx->caps);
+    n_hash_free(idx->reqs);
+    n_hash_free(idx->dirs);
+    n_array_free(idx->pkgs);
+    n_cfree(&idx->dbpath);
+    free(idx);
+}
+
+static time_t db_mtime(struct pkgdb *db)
+{
+    char path[PATH_MAX];
+
+    if (db_fullpath(db->_ctx, db->rootdir, db->path, path, sizeof(path)) == NULL)
+        return 0;
+
+    return pm_dbmtime(db->_ctx, path);
+}
+
+int pkgdb_build_index(struct pkgdb *db)
+{
+    struct pkgdb_it        it;
+    const struct pm_dbrec  *dbrec;
+    struct pkgdb_idx       *idx;
+    char                   path[PATH_MAX];
+
+    if (db->_idx)
+        return 1;
+
+    if (!db->_opened)
+        return 0;
+
+    idx = idx_new(0);
+    if (db_fullpath(db->_ctx, db->rootdir, db->path, path, sizeof(path)))
+        idx->dbpath = n_strdup(path);
+    idx->dbmtime = db_mtime(db);
+
+    pkgdb_it_init(db, &it, PMTAG_RECNO, NULL);
+    while ((dbrec = pkgdb_it_get(&it))) {
+        struct pkg *pkg;
+
+        if ((pkg = load_pkg(NULL, db, dbrec, PKGDB_IDX_LDFLAGS)) == NULL)
+            continue;
+
+        idx_add_pkg(idx, pkg, 0);
+
+        if (sigint_reached())
+            break;
+    }
+    pkgdb_it_destroy(&it);
+
+    if (sigint_reached()) {
+        pkgdb_idx_free(idx);
+        return 0;
+    }
+
+    idx_setup(idx);
+    msgn(3, "Indexed %d installed packages", n_array_size(idx->pkgs));
+
+    db->_idx = idx;
+    return 1;
+}
+
+void pkgdb_free_index(struct pkgdb *db)
+{
+    if (db->_idx) {
+        pkgdb_idx_free(db->_idx);
+        db->_idx = NULL;
+    }
+}
+
+struct pkgdb_idx *pkgdb_get_index(struct pkgdb *db)
+{
+    return db->_idx;
+}
+
+int pkgdb_set_index(struct pkgdb *db, struct pkgdb_idx *idx)
+{
+    char path[PATH_MAX];
+    time_t mtime;
+
+    if (idx->dbpath == NULL ||
+        db_fullpath(db->_ctx, db->rootdir, db->path, path, sizeof(path)) == NULL)
+        return 0;
+
+    if (strcmp(idx->dbpath, path) != 0) /* another database */
+        return 0;
+
+    mtime = pm_dbmtime(db->_ctx, path);
+    if (mtime == 0 || mtime != idx->dbmtime) { /* changed outside */
+        msgn(3, "%s: installed packages index is outdated", path);
+        return 0;
+    }
+
+    pkgdb_free_index(db);
+    db->_idx = pkgdb_idx_link(idx);
+    return 1;
+}
+
+static int hdr_eq_arch(struct pm_ctx *ctx, void *hdr, const struct pkg *pkg)
+{
+    const char *name = NULL, *ver = NULL, *rel = NULL, *arch = NULL;
+    const char *pkgarch = pkg_arch(pkg);
+    int32_t epoch = 0;
+
+    if (!ctx->mod->hdr_nevr(hdr, &name, &epoch, &ver, &rel, &arch, NULL))
+        return 0;
+
+    if (arch == NULL)
+        arch = "";
+
+    if (pkgarch == NULL)
+        pkgarch = "";
+
+    return n_str_eq(arch, pkgarch);
+}
+
+/* adds record of just installed pkg */
+static int idx_add_installed(struct pkgdb_idx *idx, struct pkgdb *db,
+                             const struct pkg *pkg, unsigned ldflags)
+{
+    struct pkgdb_it        it;
+    const struct pm_dbrec  *dbrec;
+    int                    n = 0;
+
+    pkgdb_it_init(db, &it, PMTAG_NAME, pkg->name);
+    while ((dbrec = pkgdb_it_get(&it))) {
+        struct pkg *dbpkg, tmp;
+        int cmprc = 0;
+
+        if (!pkg_hdr_cmp_evr(db->_ctx, dbrec->hdr, pkg, &cmprc) || cmprc != 0)
+            continue;
+
+        if (!hdr_eq_arch(db->_ctx, dbrec->hdr, pkg)) /* multilib */
+            continue;
+
+        tmp.recno = dbrec->recno;
+        if (n_array_bsearch(idx->pkgs, &tmp)) /* already there */
+            continue;
+
+        if ((dbpkg = load_pkg(NULL, db, dbrec, ldflags))) {
+            idx_add_pkg(idx, dbpkg, 1);
+            n++;
+        }
+    }
+    pkgdb_it_destroy(&it);
+    return n;
+}
+
+int pkgdb_idx_update(struct pkgdb_idx *idx, struct pkgdb *db,
+                     const tn_array *installed, const tn_array *removed)
+{
+    unsigned ldflags = PKGDB_IDX_LDFLAGS;
+    int i, n = 0;
+
+    if (removed) {
+        for (i=0; i < n_array_size(removed); i++) {
+            struct pkg *pkg = n_array_nth(removed, i), *dbpkg;
+
+            if (pkg->recno == 0)
+                continue;
+
+            if ((dbpkg = n_array_bsearch(idx->pkgs, pkg)) == NULL)
+                continue;
+
+            if (pkg_cmp_name_evr(dbpkg, pkg) != 0) /* recno reused? */
+                continue;
+
+            idx_remove_pkg(idx, dbpkg);
+            n++;
+        }
+    }
+
+    if (installed && n_array_size(installed) > 0) {
+        if (!pkgdb_reopen(db, O_RDONLY))
+            return 0;
+
+        if (idx->flags & PKGDB_IDX_NOFL)
+            ldflags &= ~PKG_LDFL_WHOLE;
+
+        for (i=0; i < n_array_size(installed); i++)
+            n += idx_add_installed(idx, db, n_array_nth(installed, i), ldflags);
+    }
+
+    idx->dbmtime = db_mtime(db);
+    msgn(3, "Updated installed packages index (%d changes, %d packages)",
+         n, n_array_size(idx->pkgs));
+    return 1;
+}
+
+/* dirname as stored in pkg->fl, i.e. without leading '/' */
+static const char *idx_dirname(const char *path)
+{
+    if (*path == '/' && *(path + 1) != '\0')
+        path++;
+    return path;
+}
+
+static tn_array *idx_lookup(struct pkgdb_idx *idx, enum pkgdb_it_tag tag,
+                            const char *value)
+{
+    switch (tag) {
+        case PMTAG_NAME:
+            return n_hash_get(idx->names, value);
+
+        case PMTAG_CAP:
+            return n_hash_get(idx->caps, value);
+
+        case PMTAG_REQ:
+            return n_hash_get(idx->reqs, value);
+
+        case PMTAG_DIRNAME:
+            return n_hash_get(idx->dirs, idx_dirname(value));
+
+        default:
+            break;
+    }
+
+    return NULL;
+}
+
+static int idx_can_lookup(const struct pkgdb *db, enum pkgdb_it_tag tag)
+{
+    if (db->_idx == NULL)
+        return 0;
+
+    if (tag == PMTAG_DIRNAME)
+        return (db->_idx->flags & PKGDB_IDX_NOFL) == 0;
+
+    return tag == PMTAG_NAME || tag == PMTAG_CAP || tag == PMTAG_REQ;
+}
+
+/* file lists are needed but index has them not */
+#define idx_lacks_fl(db, ldflags) \
+    (((db)->_idx->flags & PKGDB_IDX_NOFL) && \
+     ((ldflags) & (PKG_LDFL_WHOLE | PKG_LDFL_DEPDIRS)))
+
+/* PMTAG_FILE lookup */
+static int idx_has_file(struct pkgdb_idx *idx, const char *path,
+                        const tn_array *exclude)
+{
+    char *dirname, *basename, *tmp;
+    tn_array *pkgs;
+    int i, len;
+
+    if (*path != '/')
+        return 0;
+
+    len = strlen(path);
+    tmp = alloca(len + 1);
+    memcpy(tmp, path + 1, len);  /* skip '/' */
+
+    n_basedirnam(tmp, &dirname, &basename);
+    if (dirname == NULL || *dirname == '\0')
+        dirname = "/";
+
+    if ((pkgs = n_hash_get(idx->dirs, dirname)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (exclude && dbpkg_array_has(exclude, pkg->recno))
+            continue;
+
+        if (pkg_has_path(pkg, dirname, basename))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int idx_search(struct pkgdb_idx *idx, tn_array **dbpkgs,
+                      enum pkgdb_it_tag tag, const char *value,
+                      const tn_array *exclude)
+{
+    tn_array *pkgs;
+    int i, nfound = 0, dbpkgs_was_null = 0;
+
+    if ((pkgs = idx_lookup(idx, tag, value)) == NULL)
+        return 0;
+
+    for (i=0; i < n_array_size(pkgs); i++) {
+        struct pkg *pkg = n_array_nth(pkgs, i);
+
+        if (exclude && dbpkg_array_has(exclude, pkg->recno))
+            continue;
+
+        if (dbpkgs == NULL) {
+            nfound++;
+            continue;
+        }
+
+        if (*dbpkgs == NULL) {
+            *dbpkgs = pkgs_array_new_ex(16, pkg_cmp_recno);
+            dbpkgs_was_null = 1;
+        }
+
+        if (!dbpkgs_was_null && dbpkg_array_has(*dbpkgs, pkg->recno))
+            continue;
+
+        nfound++;
+        n_array_push(*dbpkgs, pkg_link(pkg));
+    }
+
+    if (dbpkgs && *dbpkgs)
+        n_array_sort(*dbpkgs);
+
+    return nfound;
+}
+
 int pkgdb_search(struct pkgdb *db, tn_array **dbpkgs,
                  enum pkgdb_it_tag tag,
                  const char *value,
@@ -349,6 +870,9 @@ int pkgdb_search(struct pkgdb *db, tn_array **dbpkgs,
     const struct pm_dbrec  *dbrec;
     int                    nfound = 0, dbpkgs_was_null = 0;
 
+    if (idx_can_lookup(db, tag) && !idx_lacks_fl(db, ldflags))
+        return idx_search(db->_idx, dbpkgs, tag, value, exclude);
+
     pkgdb_it_init(db, &it, tag, value);
     while ((dbrec = pkgdb_it_get(&it))) {
         struct pkg *pkg;
@@ -434,6 +958,26 @@ static int db_match(struct pkgdb *db, enum pkgdb_it_tag tag,
 
     is_file = (*capreq_name(cap) == '/' ? 1 : 0);
 
+    if (db->_idx && tag == PMTAG_FILE &&
+        (db->_idx->flags & PKGDB_IDX_NOFL) == 0)
+        return idx_has_file(db->_idx, capreq_name(cap), exclude);
+
+    if (idx_can_lookup(db, tag)) {
+        tn_array *pkgs = idx_lookup(db->_idx, tag, capreq_name(cap));
+        int i;
+
+        for (i=0; pkgs && i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            if (exclude && dbpkg_array_has(exclude, pkg->recno))
+                continue;
+
+            if (is_file || pkg_caps_match_req(pkg, cap, ma_flags))
+                return 1;
+        }
+        return 0;
+    }
+
     pkgdb_it_init(db, &it, tag, capreq_name(cap));
     while ((dbrec = pkgdb_it_get(&it))) {
         if (exclude && dbpkg_array_has(exclude, dbrec->recno))
@@ -479,6 +1023,34 @@ static int get_obsoletedby_cap(struct pkgdb *db, int tag, tn_array *dbpkgs,
     const struct pm_dbrec *dbrec;
     int n = 0;
 
+    if (idx_can_lookup(db, tag) && !idx_lacks_fl(db, ldflags)) {
+        tn_array *pkgs = idx_lookup(db->_idx, tag, capreq_name(cap));
+        int i;
+
+        for (i=0; pkgs && i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+            int add = 0;
+
+            if (exclude && dbpkg_array_has(exclude, pkg->recno))
+                continue;
+
+            if (dbpkg_array_has(dbpkgs, pkg->recno))
+                continue;
+
+            if (tag == PMTAG_NAME)
+                add = pkg_evr_match_req(pkg, cap, POLDEK_MA_PROMOTE_VERSION);
+            else
+                add = pkg_caps_match_req(pkg, cap, 1);
+
+            if (add) {
+                n_array_push(dbpkgs, pkg_link(pkg));
+                n_array_sort(dbpkgs);
+                n++;
+            }
+        }
+        return n;
+    }
+
     pkgdb_it_init(db, &it, tag, capreq_name(cap));
     while ((dbrec = pkgdb_it_get(&it)) != NULL) {
         int add = 0;
@@ -560,15 +1132,25 @@ int pkgdb_q_obsoletedby_pkg(struct pkgdb *db, tn_array *dbpkgs,
             continue;
 
 /* FIXME: is reverse match should be performed there too? */
-        n += get_obsoletedby_cap(db, PMTAG_NAME, dbpkgs, cnfl, exclude, ldflags);
-#ifdef HAVE_RPM_4_1             /* TODO -- code this in pm's module */
-        n += get_obsoletedby_cap(db, PMTAG_CAP, dbpkgs, cnfl, exclude, ldflags);
-#endif
+        n += pkgdb_q_obsoletedby_cap(db, dbpkgs, cnfl, exclude, ldflags);
     }
 
     return n;
 }
 
+int pkgdb_q_obsoletedby_cap(struct pkgdb *db, tn_array *dbpkgs,
+                            struct capreq *obsl, const tn_array *exclude,
+                            unsigned ldflags)
+{
+    int n;
+
+    n = get_obsoletedby_cap(db, PMTAG_NAME, dbpkgs, obsl, exclude, ldflags);
+#ifdef HAVE_RPM_4_1             /* TODO -- code this in pm's module */
+    n += get_obsoletedby_cap(db, PMTAG_CAP, dbpkgs, obsl, exclude, ldflags);
+#endif
+    return n;
+}
+
 struct pkgdir *pkgdb_to_pkgdir(struct pm_ctx *ctx, const char *rootdir,
                                const char *path, unsigned pkgdir_ldflags,
                                const char *key, ...)
@@ -604,6 +1186,35 @@ static int q_what_requires(struct pkgdb *db, tn_array *dbpkgs,
 
     (void)ma_flags;  /* unused */
 
+    /* also self match of file requirement needs file list */
+    if (idx_can_lookup(db, tag) && !idx_lacks_fl(db, ldflags) &&
+        !(capreq_is_file(cap) && idx_lacks_fl(db, PKG_LDFL_WHOLE))) {
+        tn_array *pkgs = idx_lookup(db->_idx, tag, value);
+        int i;
+
+        (void)ldflags;          /* indexed packages are loaded whole */
+        for (i=0; pkgs && i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            if (exclude && dbpkg_array_has(exclude, pkg->recno))
+                continue;
+
+            if (dbpkg_array_has(dbpkgs, pkg->recno))
+                continue;
+
+            if (pkg_satisfies_req(pkg, cap, 1)) { /* self matched? */
+                trace(2, "- required %s: self matched", pkg_id(pkg));
+                continue;
+            }
+
+            trace(2, "- required %s", pkg_id(pkg));
+            n_array_push(dbpkgs, pkg_link(pkg));
+            n_array_isort(dbpkgs);
+            n++;
+        }
+        return n;
+    }
+
     pkgdb_it_init(db, &it, tag, value);
     while ((dbrec = pkgdb_it_get(&it)) != NULL) {
         struct pkg *pkg;
@@ -685,6 +1296,21 @@ static int q_is_required(struct pkgdb *db, int tag, const struct capreq *cap,
     if (*capreq_name(cap) == '/')
         ldflags |= PKG_LDFL_DEPDIRS;
 
+    if (idx_can_lookup(db, tag)) {
+        tn_array *pkgs = idx_lookup(db->_idx, tag, capreq_name(cap));
+        int i;
+
+        for (i=0; pkgs && i < n_array_size(pkgs); i++) {
+            struct pkg *pkg = n_array_nth(pkgs, i);
+
+            if (exclude && dbpkg_array_has(exclude, pkg->recno))
+                continue;
+
+            return 1;
+        }
+        return 0;
+    }
+
     pkgdb_it_init(db, &it, tag, capreq_name(cap));
     while ((dbrec = pkgdb_it_get(&it)) != NULL) {
         struct pkg *pkg;
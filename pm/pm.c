@@ -109,6 +109,13 @@ time_t pm_dbmtime(struct pm_ctx *ctx, const char *path)
     return 0;
 }
 
+int pm_dbflush(struct pm_ctx *ctx)
+{
+    if (ctx->mod->dbflush)
+        return ctx->mod->dbflush(ctx->modh);
+    return 1;
+}
+
 char *pm_dbpath(struct pm_ctx *ctx, char *path, size_t size)
 {
     if (ctx->mod->dbpath)
@@ -132,6 +139,13 @@ int pm_satisfies(struct pm_ctx *ctx, const struct capreq *req)
     return 0;
 }
 
+tn_array *pm_rpmlib_caps(struct pm_ctx *ctx)
+{
+    if (ctx->mod->rpmlib_caps)
+        return ctx->mod->rpmlib_caps(ctx->modh);
+    return NULL;
+}
+
 struct pkg *pm_load_package(struct pm_ctx *ctx,
                             tn_alloc *na, const char *path, unsigned ldflags)
 {
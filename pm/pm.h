@@ -44,6 +44,8 @@ EXPORT const char *pm_get_name(struct pm_ctx *ctx);
 
 EXPORT char *pm_dbpath(struct pm_ctx *ctx, char *path, size_t size);
 EXPORT time_t pm_dbmtime(struct pm_ctx *ctx, const char *path);
+/* writes database changes the PM defers past transaction commit */
+EXPORT int pm_dbflush(struct pm_ctx *ctx);
 
 EXPORT int pm_pminstall(struct pkgdb *db, const tn_array *pkgs,
                  const tn_array *pkgs_toremove, struct poldek_ts *ts);
@@ -70,6 +72,7 @@ struct pkgdb {
     void            *_filter_arg;
 
     struct pm_ctx *_ctx;
+    struct pkgdb_idx *_idx;     /* see pkgdb_build_index() */
 };
 
 EXPORT struct pkgdb *pkgdb_open(struct pm_ctx *ctx, const char *rootdir,
@@ -180,6 +183,32 @@ EXPORT int pkgdb_q_what_requires(struct pkgdb *db, tn_array *dbpkgs,
 EXPORT int pkgdb_q_is_required(struct pkgdb *db, const struct capreq *cap,
                                const tn_array *exclude);
 
+/* Loads all installed packages into memory and answers pkgdb_search(),
+   pkgdb_match_req() and pkgdb_q_*() queries from them until the database
+   is closed or a transaction is committed. */
+EXPORT int pkgdb_build_index(struct pkgdb *db);
+EXPORT void pkgdb_free_index(struct pkgdb *db);
+
+/* Installed packages index shared between pkgdb handles; built once from
+   already loaded db packages (rpmdbcache; they get self capability and
+   PKG_DBPKG flag as packages loaded from db), kept up to date by
+   pkgdb_idx_update() after each transaction. */
+#define PKGDB_IDX_NOFL (1 << 0) /* no file lists, file queries go to db */
+EXPORT struct pkgdb_idx *pkgdb_idx_new(struct pm_ctx *ctx, const char *rootdir,
+                                       time_t dbmtime, tn_array *pkgs,
+                                       unsigned flags);
+EXPORT struct pkgdb_idx *pkgdb_idx_link(struct pkgdb_idx *idx);
+EXPORT void pkgdb_idx_free(struct pkgdb_idx *idx);
+
+EXPORT struct pkgdb_idx *pkgdb_get_index(struct pkgdb *db);
+/* RET: 0 if idx belongs to another database or db was changed outside */
+EXPORT int pkgdb_set_index(struct pkgdb *db, struct pkgdb_idx *idx);
+
+/* applies transaction results; installed packages are looked up in db */
+EXPORT int pkgdb_idx_update(struct pkgdb_idx *idx, struct pkgdb *db,
+                            const tn_array *installed,
+                            const tn_array *removed);
+
 
 #define PKGDB_GETF_OBSOLETEDBY_NEVR (1 << 0)  /* by NEVR only  */
 #define PKGDB_GETF_OBSOLETEDBY_OBSL (1 << 1)  /* by Obsoletes  */
@@ -192,6 +221,14 @@ EXPORT int pkgdb_q_obsoletedby_pkg(struct pkgdb *db, tn_array *dbpkgs,
                                    const struct pkg *pkg, unsigned flags,
                                    const tn_array *exclude, unsigned ldflags);
 
+/*
+  adds to dbpkgs packages obsoleted by single Obsoletes capreq; note
+  that pkgdb's filter is not applied while pkgdb_build_index()-ed
+*/
+EXPORT int pkgdb_q_obsoletedby_cap(struct pkgdb *db, tn_array *dbpkgs,
+                                   struct capreq *obsl,
+                                   const tn_array *exclude, unsigned ldflags);
+
 
 enum pm_machine_score_tag {
     PMMSTAG_ARCH = 1,
@@ -203,6 +240,10 @@ EXPORT int pm_machine_score(struct pm_ctx *ctx,
 
 EXPORT int pm_satisfies(struct pm_ctx *ctx, const struct capreq *req);
 
+/* internal capabilities (rpmlib() and friends) or NULL if PM has none;
+   returned array must be freed by caller */
+EXPORT tn_array *pm_rpmlib_caps(struct pm_ctx *ctx);
+
 EXPORT int pm_get_dbdepdirs(struct pm_ctx *ctx,
                             const char *rootdir, const char *dbpath,
                             tn_array *depdirs);
@@ -54,6 +54,8 @@ struct pm_module pm_module_pset = {
     NULL,            /* ldpkg */
     pm_pset_db_to_pkgdir, 
     NULL,
+    NULL,
+    pm_pset_dbflush,
 };
 
     
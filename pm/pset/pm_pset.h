@@ -61,4 +61,6 @@ struct pkgdir *pm_pset_db_to_pkgdir(void *pm_pset, const char *rootdir,
                                     const char *dbpath, unsigned pkgdir_ldflags,
                                     tn_hash *kw);
 
+int pm_pset_dbflush(void *pm_pset);
+
 #endif
@@ -48,25 +48,40 @@
 #define IMMUTABLE_MULTISRC  (1 << 1)
 #define AUTODIRDEP          (1 << 2)
 
+struct pm_psetdb;
+
 struct pm_pset {
     char      *installer_path;
     tn_hash   *cnf;
     tn_array  *sources;
     unsigned  flags;
+    struct pm_psetdb *db;       /* kept open for whole session */
 };
 
-
+/*
+  Database is opened once and shared by all transactions of the session,
+  so the destination pkgset is not rebuilt for each one. Committed
+  changes are applied to in-memory pkgdir; its index is written by
+  pm_pset_dbflush(), at the end of a command (batch of transactions),
+  or before db_to_pkgdir() reads it back.
+*/
 struct pm_psetdb {
     struct poldek_ts *ts;
     struct pkgset    *ps;
     char             *tsdir;       /* transaction temp directory */
-    tn_array         *pkgs_added;
+    tn_array         *pkgs_added;  /* not ours, recno is set while in use */
+    tn_array         *tx_added;    /* added by current transaction */
+    tn_array         *tx_removed;  /* removed by current transaction */
     tn_array         *paths_added;
     tn_array         *paths_removed;
     int              _recno;
+    int              ndirty;       /* committed transactions not saved */
     struct pm_pset   *pm;
 };
 
+static void psetdb_free(struct pm_psetdb *db);
+static int psetdb_flush(struct pm_psetdb *db);
+
 void *pm_pset_init(void)
 {
     struct pm_pset *pm;
@@ -83,6 +98,7 @@ void *pm_pset_init(void)
     pm->sources = n_array_new(4, (tn_fn_free)source_free,
                               (tn_fn_cmp)source_cmp);
     pm->flags = 0;
+    pm->db = NULL;
 
     return pm;
 }
@@ -91,6 +107,12 @@ void pm_pset_destroy(void *pm_pset)
 {
     struct pm_pset *pm = pm_pset;
 
+    if (pm->db) {
+        psetdb_flush(pm->db);   /* nobody flushed it, last chance */
+        psetdb_free(pm->db);
+        pm->db = NULL;
+    }
+
     n_cfree(&pm->installer_path);
     n_hash_free(pm->cnf);
     n_array_free(pm->sources);
@@ -178,6 +200,14 @@ void *pm_pset_opendb(void *pm_pset, void *dbh,
     if (db)
         return db;
 
+    if ((db = pm->db)) {        /* opened by previous transaction */
+        for (i=0; i < n_array_size(db->pkgs_added); i++) {
+            struct pkg *pkg = n_array_nth(db->pkgs_added, i);
+            pkg->recno = db->_recno++;
+        }
+        return db;
+    }
+
     n_assert(n_hash_exists(kw, "source") == 0);      /* use pm_configure() */
 
     if (n_array_size(pm->sources) == 0) {
@@ -213,11 +243,16 @@ void *pm_pset_opendb(void *pm_pset, void *dbh,
     db->ts = NULL;
     db->ps = ps;
     db->pkgs_added = pkgs_array_new(32);
+    db->tx_added = pkgs_array_new(32);
+    db->tx_removed = pkgs_array_new(32);
     db->paths_added = n_array_new(32, free, NULL);
     db->paths_removed = n_array_new(32, free, NULL);
     db->tsdir = NULL;
     db->_recno = recno;
+    db->ndirty = 0;
     db->pm = pm;
+
+    pm->db = db;
     return db;
 }
 
@@ -227,33 +262,115 @@ void pm_pset_closedb(void *dbh)
     return;
 }
 
-void pm_pset_freedb(void *dbh)
+static struct pkgdir *psetdb_pkgdir(struct pm_psetdb *db)
 {
-    struct pm_psetdb *db = dbh;
-
-    if (db == NULL)
-        return;
+    n_assert(n_array_size(db->ps->pkgdirs) == 1);
+    return n_array_nth(db->ps->pkgdirs, 0);
+}
 
-    if (db->ps)
-        pkgset_free(db->ps);
+static void pkgs_added_remove(struct pm_psetdb *db, struct pkg *pkg)
+{
+    int i;
 
-    if (db->pkgs_added) {       /* clean our recno's */
-        int i;
-        for (i=0; i < n_array_size(db->pkgs_added); i++) {
-            struct pkg *pkg = n_array_nth(db->pkgs_added, i);
-            pkg->recno = 0;
+    for (i = n_array_size(db->pkgs_added) - 1; i >= 0; i--) {
+        if (n_array_nth(db->pkgs_added, i) == pkg) {
+            n_array_remove_nth(db->pkgs_added, i);
+            break;
         }
-        n_array_free(db->pkgs_added);
     }
+}
 
-    if (db->tsdir) {     /* remove transaction directory */
-        int i;
+/* forget uncommitted changes */
+static void psetdb_rollback(struct pm_psetdb *db)
+{
+    struct pkgdir *pkgdir;
+    int i;
+
+    if (n_array_size(db->tx_added) == 0 && n_array_size(db->tx_removed) == 0)
+        goto l_end;
+
+    pkgdir = psetdb_pkgdir(db);
+
+    for (i=0; i < n_array_size(db->tx_added); i++) {
+        struct pkg *pkg = n_array_nth(db->tx_added, i);
+
+        pkgset_remove_package(db->ps, pkg);
+        pkgdir_remove_package(pkgdir, pkg);
+        pkgs_added_remove(db, pkg);
+        pkg->recno = 0;
+    }
+
+    for (i=0; i < n_array_size(db->tx_removed); i++) {
+        struct pkg *pkg = n_array_nth(db->tx_removed, i);
+
+        pkgset_add_package(db->ps, pkg);
+        pkgdir_add_package(pkgdir, pkg);
+        pkg->recno = db->_recno++;
+    }
+
+l_end:
+    if (db->tsdir) {
         for (i=0; i < n_array_size(db->paths_added); i++) {
             char *path = n_array_nth(db->paths_added, i);
             DBGF("unlink %s\n", path);
             unlink(path);
         }
+    }
+
+    n_array_clean(db->tx_added);
+    n_array_clean(db->tx_removed);
+    n_array_clean(db->paths_added);
+    n_array_clean(db->paths_removed);
+    db->ts = NULL;
+}
+
+static int psetdb_flush(struct pm_psetdb *db)
+{
+    struct pkgdir *pkgdir;
+    int rc = 1;
+
+    if (db->ndirty == 0)
+        return 1;
+
+    pkgdir = psetdb_pkgdir(db);
+    if (pkgdir_type_info(pkgdir->type) & PKGDIR_CAP_SAVEABLE) {
+        msgn(2, _("Saving %s index (%d transactions)"), pkgdir->path,
+             db->ndirty);
+        if (!(rc = pkgdir_save(pkgdir, 0))) {
+            logn(LOGERR, _("%s: index save failed, it does not reflect "
+                           "%d transaction(s)"), pkgdir->path, db->ndirty);
+            return 0;           /* still dirty, retried on next flush */
+        }
+    }
+
+    db->ndirty = 0;
+    return rc;
+}
+
+int pm_pset_dbflush(void *pm_pset)
+{
+    struct pm_pset *pm = pm_pset;
+
+    if (pm->db == NULL)
+        return 1;
+
+    return psetdb_flush(pm->db);
+}
+
+static void psetdb_free(struct pm_psetdb *db)
+{
+    psetdb_rollback(db);
+
+    if (db->ps)
+        pkgset_free(db->ps);
+
+    n_array_free(db->pkgs_added);
+    n_array_free(db->tx_added);
+    n_array_free(db->tx_removed);
+
+    if (db->tsdir) {     /* remove transaction directory */
         rmdir(db->tsdir);
+        free(db->tsdir);
     }
 
     n_array_free(db->paths_added);
@@ -262,6 +379,23 @@ void pm_pset_freedb(void *dbh)
     free(db);
 }
 
+/* db stays open in pm->db until pm_pset_destroy() */
+void pm_pset_freedb(void *dbh)
+{
+    struct pm_psetdb *db = dbh;
+    int i;
+
+    if (db == NULL)
+        return;
+
+    psetdb_rollback(db);
+
+    for (i=0; i < n_array_size(db->pkgs_added); i++) { /* clean our recno's */
+        struct pkg *pkg = n_array_nth(db->pkgs_added, i);
+        pkg->recno = 0;
+    }
+}
+
 
 /* remember! don't touch any member */
 struct psetdb_it {
@@ -570,9 +704,7 @@ int pm_pset_packages_install(struct pkgdb *pdb, const tn_array *pkgs,
         return 0;
 
     pm_pset_packages_uninstall(pdb, pkgs_toremove, ts);
-
-    n_assert(n_array_size(db->ps->pkgdirs) == 1);
-    pkgdir = n_array_nth(db->ps->pkgdirs, 0);
+    pkgdir = psetdb_pkgdir(db);
 
     for (i=0; i < n_array_size(pkgs); i++) {
         struct pkg *tmp, *pkg = n_array_nth(pkgs, i);
@@ -590,6 +722,7 @@ int pm_pset_packages_install(struct pkgdb *pdb, const tn_array *pkgs,
         pkgdir_add_package(pkgdir, pkg);
         pkg->recno = db->_recno++;
         n_array_push(db->pkgs_added, pkg_link(pkg));
+        n_array_push(db->tx_added, pkg_link(pkg));
 
         tmp = n_array_bsearch(pkgdir->pkgs, pkg);
         DBGF("after in %p(%p) %s\n", pkg, tmp, pkg_id(pkg));
@@ -622,8 +755,7 @@ int pm_pset_packages_uninstall(struct pkgdb *pdb, const tn_array *pkgs,
     if (is_immutable(db->pm, "removal"))
         return 0;
 
-    n_assert(n_array_size(db->ps->pkgdirs) == 1);
-    pkgdir = n_array_nth(db->ps->pkgdirs, 0);
+    pkgdir = psetdb_pkgdir(db);
     ts = ts;
 
     for (i=0; i < n_array_size(pkgs); i++) {
@@ -637,6 +769,9 @@ int pm_pset_packages_uninstall(struct pkgdb *pdb, const tn_array *pkgs,
                 n_assert(0);
             }
 
+            n_array_push(db->tx_removed, pkg_link(tmp));
+            pkgs_added_remove(db, tmp);
+
             tmp->recno = 0;
             pkgset_remove_package(db->ps, tmp);
             pkgdir_remove_package(pkgdir, tmp);
@@ -658,7 +793,7 @@ void pm_pset_tx_begin(void *dbh, struct poldek_ts *ts)
 }
 
 
-/* TODO: transaction like behaviour */
+/* files are copied/removed here, index is saved by psetdb_flush() */
 int pm_pset_tx_commit(void *dbh)
 {
     struct pm_psetdb *db = dbh;
@@ -668,15 +803,15 @@ int pm_pset_tx_commit(void *dbh)
     int i, rc = 1, nchanges;
 
     n_assert(db->ts);
-    db->ts = NULL;
 
     nchanges = n_array_size(db->paths_removed) + n_array_size(db->paths_added);
-    if (nchanges == 0)
+    if (nchanges == 0) {
+        psetdb_rollback(db);    /* nothing to do, just reset */
         return 1;
+    }
 
     nchanges = 0;               /* count real made changes */
-    n_assert(n_array_size(db->ps->pkgdirs) == 1);
-    pkgdir = n_array_nth(db->ps->pkgdirs, 0);
+    pkgdir = psetdb_pkgdir(db);
     msgn(0, _("Operating on %s"), pkgdir->path);
 
     for (i=0; i < n_array_size(db->paths_removed); i++) {
@@ -720,15 +855,26 @@ int pm_pset_tx_commit(void *dbh)
         }
     }
 
-    if (nchanges == 0 || !rc)
+    if (!rc) {              /* index is left as it was before transaction */
+        psetdb_rollback(db);
+        psetdb_flush(db);
         return rc;
+    }
 
-    if (pkgdir_type_info(pkgdir->type) & PKGDIR_CAP_SAVEABLE)
-        rc = pkgdir_save(pkgdir, 0);
-
-    else if (ts->getop(ts, POLDEK_OP_JUSTDB))
+    if ((pkgdir_type_info(pkgdir->type) & PKGDIR_CAP_SAVEABLE) == 0 &&
+        ts->getop(ts, POLDEK_OP_JUSTDB))
         logn(LOGWARN, "--justdb makes no sense for non-db repository");
 
+    /* committed, keep changes */
+    n_array_clean(db->tx_added);
+    n_array_clean(db->tx_removed);
+    n_array_clean(db->paths_added);
+    n_array_clean(db->paths_removed);
+    db->ts = NULL;
+
+    if (nchanges > 0)
+        db->ndirty++;
+
     return rc;
 }
 
@@ -756,6 +902,9 @@ struct pkgdir *pm_pset_db_to_pkgdir(void *pm_pset, const char *rootdir,
              "making only from the first one");
     }
 
+    if (pm->db)                 /* index is read back from disk */
+        psetdb_flush(pm->db);
+
     src = n_array_nth(pm->sources, 0);
 
     if ((dir = pkgdir_srcopen(src, 0)) == NULL) {
@@ -387,3 +387,238 @@ int pm_rpm_install_package(struct pkgdb *db, const char *path,
     return do_dbinstall(db->dbh, db->rootdir, path,
                         filterflags, transflags, instflags);
 }
+
+#ifdef HAVE_RPM_4_1
+#ifdef HAVE_RPMDSUNAME
+typedef unsigned long long cb_size_t;
+#else
+typedef unsigned long cb_size_t;
+#endif
+
+struct ts_notify {
+    int      npackages;
+    int      ninstalled;
+    unsigned flags;             /* INSTALL_LABEL, INSTALL_HASH */
+};
+
+/* logs installed packages, the rest (files opening, hashes) is rpm's job */
+static void *ts_notify_cb(const void *h, const rpmCallbackType op,
+                          const cb_size_t amount, const cb_size_t total,
+                          const void *pkgpath, void *data)
+{
+    struct ts_notify *nt = data;
+
+    if (op == RPMCALLBACK_INST_START && pkgpath) {
+        nt->ninstalled++;
+        msgn_f(0, "rpm: %s [%d/%d]", n_basenam(pkgpath), nt->ninstalled,
+               nt->npackages);
+    }
+
+#ifdef HAVE_RPMDSUNAME
+    return rpmShowProgress(h, op, amount, total, pkgpath,
+                           (void*)((long)nt->flags));
+#else
+    return install_cb(h, op, amount, total, pkgpath, NULL);
+#endif
+}
+
+/* defines "name body" macro for transaction, name is saved to undefine it */
+static int ts_define_macro(tn_array *names, const char *def)
+{
+    char name[256];
+    const char *body;
+    size_t len;
+
+    len = strcspn(def, " \t");
+    if (len == 0 || def[len] == '\0' || len >= sizeof(name)) {
+        logn(LOGERR, _("%s: invalid macro definition"), def);
+        return 0;
+    }
+
+    memcpy(name, def, len);
+    name[len] = '\0';
+
+    body = def + len;
+    while (isspace(*body))
+        body++;
+
+    addMacro(NULL, name, NULL, body, RMIL_CMDLINE);
+    n_array_push(names, n_strdup(name));
+    return 1;
+}
+
+/* restores macros overridden by ts_define_macro() */
+static void ts_undefine_macros(tn_array *names)
+{
+    int i;
+
+    for (i = n_array_size(names) - 1; i >= 0; i--)
+        delMacro(NULL, n_array_nth(names, i));
+
+    n_array_free(names);
+}
+
+/* logs problems instead of rpmpsPrint()-ing them to stderr */
+static void ts_log_problems(rpmps ps)
+{
+    rpmpsi psi;
+
+    psi = rpmpsInitIterator(ps);
+    while (rpmpsNextIterator(psi) >= 0) {
+        const char *s = rpmProblemString(rpmpsProblem(psi));
+
+        logn(LOGERR, "  %s", s);
+        free((char*)s);
+    }
+    rpmpsFreeIterator(psi);
+}
+
+/*
+  Installs packages within single in-process transaction.
+  Returns -1 if transaction could not be set up at all (caller may try
+  PM command then), 0 on failure and 1 on success.
+*/
+int pm_rpm_packages_install_ts(char *const paths[], int npaths,
+                               struct poldek_ts *ts)
+{
+    unsigned transflags = 0, filterflags = 0;
+    struct ts_notify nt;
+    rpmts rts = NULL;
+    rpmps ps = NULL;
+    tn_array *macros;
+    int i, rc = 0, upgrade, nerr = 0;
+
+    upgrade = poldek_ts_issetf(ts, POLDEK_TS_UPGRADE | POLDEK_TS_REINSTALL |
+                               POLDEK_TS_DOWNGRADE);
+
+    if (poldek_ts_issetf(ts, POLDEK_TS_REINSTALL))
+        filterflags |= RPMPROB_FILTER_REPLACEPKG |
+            RPMPROB_FILTER_REPLACEOLDFILES | RPMPROB_FILTER_REPLACENEWFILES;
+
+    if (poldek_ts_issetf(ts, POLDEK_TS_DOWNGRADE))
+        filterflags |= RPMPROB_FILTER_OLDPACKAGE;
+
+    if (ts->getop(ts, POLDEK_OP_FORCE))
+        filterflags |= RPMPROB_FILTER_REPLACEPKG |
+            RPMPROB_FILTER_REPLACEOLDFILES |
+            RPMPROB_FILTER_REPLACENEWFILES |
+            RPMPROB_FILTER_OLDPACKAGE;
+
+    if (ts->getop(ts, POLDEK_OP_RPMTEST))
+        transflags |= RPMTRANS_FLAG_TEST;
+
+    if (ts->getop(ts, POLDEK_OP_JUSTDB))
+        transflags |= RPMTRANS_FLAG_JUSTDB;
+
+    /* as --define-s passed to PM command, valid for this transaction only */
+    macros = n_array_new(4, free, NULL);
+    ts_define_macro(macros, ts->getop(ts, POLDEK_OP_AUTODIRDEP) ?
+                    "_check_dirname_deps 1" : "_check_dirname_deps 0");
+
+    for (i=0; ts->rpmacros && i < n_array_size(ts->rpmacros); i++) {
+        if (!ts_define_macro(macros, n_array_nth(ts->rpmacros, i))) {
+            ts_undefine_macros(macros);
+            return -1;
+        }
+    }
+
+    rts = rpmtsCreate();
+    rpmtsSetRootDir(rts, ts->rootdir ? ts->rootdir : "/");
+    if (rpmtsOpenDB(rts, ts->getop(ts, POLDEK_OP_RPMTEST) ? O_RDONLY : O_RDWR) != 0) {
+        logn(LOGERR, _("%s: could not open rpm database"),
+             ts->rootdir ? ts->rootdir : "/");
+        rpmtsFree(rts);
+        ts_undefine_macros(macros);
+        return -1;
+    }
+
+    /* headers are read from package files again: poldek's packages come
+       from indexes without rpm headers, while rpm wants the whole ones */
+    for (i=0; i < npaths; i++) {
+        const char *path = paths[i];
+        Header h = NULL;
+        FD_t fdt;
+
+        fdt = Fopen(path, "r.ufdio");
+        if (fdt == NULL || Ferror(fdt)) {
+            logn(LOGERR, "%s: %s", path, Fstrerror(fdt));
+            if (fdt)
+                Fclose(fdt);
+            nerr++;
+            continue;
+        }
+
+        if (!pm_rpmhdr_loadfdt(fdt, &h, path)) {
+            Fclose(fdt);
+            nerr++;
+            continue;
+        }
+        Fclose(fdt);
+
+        /* path is a key passed back to callback to open the package */
+        if (rpmtsAddInstallElement(rts, h, (fnpyKey)path, upgrade, NULL) != 0) {
+            logn(LOGERR, "%s: rpmtsAddInstallElement() failed", n_basenam(path));
+            nerr++;
+        }
+        headerFree(h);
+    }
+
+    if (nerr)
+        goto l_end;
+
+    if (!ts->getop(ts, POLDEK_OP_NODEPS)) {
+        if (rpmtsCheck(rts) != 0) {
+            logn(LOGERR, "rpmtsCheck() failed");
+            goto l_end;
+        }
+
+        ps = rpmtsProblems(rts);
+        if (rpmpsNumProblems(ps) > 0) {
+            logn(LOGERR, _("failed dependencies:"));
+            ts_log_problems(ps);
+            goto l_end;
+        }
+        ps = rpmpsFree(ps);
+    }
+
+    if (rpmtsOrder(rts) != 0) {
+        logn(LOGERR, "rpmtsOrder() failed");
+        goto l_end;
+    }
+
+    memset(&nt, 0, sizeof(nt));
+    nt.npackages = npaths;
+    if (poldek_VERBOSE > 0) {
+        nt.flags |= INSTALL_LABEL;
+        if (!ts->getop(ts, POLDEK_OP_PROGRESS_NONE))
+            nt.flags |= INSTALL_HASH;
+    }
+
+    rpmtsSetFlags(rts, transflags);
+    rpmtsSetNotifyCallback(rts, (rpmCallbackFunction)ts_notify_cb, &nt);
+
+    if ((rc = rpmtsRun(rts, NULL, (rpmprobFilterFlags)filterflags)) == 0) {
+        rc = 1;
+
+    } else {
+        if (rc > 0) {
+            ps = rpmtsProblems(rts);
+            logn(LOGERR, _("installation failed:"));
+            ts_log_problems(ps);
+
+        } else {
+            logn(LOGERR, _("installation failed (retcode=%d)"), rc);
+        }
+        rc = 0;
+    }
+
+ l_end:
+    if (ps)
+        rpmpsFree(ps);
+
+    rpmtsCloseDB(rts);
+    rpmtsFree(rts);
+    ts_undefine_macros(macros);
+    return rc;
+}
+#endif /* HAVE_RPM_4_1 */
@@ -226,6 +226,18 @@ static int rpmioaccess_satisfies(const struct capreq *req)
     return rc;
 }
 
+/* PM's internal capabilities (rpmlib() and friends), sorted by name */
+tn_array *pm_rpm_rpmlib_caps(void *pm_rpm)
+{
+    struct pm_rpm *pm = pm_rpm;
+
+    if (pm->caps == NULL)
+        if ((pm->caps = load_internal_caps(pm_rpm)) == NULL)
+            return NULL;
+
+    return n_ref(pm->caps);
+}
+
 int pm_rpm_satisfies(void *pm_rpm, const struct capreq *req)
 {
     struct pm_rpm *pm = pm_rpm;
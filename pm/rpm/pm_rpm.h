@@ -93,6 +93,7 @@
 #include "pm/pm.h"
 
 #define PM_RPM_CMDSETUP_DONE (1 << 0)
+#define PM_RPM_NATIVE_TS     (1 << 1) /* install through librpm's rpmts */
 struct pm_rpm {
     unsigned flags;
     char *rpm;
@@ -146,6 +147,11 @@ int pm_rpm_db_it_init(struct pkgdb_it *it, int tag, const char *arg);
 int pm_rpm_install_package(struct pkgdb *db, const char *path,
                            const struct poldek_ts *ts);
 
+#ifdef HAVE_RPM_4_1
+int pm_rpm_packages_install_ts(char *const paths[], int npaths,
+                               struct poldek_ts *ts);
+#endif
+
 int pm_rpm_vercmp(const char *one, const char *two);
 
 /************/
@@ -153,6 +159,8 @@ int pm_rpm_vercmp(const char *one, const char *two);
 int pm_rpmhdr_loadfdt(FD_t fdt, Header *hdr, const char *path);
 int pm_rpmhdr_loadfile(const char *path, Header *hdr);
 Header pm_rpmhdr_readfdt(void *fdt); /* headerRead */
+/* header from on-disk image without magic (il, dl, index, data) */
+Header pm_rpmhdr_loadblob(const void *blob, size_t size);
 
 int pm_rpmhdr_nevr(void *h, const char **name, int32_t *epoch,
                    const char **version, const char **release,
@@ -108,6 +108,9 @@ int pm_rpm_configure(void *pm_rpm, const char *key, void *val)
             pm->rpm = n_strdup(val);
         DBGF("%s %s\n", key, (char*)val);
 
+    } else if (n_str_eq(key, "nativets")) {
+        pm->flags |= PM_RPM_NATIVE_TS;
+
     } else if (n_str_eq(key, "sudocmd")) {
         n_cfree(&pm->sudo);
         if (val)
@@ -185,6 +185,12 @@ int pm_rpmhdr_loadfile(const char *path, Header *hdr)
     return rc;
 }
 
+Header pm_rpmhdr_loadblob(const void *blob, size_t size)
+{
+    size = size;
+    return headerCopyLoad(blob);
+}
+
 Header pm_rpmhdr_readfdt(void *fdt)
 {
     Header h;
@@ -455,6 +455,20 @@ int pm_rpm_packages_install(struct pkgdb *db, const tn_array *pkgs,
     n_assert(nargs > nopts);
     argv[nargs] = NULL;
 
+#ifdef HAVE_RPM_4_1
+    /* PM command is still used if sudo or raw rpm options are needed */
+    if ((pm->flags & PM_RPM_NATIVE_TS) &&
+        (ts->rpmopts == NULL || n_array_size(ts->rpmopts) == 0) &&
+        (getuid() == 0 || ts->getop(ts, POLDEK_OP_RPMTEST))) {
+
+        msgn(1, _("Installing %d package(s)..."), nargs - nopts);
+        if ((ec = pm_rpm_packages_install_ts(&argv[nopts], nargs - nopts, ts)) >= 0)
+            return ec;
+
+        logn(LOGWARN, _("falling back to %s"), cmd);
+    }
+#endif
+
     if (poldek_VERBOSE) {
         char buf[8192], *p;
         p = buf;
@@ -98,6 +98,8 @@ int pm_rpm_vercmp(const char *one, const char *two);
 int pm_rpmhdr_loadfdt(FD_t fdt, Header *hdr, const char *path);
 int pm_rpmhdr_loadfile(const char *path, Header *hdr);
 Header pm_rpmhdr_readfdt(void *fdt); /* headerRead */
+/* header from on-disk image without magic (il, dl, index, data) */
+Header pm_rpmhdr_loadblob(const void *blob, size_t size);
 
 int pm_rpmhdr_nevr(void *h, const char **name, int32_t *epoch,
                    const char **version, const char **release,
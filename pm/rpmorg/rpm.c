@@ -108,6 +108,10 @@ int pm_rpm_configure(void *pm_rpm, const char *key, void *val)
             pm->rpm = n_strdup(val);
         DBGF("%s %s\n", key, (char *)val);
 
+    } else if (n_str_eq(key, "nativets")) {
+        logn(LOGWARN, _("native transaction is not supported with rpm.org, "
+                        "PM command will be used"));
+
     } else if (n_str_eq(key, "sudocmd")) {
         n_cfree(&pm->sudo);
         if (val)
@@ -147,6 +147,11 @@ int pm_rpmhdr_loadfile(const char *path, Header *hdr)
     return rc;
 }
 
+Header pm_rpmhdr_loadblob(const void *blob, size_t size)
+{
+    return headerImport((void *)blob, size, HEADERIMPORT_COPY);
+}
+
 Header pm_rpmhdr_readfdt(void *fdt)
 {
     Header h;
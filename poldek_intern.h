@@ -37,6 +37,7 @@ struct poldek_ctx {
 
     struct pkgset    *ps;
     struct pm_ctx    *pmctx;       /* package manager context */
+    struct pkgdb_idx *dbidx;       /* installed packages, shared by ts-es */
     int              _rpm_tscolor; /* rpm transaction color */
     int              _depsolver;
     unsigned         _ps_setup_flags;
@@ -70,6 +71,14 @@ void poldek__ts_postconf(struct poldek_ctx *ctx, struct poldek_ts *ts);
 struct pkgdb;
 struct pkgdb *poldek_ts_dbopen(struct poldek_ts *ts, mode_t mode);
 
+/* sets installed packages index used by poldek_ts_dbopen()-ed dbs */
+struct pkgdb_idx;
+void poldek__set_installed_index(struct poldek_ctx *ctx,
+                                 struct pkgdb_idx *idx);
+/* applies ts->pkgs_{installed,removed} to the index attached by
+   poldek_ts_dbopen(); drops the index if it cannot be updated */
+void poldek__ts_update_installed_index(struct poldek_ts *ts);
+
 void poldek_ts_xsetop(struct poldek_ts *ts, int optv, int on, int touch);
 
 void poldek__ts_dump_settings(struct poldek_ctx *ctx, struct poldek_ts *ts);
@@ -301,6 +301,10 @@ static void poldek_ts_destroy(struct poldek_ts *ts)
 
     ts->db = NULL;
 
+    if (ts->_dbidx)
+        pkgdb_idx_free(ts->_dbidx);
+    ts->_dbidx = NULL;
+
     if (ts->aps)
         arg_packages_free(ts->aps);
 
@@ -552,14 +556,63 @@ int poldek_ts_vconfigure(struct poldek_ts *ts, int param, va_list ap)
     return rc;
 }
 
+void poldek__set_installed_index(struct poldek_ctx *ctx,
+                                 struct pkgdb_idx *idx)
+{
+    if (ctx->dbidx)
+        pkgdb_idx_free(ctx->dbidx);
+
+    ctx->dbidx = idx ? pkgdb_idx_link(idx) : NULL;
+}
+
 struct pkgdb *poldek_ts_dbopen(struct poldek_ts *ts, mode_t mode)
 {
+    struct pkgdb *db;
+
     if (mode == 0)
         mode = O_RDONLY;
 
-    return pkgdb_open(ts->pmctx, ts->rootdir, NULL, mode,
-                      ts->pm_pdirsrc ? "source" : NULL,
-                      ts->pm_pdirsrc ? ts->pm_pdirsrc : NULL, NULL);
+    db = pkgdb_open(ts->pmctx, ts->rootdir, NULL, mode,
+                    ts->pm_pdirsrc ? "source" : NULL,
+                    ts->pm_pdirsrc ? ts->pm_pdirsrc : NULL, NULL);
+
+    if (db && ts->ctx && ts->ctx->dbidx && (mode & O_CREAT) == 0) {
+        /* db changed outside poldek, index is useless now */
+        if (!pkgdb_set_index(db, ts->ctx->dbidx)) {
+            poldek__set_installed_index(ts->ctx, NULL);
+
+        } else if (ts->_dbidx != ts->ctx->dbidx) {
+            /* db drops its index on pkgdb_close(), i.e. before PM
+               run, so remember what was attached */
+            if (ts->_dbidx)
+                pkgdb_idx_free(ts->_dbidx);
+            ts->_dbidx = pkgdb_idx_link(ts->ctx->dbidx);
+        }
+    }
+
+    return db;
+}
+
+/* applies committed transaction to shared installed packages index */
+void poldek__ts_update_installed_index(struct poldek_ts *ts)
+{
+    struct poldek_ctx *ctx = ts->ctx;
+    struct pkgdb_idx *idx = ts->_dbidx;
+
+    ts->_dbidx = NULL;
+
+    if (ctx && ctx->dbidx) {
+        /* not attached or transaction results are unknown */
+        if (idx != ctx->dbidx || ts->db == NULL ||
+            !poldek_ts_issetf(ts, POLDEK_TS_TRACK) ||
+            !pkgdb_idx_update(ctx->dbidx, ts->db, ts->pkgs_installed,
+                              ts->pkgs_removed)) {
+            poldek__set_installed_index(ctx, NULL);
+        }
+    }
+
+    if (idx)
+        pkgdb_idx_free(idx);
 }
 
 int poldek_ts_add_pkg(struct poldek_ts *ts, struct pkg *pkg)
@@ -814,8 +867,10 @@ static int ts_run_upgrade_dist(struct poldek_ts *ts)
 
     pkgdb_tx_begin(ts->db, ts);
     rc = do_poldek_ts_upgrade_dist(ts);
-    if (rc && !ts->getop(ts, POLDEK_OP_RPMTEST))
+    if (rc && !ts->getop(ts, POLDEK_OP_RPMTEST)) {
         pkgdb_tx_commit(ts->db);
+        poldek__ts_update_installed_index(ts);
+    }
     pkgdb_free(ts->db);
     ts->db = NULL;
     return rc;
@@ -851,8 +906,10 @@ static int ts_run_install(struct poldek_ts *ts)
     DBGF("0 arg_packages_size=%d\n", arg_packages_size(ts->aps));
 
     rc = i3_do_poldek_ts_install(ts);
-    if (rc && !ts->getop(ts, POLDEK_OP_RPMTEST))
+    if (rc && !ts->getop(ts, POLDEK_OP_RPMTEST)) {
         pkgdb_tx_commit(ts->db);
+        poldek__ts_update_installed_index(ts);
+    }
 
     pkgdb_free(ts->db);
     ts->db = NULL;
@@ -872,8 +929,10 @@ static int ts_run_uninstall(struct poldek_ts *ts)
 
     rc = do_poldek_ts_uninstall(ts);
 
-    if (rc && !ts->getop(ts, POLDEK_OP_TEST))
+    if (rc && !ts->getop(ts, POLDEK_OP_TEST)) {
         pkgdb_tx_commit(ts->db);
+        poldek__ts_update_installed_index(ts);
+    }
 
     MEMINF("before dbfree");
     pkgdb_free(ts->db);
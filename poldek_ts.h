@@ -111,6 +111,7 @@ enum poldek_ts_opt {
 
 struct poldek_ctx;
 struct pkgdb;
+struct pkgdb_idx;
 struct pm_ctx;
 struct source;
 struct arg_packages;
@@ -123,6 +124,7 @@ struct poldek_ts {
     char               *typenam;
     struct poldek_ctx  *ctx;
     struct pkgdb       *db;
+    struct pkgdb_idx   *_dbidx;     /* ctx->dbidx as attached to db */
     struct pm_ctx      *pmctx;
     struct source      *pm_pdirsrc; /* for 'pset' PM, XXX unused, to rethink */
     tn_array           *pkgs;
@@ -0,0 +1,154 @@
+#include "test.h"
+#include "cli/export.h"
+
+#define NOLAZY (EXPORT_REC_NOFILES | EXPORT_REC_NODESC)
+
+static struct pkg *new_pkg(void)
+{
+    struct pkg *pkg;
+
+    pkg = pkg_new_ext(NULL, "foo", 1, "1.0", "2", "x86_64", "linux",
+                      NULL, "foo-1.0-2", 100, 50, 1000);
+
+    pkg->caps = capreq_arr_new(1);
+    n_array_push(pkg->caps, capreq_new(NULL, "foo", 1, "1.0", "2", REL_EQ, 0));
+
+    pkg->cnfls = capreq_arr_new(2);
+    n_array_push(pkg->cnfls, capreq_new(NULL, "bar", 0, "2.0", NULL, REL_LT,
+                                        CAPREQ_CNFL));
+    n_array_push(pkg->cnfls, capreq_new(NULL, "oldfoo", 0, NULL, NULL, 0,
+                                        CAPREQ_CNFL | CAPREQ_OBCNFL));
+    return pkg;
+}
+
+static uint32_t get_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+struct field {
+    int         tag;
+    int         size;
+    const char  *data;       /* NULL => data is uint32 value */
+    uint32_t    value;
+};
+
+/* checks record at p, returns its size */
+static int check_record(const unsigned char *p, int avail,
+                        const struct field *fields)
+{
+    uint32_t size;
+    int i, n = 4;
+
+    fail_if(avail < 4, "truncated record");
+    size = get_be32(p);
+    fail_if(size + 4 > (uint32_t)avail, "record size %u > %d", size, avail - 4);
+
+    for (i = 0; fields[i].tag; i++) {
+        const struct field *f = &fields[i];
+
+        fail_if(n + 5 > (int)size + 4, "field %c: truncated record", f->tag);
+        expect_int(p[n], f->tag);
+        expect_int(get_be32(&p[n + 1]), f->size);
+        n += 5;
+
+        if (f->data)
+            fail_if(memcmp(&p[n], f->data, f->size) != 0,
+                    "field %c: data mismatch", f->tag);
+        else
+            expect_int(get_be32(&p[n]), f->value);
+        n += f->size;
+    }
+    expect_int(n, size + 4);        /* no extra fields */
+    return n;
+}
+
+START_TEST (test_binary_record) {
+    struct field fields[] = {
+        { 'N', 3, "foo", 0 },
+        { 'E', 4, NULL, 1 },
+        { 'V', 3, "1.0", 0 },
+        { 'R', 1, "2", 0 },
+        { 'A', 6, "x86_64", 0 },
+        { 'O', 5, "linux", 0 },
+        { 'S', 4, NULL, 100 },
+        { 'z', 4, NULL, 50 },
+        { 'b', 4, NULL, 1000 },
+        { 'r', 17, "foo-1.0-2.src.rpm", 0 },
+        { 'P', 13, "foo\0=\0" "1:1.0-2", 0 },
+        { 'C', 9, "bar\0<\0" "2.0", 0 },
+        { 'o', 8, "oldfoo\0", 0 },
+        { 0, 0, NULL, 0 },
+    };
+    struct pkg *pkg = new_pkg();
+    tn_buf *nbuf = n_buf_new(64);
+    const unsigned char *p;
+    int n;
+
+    /* records are appended, size of each one is its own */
+    export_record(nbuf, pkg, EXPORT_REC_BINARY | NOLAZY);
+    export_record(nbuf, pkg, EXPORT_REC_BINARY | NOLAZY);
+
+    p = (const unsigned char*)n_buf_ptr(nbuf);
+    n = check_record(p, n_buf_size(nbuf), fields);
+    n += check_record(p + n, n_buf_size(nbuf) - n, fields);
+    expect_int(n, n_buf_size(nbuf));
+
+    n_buf_free(nbuf);
+    pkg_free(pkg);
+}
+END_TEST
+
+static void do_test_json(const struct pkg *pkg, const char *expected)
+{
+    tn_buf *nbuf = n_buf_new(64);
+
+    export_record(nbuf, pkg, NOLAZY);
+    n_buf_putc(nbuf, '\0');
+    expect_str(n_buf_ptr(nbuf), expected);
+    n_buf_free(nbuf);
+}
+
+START_TEST (test_json_record) {
+    struct pkg *pkg = new_pkg();
+
+    do_test_json(pkg, "{\"name\":\"foo\",\"epoch\":1,\"version\":\"1.0\","
+                 "\"release\":\"2\",\"arch\":\"x86_64\",\"os\":\"linux\","
+                 "\"size\":100,\"fsize\":50,\"btime\":1000,"
+                 "\"sourcerpm\":\"foo-1.0-2.src.rpm\","
+                 "\"provides\":[{\"name\":\"foo\",\"rel\":\"=\",\"evr\":\"1:1.0-2\"}],"
+                 "\"conflicts\":[{\"name\":\"bar\",\"rel\":\"<\",\"evr\":\"2.0\"}],"
+                 "\"obsoletes\":[{\"name\":\"oldfoo\"}]}\n");
+    pkg_free(pkg);
+}
+END_TEST
+
+START_TEST (test_json_escape) {
+    struct pkg *pkg = pkg_new("bar", 0, "1", "1", NULL, NULL);
+    const char *names[] = {
+        "a\"b\\c\td\x01",
+        "gl\xc3\xbc\xe2\x82\xac\xf0\x9f\x98\x80", /* valid UTF-8 */
+        "x\xffy\xc0\xafz",                        /* invalid, overlong */
+        "\xed\xa0\x80",                           /* surrogate */
+        "\xe2\x82",                               /* truncated */
+        NULL
+    };
+    int i;
+
+    pkg->caps = capreq_arr_new(4);
+    for (i = 0; names[i]; i++)
+        n_array_push(pkg->caps, capreq_new(NULL, names[i], 0, NULL, NULL, 0, 0));
+
+    do_test_json(pkg, "{\"name\":\"bar\",\"epoch\":0,\"version\":\"1\","
+                 "\"release\":\"1\",\"size\":0,\"fsize\":0,\"btime\":0,"
+                 "\"provides\":["
+                 "{\"name\":\"a\\\"b\\\\c\\td\\u0001\"},"
+                 "{\"name\":\"gl\xc3\xbc\xe2\x82\xac\xf0\x9f\x98\x80\"},"
+                 "{\"name\":\"x\\ufffdy\\ufffd\\ufffdz\"},"
+                 "{\"name\":\"\\ufffd\\ufffd\\ufffd\"},"
+                 "{\"name\":\"\\ufffd\\ufffd\"}]}\n");
+    pkg_free(pkg);
+}
+END_TEST
+
+NTEST_RUNNER("export", test_binary_record, test_json_record, test_json_escape);
@@ -0,0 +1,104 @@
+#include "test.h"
+#include "cli/ls_queryfmt.h"
+
+static struct pkg *new_pkg(void)
+{
+    struct pkg *pkg;
+
+    pkg = pkg_new("foo", 1, "1.0", "2", "x86_64", "linux");
+
+    pkg->caps = capreq_arr_new(2);
+    n_array_push(pkg->caps, capreq_new(NULL, "foo", 1, "1.0", "2", REL_EQ, 0));
+    n_array_push(pkg->caps, capreq_new(NULL, "libfoo.so.1", 0, NULL, NULL, 0, 0));
+
+    /* conflicts interleaved with obsoletes */
+    pkg->cnfls = capreq_arr_new(3);
+    n_array_push(pkg->cnfls, capreq_new(NULL, "bar", 0, "2.0", NULL, REL_LT,
+                                        CAPREQ_CNFL));
+    n_array_push(pkg->cnfls, capreq_new(NULL, "oldfoo", 0, NULL, NULL, 0,
+                                        CAPREQ_CNFL | CAPREQ_OBCNFL));
+    n_array_push(pkg->cnfls, capreq_new(NULL, "baz", 0, "1", NULL,
+                                        REL_GT | REL_EQ, CAPREQ_CNFL));
+    return pkg;
+}
+
+/* expected == NULL means format is invalid */
+static void do_test_render(struct pkg *pkg, const char *fmt,
+                           const char *expected)
+{
+    struct lsqf_ent_array *qf;
+    char *fmtbuf = n_strdup(fmt);      /* lsqf_parse() modifies it */
+    tn_buf *nbuf;
+    int rc;
+
+    msgn(1, "  %s", fmt);
+    qf = lsqf_parse(fmtbuf);
+    free(fmtbuf);
+
+    if (qf == NULL) {
+        fail_if(expected, "%s: parse failed", fmt);
+        return;
+    }
+
+    nbuf = n_buf_new(64);
+    rc = lsqf_render(qf, pkg, nbuf);
+    fail_if(rc != (expected != NULL), "%s: render returned %d", fmt, rc);
+
+    if (rc) {
+        n_buf_putc(nbuf, '\0');
+        expect_str(n_buf_ptr(nbuf), expected);
+
+        /* nbuf is reused by ls, rendered packages are appended */
+        n_buf_clean(nbuf);
+        fail_unless(lsqf_render(qf, pkg, nbuf), "%s: 2nd render failed", fmt);
+        n_buf_putc(nbuf, '\0');
+        expect_str(n_buf_ptr(nbuf), expected);
+    }
+
+    n_buf_free(nbuf);
+    lsqf_ent_array_free(qf);
+}
+
+START_TEST (test_render) {
+    struct pkg *pkg = new_pkg();
+
+    msg(1, "\n");
+    do_test_render(pkg, "%{NAME}-%{VERSION}-%{RELEASE}.%{ARCH}\\n",
+                   "foo-1.0-2.x86_64\n");
+    do_test_render(pkg, "%{E}:%{V} 100%%", "1:1.0 100%");
+    do_test_render(pkg, "%6{N}|%{R}", "   foo|2");
+    do_test_render(pkg, "%{#PROVIDES} %{#CONFLICTS} %{#OBSOLETES}", "2 2 1");
+    do_test_render(pkg, "[%{PROVIDES}%{PROVIDEFLAGS:depflags}%{PROVIDEVERSION};]",
+                   "foo = 1:1.0-2;libfoo.so.1  ;");
+    do_test_render(pkg, "[%{C}%{CONFLICTFLAGS:depflags}%{CONFLICTVERSION};]",
+                   "bar < 2.0;baz >= 1;");
+    do_test_render(pkg, "[%{OBSOLETES}:%{OBSOLETEFLAGS};]", "oldfoo:0;");
+    do_test_render(pkg, "[%{=NAME}:%{CONFLICTS} ]", "foo:bar foo:baz ");
+    do_test_render(pkg, "[%{C} ][%{O} ][%{C} ]", "bar baz oldfoo bar baz ");
+
+    /* different sized arrays */
+    do_test_render(pkg, "[%{PROVIDES} %{OBSOLETES}]", NULL);
+    pkg_free(pkg);
+}
+END_TEST
+
+START_TEST (test_parse_errors) {
+    const char *fmts[] = {
+        "%NAME", "%{NAME", "%{}", "%{NOSUCHTAG}", "[%{NAME}", "%{NAME}]",
+        "}", NULL
+    };
+    int i;
+
+    msg(1, "\n");
+    for (i = 0; fmts[i]; i++) {
+        char *fmt = n_strdup(fmts[i]);
+        struct lsqf_ent_array *qf = lsqf_parse(fmt);
+
+        msgn(1, "  %s", fmts[i]);
+        fail_if(qf != NULL, "%s: parsed", fmts[i]);
+        free(fmt);
+    }
+}
+END_TEST
+
+NTEST_RUNNER("ls query format", test_render, test_parse_errors);
@@ -1,4 +1,6 @@
+#include <utime.h>
 #include "test.h"
+#include "poldek_intern.h"
 
 START_TEST (test_system_rpmdb) {
     //char buf[PATH_MAX], tmp[PATH_MAX];
@@ -57,4 +59,72 @@ START_TEST (test_custom_rpmdb) {
 }
 END_TEST
 
-NTEST_RUNNER("PM database", test_system_rpmdb, test_custom_rpmdb);
+/* shared installed packages index must survive pkgdb_close() done
+   by install/uninstall before PM run and be updated after it */
+START_TEST (test_installed_index) {
+    struct poldek_ctx *ctx;
+    struct poldek_ts *ts;
+    struct pkgdb *db;
+    struct pkgdb_idx *idx;
+    struct utimbuf ut;
+    tn_array *pkgs;
+    time_t mtime;
+
+    const char *path = "/tmp/poldek-tests/idx";
+    const char *dbpath = "/tmp/poldek-tests/idx" "/var/lib/rpm";
+    const char *dbfile = "/tmp/poldek-tests/idx" "/var/lib/rpm/Packages";
+
+    system("rm -rf /tmp/poldek-tests/");
+    poldeklib_init();
+
+    ctx = poldek_new(0);
+    poldek_configure(ctx, POLDEK_CONF_ROOTDIR, path);
+    fail_unless(poldek_setup(ctx));
+
+    ts = poldek_ts_new(ctx, 0);
+    db = pkgdb_open(ts->pmctx, path, NULL, O_RDWR, NULL);
+    fail_if(db == NULL);
+    pkgdb_free(db);
+
+    mtime = pm_dbmtime(ts->pmctx, dbpath);
+    fail_if(mtime == 0);
+
+    pkgs = pkgs_array_new(4);
+    idx = pkgdb_idx_new(ts->pmctx, path, mtime, pkgs, PKGDB_IDX_NOFL);
+    fail_if(idx == NULL);
+    poldek__set_installed_index(ctx, idx);
+    pkgdb_idx_free(idx);
+    n_array_free(pkgs);
+
+    ts->db = poldek_ts_dbopen(ts, O_RDWR);
+    fail_if(ts->db == NULL);
+    fail_unless(pkgdb_get_index(ts->db) == idx, "index not attached");
+
+    pkgdb_tx_begin(ts->db, ts);
+    pkgdb_close(ts->db);        /* as install does before PM run */
+
+    /* PM run */
+    ut.actime = ut.modtime = mtime + 10;
+    fail_if(utime(dbfile, &ut) != 0);
+
+    poldek_ts_setf(ts, POLDEK_TS_TRACK);
+    pkgdb_tx_commit(ts->db);
+    poldek__ts_update_installed_index(ts);
+    pkgdb_free(ts->db);
+    ts->db = NULL;
+
+    fail_unless(ctx->dbidx == idx, "index dropped after transaction");
+
+    /* updated, i.e. accepted by freshly opened db */
+    db = poldek_ts_dbopen(ts, O_RDONLY);
+    fail_if(db == NULL);
+    fail_unless(pkgdb_get_index(db) == idx, "index not updated");
+    pkgdb_free(db);
+
+    poldek_ts_free(ts);
+    poldek_free(ctx);
+}
+END_TEST
+
+NTEST_RUNNER("PM database", test_system_rpmdb, test_custom_rpmdb,
+             test_installed_index);
@@ -0,0 +1,125 @@
+#include "test.h"
+#include "pkgdir/pkgdir.h"
+#include "cli/search_idx.h"
+
+#define FMASK 0
+#define PCRE  1
+
+struct literals_case {
+    int         type;
+    const char  *pattern;
+    int         rc;
+    const char  *literals[4];
+};
+
+static void do_test_literals(const struct literals_case *c)
+{
+    tn_array *literals = n_array_new(4, free, NULL);
+    int i, rc;
+
+    if (c->type == FMASK)
+        rc = search_idx_fmask_literals(literals, c->pattern);
+    else
+        rc = search_idx_pcre_literals(literals, c->pattern);
+
+    msgn(1, "  %s %s => %d", c->type == FMASK ? "fmask" : "pcre",
+         c->pattern, rc);
+    fail_if(rc != c->rc, "%s: rc %d, expected %d", c->pattern, rc, c->rc);
+
+    if (rc) {
+        for (i = 0; c->literals[i]; i++) {
+            fail_if(i >= n_array_size(literals),
+                    "%s: missing literal %s", c->pattern, c->literals[i]);
+            expect_str(n_array_nth(literals, i), c->literals[i]);
+        }
+        fail_if(i != n_array_size(literals), "%s: %d literals, expected %d",
+                c->pattern, n_array_size(literals), i);
+    }
+
+    n_array_free(literals);
+}
+
+START_TEST (test_fmask_literals) {
+    struct literals_case cases[] = {
+        { FMASK, "*foo*bar?",     1, { "foo", "bar", NULL } },
+        { FMASK, "[abc]xyzzy*",   1, { "xyzzy", NULL } },
+        { FMASK, "[!]x]libfoo",   1, { "libfoo", NULL } },
+        { FMASK, "foo\\*bar",     1, { "foo*bar", NULL } },
+        { FMASK, "ab*cd",         1, { NULL } },
+        { FMASK, "foo[abc",       0, { NULL } },
+        { 0, NULL, 0, { NULL } },
+    };
+    int i;
+
+    msg(1, "\n");
+    for (i = 0; cases[i].pattern; i++)
+        do_test_literals(&cases[i]);
+}
+END_TEST
+
+START_TEST (test_pcre_literals) {
+    struct literals_case cases[] = {
+        { PCRE, "libfoo\\.so",       1, { "libfoo.so", NULL } },
+        { PCRE, "^foo.*bar$",        1, { "foo", "bar", NULL } },
+        { PCRE, "foo(bar)?baz",      1, { "foo", "baz", NULL } },
+        { PCRE, "foo(bar)+baz",      1, { "foo", "bar", "baz", NULL } },
+        { PCRE, "foo(?!bar)baz",     1, { "foo", "baz", NULL } },
+        { PCRE, "colou?r",           1, { "colo", NULL } },
+        { PCRE, "abc\\d{2,}xyz",     1, { "abc", "xyz", NULL } },
+        { PCRE, "[[:alpha:]]+perl",  1, { "perl", NULL } },
+        { PCRE, "foo|bar",           0, { NULL } },
+        { PCRE, "(foobar",           0, { NULL } },
+        { PCRE, "foobar)",           0, { NULL } },
+        { PCRE, "foo\\1bar",         0, { NULL } },
+        { PCRE, "(?i)foobar",        0, { NULL } },
+        { 0, NULL, 0, { NULL } },
+    };
+    int i;
+
+    msg(1, "\n");
+    for (i = 0; cases[i].pattern; i++)
+        do_test_literals(&cases[i]);
+}
+END_TEST
+
+/* descriptions are per language, so are index documents */
+START_TEST (test_doc_langs) {
+    struct search_idx *idx;
+    struct search_idx_doc *doc, *pldoc;
+    struct pkgdir pkgdir;
+    struct pkg *pkg;
+
+    memset(&pkgdir, 0, sizeof(pkgdir));
+    pkgdir.idxpath = "/tmp/packages.ndir.gz";
+    pkgdir.langs = n_array_new(2, NULL, NULL);
+    n_array_push(pkgdir.langs, "C");
+
+    pkg = pkg_new("foo", 1, "1.0", "2", "x86_64", "linux");
+    pkg->pkgdir = &pkgdir;
+
+    idx = search_idx_load(NULL);
+    doc = search_idx_doc(idx, pkg);
+    fail_unless(search_idx_doc_needs(doc, 1 << 0));
+    search_idx_add(idx, doc, 1 << 0, "Package manager", 0);
+    search_idx_doc_done(idx, doc, 1 << 0);
+
+    fail_unless(search_idx_doc(idx, pkg) == doc);
+    fail_if(search_idx_doc_needs(doc, 1 << 0));
+
+    n_array_clean(pkgdir.langs);
+    n_array_push(pkgdir.langs, "pl_PL");
+    n_array_push(pkgdir.langs, "C");
+
+    pldoc = search_idx_doc(idx, pkg);
+    fail_if(pldoc == doc, "document shared by different languages");
+    fail_unless(search_idx_doc_needs(pldoc, 1 << 0));
+
+    pkg->pkgdir = NULL;
+    pkg_free(pkg);
+    search_idx_free(idx);
+    n_array_free(pkgdir.langs);
+}
+END_TEST
+
+NTEST_RUNNER("search index", test_fmask_literals, test_pcre_literals,
+             test_doc_langs);
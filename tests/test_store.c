@@ -1,6 +1,9 @@
 #include "test.h"
+#include <unistd.h>
 #include "poldek_intern.h"
 #include "capreq.h"
+#include "pkgfl.h"
+#include "pkgdir/pkg_store.h"
 
 static struct capreq *new_capreq(char *name, int versioned)
 {
@@ -71,8 +74,215 @@ START_TEST(test_long_capname) {
 END_TEST
 
 
+static struct pkg *do_test_pkg_store(const struct pkg *pkg)
+{
+    const char *path = "test_store_pkg.tmp";
+    struct pkg *re;
+    tn_stream *st;
+
+    st = n_stream_open(path, "w", TN_STREAM_UNKNOWN);
+    expect_notnull(st);
+    fail_if(pkg_store_st(pkg, st, NULL, PKGSTORE_NODESC | PKGSTORE_NOANYFL) <= 0,
+            "%s: store failed", pkg_id(pkg));
+    n_stream_close(st);
+
+    st = n_stream_open(path, "r", TN_STREAM_UNKNOWN);
+    expect_notnull(st);
+    re = pkg_restore_st(st, NULL, NULL, NULL, 0, NULL, path);
+    n_stream_close(st);
+    unlink(path);
+
+    expect_notnull(re);
+    expect_str(pkg_id(re), pkg_id(pkg));
+    expect_int(re->btime, pkg->btime);
+    return re;
+}
+
+START_TEST(test_sectime) {
+    struct pkg *pkg, *re;
+
+    pkg = pkg_new("foo", 0, "1.0", "1", "x86_64", "linux");
+    pkg->btime = 1000;
+
+    /* unknown security fix time is not stored */
+    re = do_test_pkg_store(pkg);
+    fail_if(re->flags & PKG_HAS_SECTIME, "%s: unexpected sectime", pkg_id(re));
+    pkg_free(re);
+
+    pkg->flags |= PKG_HAS_SECTIME;
+    pkg->sectime = 1234567890;
+    re = do_test_pkg_store(pkg);
+    fail_unless(re->flags & PKG_HAS_SECTIME, "%s: no sectime", pkg_id(re));
+    expect_int(re->sectime, pkg->sectime);
+    pkg_free(re);
+
+    /* no security fix is stored too */
+    pkg->sectime = 0;
+    re = do_test_pkg_store(pkg);
+    fail_unless(re->flags & PKG_HAS_SECTIME, "%s: no sectime", pkg_id(re));
+    expect_int(re->sectime, 0);
+    pkg_free(re);
+
+    pkg_free(pkg);
+}
+END_TEST
+
+static void pkgfl_collect(tn_array *entries, struct pkgfl_ent *flent)
+{
+    char buf[1024];
+    int i;
+
+    if (flent->items == 0) {
+        n_array_push(entries, n_strdup(flent->dirname));
+        return;
+    }
+
+    for (i=0; i < flent->items; i++) {
+        struct flfile *f = flent->files[i];
+        const char *linkto = "";
+
+        if (S_ISLNK(f->mode))
+            linkto = f->basename + strlen(f->basename) + 1;
+
+        n_snprintf(buf, sizeof(buf), "%s %s %o %u %s", flent->dirname,
+                   f->basename, f->mode, f->size, linkto);
+        n_array_push(entries, n_strdup(buf));
+    }
+}
+
+static int pkgfl_map_collect(struct pkgfl_ent *flent, void *entries)
+{
+    pkgfl_collect(entries, flent);
+    return 1;
+}
+
+static void do_test_pkgfl_map(tn_tuple *fl, tn_array *dirs, int include)
+{
+    const char *path = "test_store_pkgfl.tmp";
+    tn_array *restored, *mapped, *dirnames;
+    tn_tuple *refl = NULL;
+    tn_alloc *na;
+    tn_stream *st;
+    tn_buf *nbuf;
+    int i, n;
+
+    nbuf = n_buf_new(1024);
+    pkgfl_store(fl, nbuf, NULL, NULL, PKGFL_ALL);
+
+    st = n_stream_open(path, "w", TN_STREAM_UNKNOWN);
+    expect_notnull(st);
+    expect_int(n_stream_write(st, n_buf_ptr(nbuf), n_buf_size(nbuf)),
+               n_buf_size(nbuf));
+    n_stream_close(st);
+    n_buf_free(nbuf);
+
+    restored = n_array_new(16, free, NULL);
+    mapped = n_array_new(16, free, NULL);
+    dirnames = n_array_new(16, free, NULL);
+
+    na = n_alloc_new(16, TN_ALLOC_OBSTACK);
+    st = n_stream_open(path, "r", TN_STREAM_UNKNOWN);
+    n = pkgfl_restore_st(na, &refl, st, dirs, include);
+    n_stream_close(st);
+
+    fail_if(n < 0, "pkgfl_restore_st failed");
+    for (i=0; refl && i < n_tuple_size(refl); i++)
+        pkgfl_collect(restored, n_tuple_nth(refl, i));
+
+    st = n_stream_open(path, "r", TN_STREAM_UNKNOWN);
+    expect_int(pkgfl_map_st(st, dirs, include, 0, pkgfl_map_collect, mapped), n);
+    n_stream_close(st);
+
+    st = n_stream_open(path, "r", TN_STREAM_UNKNOWN);
+    expect_int(pkgfl_map_st(st, dirs, include, PKGFL_MAP_DIRNAMES,
+                            pkgfl_map_collect, dirnames), n);
+    n_stream_close(st);
+    unlink(path);
+
+    expect_int(n_array_size(mapped), n_array_size(restored));
+    for (i=0; i < n_array_size(restored); i++)
+        expect_str(n_array_nth(mapped, i), n_array_nth(restored, i));
+
+    /* with PKGFL_MAP_DIRNAMES there are dirnames only */
+    expect_int(n_array_size(dirnames), n);
+    for (i=0; i < n; i++) {
+        struct pkgfl_ent *flent = n_tuple_nth(refl, i);
+        expect_str(n_array_nth(dirnames, i), flent->dirname);
+    }
+
+    n_array_free(restored);
+    n_array_free(mapped);
+    n_array_free(dirnames);
+    n_alloc_free(na);
+}
+
+static struct pkgfl_ent *pkgfl_ent_add(tn_alloc *na, struct pkgfl_ent **ents,
+                                       int *n, const char *dirname, int nfiles)
+{
+    char *dn = na->na_malloc(na, strlen(dirname) + 1);
+    struct pkgfl_ent *flent;
+
+    strcpy(dn, dirname);
+    flent = pkgfl_ent_new(na, dn, strlen(dn), nfiles);
+    ents[(*n)++] = flent;
+    return flent;
+}
+
+static void pkgfl_file_add(tn_alloc *na, struct pkgfl_ent *flent,
+                           const char *bn, uint16_t mode, uint32_t size,
+                           const char *linkto)
+{
+    flent->files[flent->items++] =
+        flfile_new(na, size, mode, bn, strlen(bn),
+                   linkto, linkto ? strlen(linkto) : 0);
+}
+
+START_TEST(test_pkgfl_map) {
+    tn_alloc *na = n_alloc_new(16, TN_ALLOC_OBSTACK);
+    struct pkgfl_ent *ents[8];
+    tn_array *dirs = n_array_new(4, NULL, (tn_fn_cmp)strcmp);
+    struct pkgfl_ent *flent;
+    tn_tuple *fl;
+    int n = 0;
+
+    flent = pkgfl_ent_add(na, ents, &n, "/", 1);
+    pkgfl_file_add(na, flent, "boot", S_IFDIR | 0755, 0, NULL);
+
+    flent = pkgfl_ent_add(na, ents, &n, "/etc/", 1);
+    pkgfl_file_add(na, flent, "foo.conf", S_IFREG | 0644, 10, NULL);
+
+    flent = pkgfl_ent_add(na, ents, &n, "/usr/bin", 3);
+    pkgfl_file_add(na, flent, "foo", S_IFREG | 0755, 1000, NULL);
+    pkgfl_file_add(na, flent, "bar", S_IFLNK | 0777, 3, "foo");
+    pkgfl_file_add(na, flent, "baz", S_IFLNK | 0777, 13, "../lib/foo.so");
+
+    flent = pkgfl_ent_add(na, ents, &n, "/usr/lib", 2);
+    pkgfl_file_add(na, flent, "foo.so", S_IFLNK | 0777, 8, "foo.so.1");
+    pkgfl_file_add(na, flent, "foo.so.1", S_IFREG | 0755, 2000, NULL);
+
+    /* empty directory */
+    pkgfl_ent_add(na, ents, &n, "/var/lib/foo", 0);
+
+    fl = n_tuple_new(na, n, (void **)ents);
+
+    do_test_pkgfl_map(fl, NULL, 0);
+
+    n_array_push(dirs, "usr/bin");
+    n_array_push(dirs, "/");
+    n_array_sort(dirs);
+
+    do_test_pkgfl_map(fl, dirs, 1);
+    do_test_pkgfl_map(fl, dirs, 0);
+
+    n_array_free(dirs);
+    n_alloc_free(na);
+}
+END_TEST
+
 
 NTEST_RUNNER("store",
              test_cap,
-             test_long_capname
+             test_long_capname,
+             test_sectime,
+             test_pkgfl_map
     );
@@ -408,6 +408,9 @@ static int do_process(struct uninstall_ctx *uctx)
     MEMINF("startdeps");
     msgn(1, _("Processing dependencies..."));
 
+    /* closure is computed from in-memory index, not by rpmdb queries */
+    pkgdb_build_index(uctx->db);
+
     tmp = n_array_dup(uctx->unpkgs, (tn_fn_dup)pkg_link);
     for (i=0; i < n_array_size(tmp); i++) {
         struct pkg *dbpkg = n_array_nth(tmp, i);
@@ -43,41 +43,44 @@
 #include "pm/pm.h"
 #include "install3/install.h"
 
-int process_pkg(const struct pkg *dbpkg, struct poldek_ts *ts,
-                tn_hash *marked_h, int *nmarked)
-{
-    struct pkg *pkg = NULL, *tmpkg;
-    char pkgkey[256];
-    int i, cmprc;
+/*
+  Both installed and available packages are sorted by name (and descending
+  EVR), so upgrade candidates are found by a single merge-join pass over
+  them; only the marked candidates go to the install3 solver. Obsoletes
+  are left to the solver.
+*/
 
-    i = n_array_bsearch_idx_ex(ts->ctx->ps->pkgs, dbpkg, (tn_fn_cmp)pkg_cmp_name);
-    if (i < 0) {
-        msgn(3, "%-32s not found in repository", pkg_id(dbpkg));
-        return 1;
-    }
+/* select upgrade candidate of dbpkg from avpkgs[from..to) name run */
+static struct pkg *select_candidate(struct poldek_ts *ts, const struct pkg *dbpkg,
+                                    tn_array *avpkgs, int from, int to)
+{
+    int i;
 
-    while (i < n_array_size(ts->ctx->ps->pkgs)) {
-        pkg = n_array_nth(ts->ctx->ps->pkgs, i);
+    if (!ts->getop(ts, POLDEK_OP_MULTILIB))
+        return n_array_nth(avpkgs, from); /* the highest EVR */
 
-        if (!ts->getop(ts, POLDEK_OP_MULTILIB))
-            break;
+    for (i = from; i < to; i++) {
+        struct pkg *pkg = n_array_nth(avpkgs, i);
 
-	if (0 != strcmp(dbpkg->name, pkg->name))
-	{
-	    pkg = NULL;
-	    break;
-	}
+        msgn(4, "UPGRADE-DIST from pkg %s.%s => to pkg %s-%s-%s.%s kind:%d up_arch:%d",
+             pkg_snprintf_s(dbpkg), pkg_arch(dbpkg), pkg->name, pkg->ver,
+             pkg->rel, pkg_arch(pkg), pkg_is_kind_of(dbpkg, pkg),
+             pkg_is_arch_compat(dbpkg, pkg));
 
-	msgn(4, "UPGRADE-DIST from pkg %s.%s => to pkg %s-%s-%s.%s kind:%d up_arch:%d",
-		pkg_snprintf_s(dbpkg), pkg_arch(dbpkg), pkg->name, pkg->ver, pkg->rel, pkg_arch(pkg),
-		pkg_is_kind_of(dbpkg, pkg), pkg_is_arch_compat(dbpkg, pkg));
+        if (pkg_cmp_evr(pkg, dbpkg) > 0 && pkg_is_kind_of(pkg, dbpkg) &&
+            pkg_is_arch_compat(pkg, dbpkg))
+            return pkg;
+    }
 
-        if (pkg_cmp_evr(pkg, dbpkg) > 0 && pkg_is_kind_of(pkg, dbpkg) && pkg_is_arch_compat(pkg, dbpkg))
-            break;
+    return NULL;
+}
 
-        i++;
-        pkg = NULL;
-    }
+static int process_pkg(const struct pkg *dbpkg, struct pkg *pkg,
+                       struct poldek_ts *ts, tn_hash *marked_h, int *nmarked)
+{
+    struct pkg *tmpkg;
+    char pkgkey[256];
+    int cmprc;
 
     if (pkg == NULL) {
         msgn(3, "%-32s match not found in repository", pkg_id(dbpkg));
@@ -126,17 +129,14 @@ int process_pkg(const struct pkg *dbpkg, struct poldek_ts *ts,
     return 1;
 }
 
-
-int do_poldek_ts_upgrade_dist(struct poldek_ts *ts)
+/* RET: installed packages (NEVRA only) sorted by name and EVR */
+static tn_array *load_installed(struct poldek_ts *ts)
 {
-    //map_s.avpkgs = ts->ctx->ps->pkgs;
     struct pkgdb_it       it;
     const struct pm_dbrec *dbrec;
-    tn_hash               *marked_h;
-    int                   nmarked = 0;
+    tn_array              *dbpkgs;
 
-    marked_h = n_hash_new(1024, NULL);
-    msgn(1, _("Looking up packages for upgrade..."));
+    dbpkgs = pkgs_array_new_ex(1024, pkg_cmp_name_evr_rev);
 
     pkgdb_it_init(ts->db, &it, PMTAG_RECNO, NULL);
     while ((dbrec = pkgdb_it_get(&it))) {
@@ -153,23 +153,71 @@ int do_poldek_ts_upgrade_dist(struct poldek_ts *ts)
 
             pkg = pkg_new(t.name, t.epoch, t.ver, t.rel, arch, NULL);
             pkg->color = t.color;
+            pkg->recno = dbrec->recno;
+            n_array_push(dbpkgs, pkg);
+        }
+
+        if (sigint_reached())
+            break;
+    }
+    pkgdb_it_destroy(&it);
+
+    if (sigint_reached()) {
+        n_array_free(dbpkgs);
+        return NULL;
+    }
+
+    n_array_sort(dbpkgs);
+    return dbpkgs;
+}
+
+int do_poldek_ts_upgrade_dist(struct poldek_ts *ts)
+{
+    tn_array              *dbpkgs, *avpkgs;
+    tn_hash               *marked_h;
+    int                   i, nmarked = 0, avi = 0, avsize;
+
+    msgn(1, _("Looking up packages for upgrade..."));
+
+    if ((dbpkgs = load_installed(ts)) == NULL)
+        return 0;
+
+    avpkgs = ts->ctx->ps->pkgs;
+    n_assert(n_array_ctl_get_cmpfn(avpkgs) == (tn_fn_cmp)pkg_cmp_name_evr_rev);
+    n_array_sort(avpkgs);
+    avsize = n_array_size(avpkgs);
+
+    marked_h = n_hash_new(1024, NULL);
 
-            if (process_pkg(pkg, ts, marked_h, &nmarked) < 0) {
-                pkg_free(pkg);
-                break;
-            }
+    for (i=0; i < n_array_size(dbpkgs); i++) {
+        struct pkg *dbpkg = n_array_nth(dbpkgs, i);
+        int cmprc = -1, to;
 
-            pkg_free(pkg);
+        /* advance to dbpkg's name; dbpkgs may have several instances */
+        while (avi < avsize &&
+               (cmprc = pkg_cmp_name(n_array_nth(avpkgs, avi), dbpkg)) < 0)
+            avi++;
+
+        if (avi == avsize || cmprc != 0) {
+            msgn(3, "%-32s not found in repository", pkg_id(dbpkg));
+            continue;
         }
 
+        to = avi + 1;
+        while (to < avsize && pkg_cmp_name(n_array_nth(avpkgs, to), dbpkg) == 0)
+            to++;
+
+        process_pkg(dbpkg, select_candidate(ts, dbpkg, avpkgs, avi, to),
+                    ts, marked_h, &nmarked);
+
         if (sigint_reached()) {
             nmarked = 0;
             break;
         }
     }
 
-    pkgdb_it_destroy(&it);
     n_hash_free(marked_h);
+    n_array_free(dbpkgs);
 
     if (nmarked == 0) {
         msgn(1, _("Nothing to do"));
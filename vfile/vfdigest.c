@@ -0,0 +1,299 @@
+/*
+  Copyright (C) 2000 - 2008 Pawel A. Gajda <mis@pld-linux.org>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2 as
+  published by the Free Software Foundation (see file COPYING for details).
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+  Streaming verification of rpm package MD5 digest (RPMSIGTAG_MD5, the
+  one checked by "rpm -K --nosignature"). Package is parsed as it is
+  being downloaded: lead and signature header are buffered, header and
+  payload bytes are hashed on the fly, so no second read is needed.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+#include <trurl/nassert.h>
+#include <trurl/nmalloc.h>
+
+#include "vfile.h"
+#include "vfile_intern.h"
+
+#define RPMLEAD_SIZE        96
+#define RPMSIGHDR_INTRO     16
+#define RPMSIGTAG_MD5       1004
+#define RPM_BIN_TYPE        7
+#define RPMSIGHDR_MAXIL     (64 * 1024)
+#define RPMSIGHDR_MAXDL     (64 * 1024 * 1024)
+
+enum {
+    ST_LEAD = 0,
+    ST_SIGHDR_INTRO,
+    ST_SIGHDR,
+    ST_SIGHDR_PAD,
+    ST_HASH,
+    ST_INVALID                  /* not an rpm or no MD5 tag */
+};
+
+struct vf_rpmdigest {
+    int            state;
+    const char     *path;       /* file being fed, used to resync */
+    off_t          off;         /* number of consumed bytes */
+
+    unsigned char  *buf;        /* lead and signature header */
+    size_t         buf_len;
+    size_t         buf_size;
+    size_t         need;        /* bytes needed to leave current state */
+
+    unsigned       il, dl;
+    int            has_md5;
+    unsigned char  md5[16];
+    EVP_MD_CTX     *ctx;
+};
+
+static unsigned be32(const unsigned char *p)
+{
+    return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) |
+        ((unsigned)p[2] << 8) | p[3];
+}
+
+static void digest_reset(struct vf_rpmdigest *dg)
+{
+    dg->state = ST_LEAD;
+    dg->off = 0;
+    dg->buf_len = 0;
+    dg->need = RPMLEAD_SIZE;
+    dg->il = dg->dl = 0;
+    dg->has_md5 = 0;
+    EVP_DigestInit(dg->ctx, EVP_md5());
+}
+
+struct vf_rpmdigest *vf_rpmdigest_new(const char *path)
+{
+    struct vf_rpmdigest *dg;
+
+    dg = n_calloc(1, sizeof(*dg));
+    dg->path = path;
+    dg->buf_size = RPMLEAD_SIZE + RPMSIGHDR_INTRO;
+    dg->buf = n_malloc(dg->buf_size);
+    dg->ctx = EVP_MD_CTX_create();
+    digest_reset(dg);
+    return dg;
+}
+
+void vf_rpmdigest_free(struct vf_rpmdigest *dg)
+{
+    EVP_MD_CTX_destroy(dg->ctx);
+    free(dg->buf);
+    free(dg);
+}
+
+static int find_md5(struct vf_rpmdigest *dg)
+{
+    const unsigned char *index, *data;
+    unsigned i;
+
+    index = dg->buf + RPMLEAD_SIZE + RPMSIGHDR_INTRO;
+    data = index + dg->il * 16;
+
+    for (i=0; i < dg->il; i++) {
+        const unsigned char *e = index + i * 16;
+
+        if (be32(e) != RPMSIGTAG_MD5)
+            continue;
+
+        if (be32(e + 4) != RPM_BIN_TYPE || be32(e + 12) != 16 ||
+            (unsigned long long)be32(e + 8) + 16 > dg->dl)
+            return 0;
+
+        memcpy(dg->md5, data + be32(e + 8), 16);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* consumes lead and signature header, returns number of bytes eaten */
+static size_t parse(struct vf_rpmdigest *dg, const unsigned char *buf,
+                    size_t size)
+{
+    size_t n = size;
+
+    if (n > dg->need)
+        n = dg->need;
+
+    if (dg->state != ST_SIGHDR_PAD) {
+        if (dg->buf_len + n > dg->buf_size) {
+            dg->buf_size = dg->buf_len + dg->need;
+            dg->buf = n_realloc(dg->buf, dg->buf_size);
+        }
+        memcpy(dg->buf + dg->buf_len, buf, n);
+        dg->buf_len += n;
+    }
+
+    dg->need -= n;
+    if (dg->need > 0)
+        return n;
+
+    switch (dg->state) {
+        case ST_LEAD:
+            if (be32(dg->buf) != 0xedabeedb) {
+                dg->state = ST_INVALID;
+                break;
+            }
+            dg->state = ST_SIGHDR_INTRO;
+            dg->need = RPMSIGHDR_INTRO;
+            break;
+
+        case ST_SIGHDR_INTRO: {
+            const unsigned char *p = dg->buf + RPMLEAD_SIZE;
+
+            dg->il = be32(p + 8);
+            dg->dl = be32(p + 12);
+
+            if (be32(p) != 0x8eade801 || dg->il > RPMSIGHDR_MAXIL ||
+                dg->dl > RPMSIGHDR_MAXDL) {
+                dg->state = ST_INVALID;
+                break;
+            }
+            dg->state = ST_SIGHDR;
+            dg->need = dg->il * 16 + dg->dl;
+            if (dg->need > 0)
+                break;
+        }
+            /* fallthrough */
+
+        case ST_SIGHDR:
+            if (!(dg->has_md5 = find_md5(dg))) {
+                dg->state = ST_INVALID;
+                break;
+            }
+
+            dg->state = ST_SIGHDR_PAD;
+            dg->need = (8 - (dg->dl % 8)) % 8;
+            if (dg->need > 0)
+                break;
+            /* fallthrough */
+
+        case ST_SIGHDR_PAD:
+            dg->state = ST_HASH;
+            break;
+
+        default:
+            n_assert(0);
+    }
+
+    return n;
+}
+
+static void update(struct vf_rpmdigest *dg, const unsigned char *buf,
+                   size_t size)
+{
+    while (size > 0 && dg->state < ST_HASH) {
+        size_t n = parse(dg, buf, size);
+        buf += n;
+        size -= n;
+        dg->off += n;
+    }
+
+    if (size > 0 && dg->state == ST_HASH)
+        EVP_DigestUpdate(dg->ctx, buf, size);
+
+    dg->off += size;
+}
+
+/*
+  Re-hashes first off bytes of already written file; needed when
+  transfer is resumed by another request or restarted from scratch.
+*/
+static int resync(struct vf_rpmdigest *dg, off_t off)
+{
+    unsigned char buf[8192];
+    int fd, rc = 1;
+
+    digest_reset(dg);
+    if (off == 0)
+        return 1;
+
+    if ((fd = open(dg->path, O_RDONLY)) < 0)
+        return 0;
+
+    while (dg->off < off) {
+        size_t len = sizeof(buf);
+        ssize_t n;
+
+        if (off - dg->off < (off_t)len)
+            len = off - dg->off;
+
+        if ((n = read(fd, buf, len)) <= 0) {
+            rc = 0;
+            break;
+        }
+        update(dg, buf, n);
+    }
+
+    close(fd);
+    return rc;
+}
+
+void vf_rpmdigest_update(void *digest, off_t off, const void *buf,
+                         size_t size)
+{
+    struct vf_rpmdigest *dg = digest;
+
+    if (dg->state == ST_INVALID && off == dg->off) {
+        dg->off += size;
+        return;
+    }
+
+    if (off != dg->off && !resync(dg, off)) {
+        dg->state = ST_INVALID;
+        dg->off = off + size;
+        return;
+    }
+
+    update(dg, buf, size);
+}
+
+/*
+  Returns 1 if digest matches, -1 on mismatch and 0 if file
+  could not be verified this way (not an rpm, no MD5, not fed in full).
+*/
+int vf_rpmdigest_final(struct vf_rpmdigest *dg, int fd)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned md_size = 0;
+    struct stat st;
+
+    if (dg->state != ST_HASH || !dg->has_md5)
+        return 0;
+
+    if (fstat(fd, &st) != 0 || st.st_size != dg->off)
+        return 0;
+
+    EVP_DigestFinal(dg->ctx, md, &md_size);
+    dg->state = ST_INVALID;     /* ctx is finalized */
+
+    if (md_size != sizeof(dg->md5) || memcmp(md, dg->md5, md_size) != 0)
+        return -1;
+
+    return 1;
+}
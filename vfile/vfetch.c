@@ -275,6 +275,9 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
     if ((req = vf_request_new(url, destpath)) == NULL)
         goto l_end;
 
+    if (flags & VF_FETCH_RPMDIGEST)
+        req->digest = vf_rpmdigest_new(req->destpath);
+
     if (req->proxy_url) {
         if ((mod = select_vf_module(req->proxy_url)) == NULL) {
             rc = vf_fetch_ext(url, destdir);
@@ -331,6 +334,22 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
             req = NULL;
             rc = vf_fetch(redir_url, destdir, flags, NULL, NULL);
         }
+
+    } else if (req->digest) {
+        switch (vf_rpmdigest_final(req->digest, req->dest_fd)) {
+            case 1:
+                *ftrc = VF_FETCHRC_VERIFIED;
+                break;
+
+            case -1:
+                vf_logerr(_("%s: MD5 digest mismatch\n"), n_basenam(req->url));
+                vf_unlink(req->destpath);
+                rc = 0;
+                break;
+
+            default:            /* not verifiable this way */
+                break;
+        }
     }
     if (req)
         vf_request_free(req);
@@ -425,11 +444,21 @@ int vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
 
 int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
               const char *urlabel, int begin, int max)
+{
+    return vf_fetcha_ex(urls, destdir, flags, urlabel, begin, max, NULL);
+}
+
+int vf_fetcha_ex(tn_array *urls, const char *destdir, unsigned flags,
+                 const char *urlabel, int begin, int max,
+                 unsigned char *verified)
 {
     const struct vf_module *mod = NULL;
     char counter[32];
     int rc = 1;
 
+    if (verified)
+        memset(verified, 0, n_array_size(urls));
+
     if ((mod = select_vf_module(n_array_nth(urls, 0))) == NULL) {
         rc = vf_fetcha_ext(urls, destdir);
 
@@ -438,11 +467,17 @@ int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
 
         for (i=0; i < n_array_size(urls); i++) {
             const char *url = n_array_nth(urls, i);
+            enum vf_fetchrc ftrc;
+
             snprintf(counter, sizeof(counter), "[%d/%d] ", begin + i + 1 , max);
-            if (!vf_fetch(url, destdir, flags, max > 1 ? counter : NULL, urlabel)) {
+            if (!vfile__vf_fetch(url, destdir, flags, max > 1 ? counter : NULL,
+                                 urlabel, &ftrc)) {
                 rc = 0;
                 break;
             }
+
+            if (verified)
+                verified[i] = (ftrc == VF_FETCHRC_VERIFIED);
         }
     }
 
@@ -414,6 +414,8 @@ int vfff_transfer_file(struct vcn *cn, struct vfff_req *vreq, long total_size)
                     is_err = 1;
                     break;
                 }
+                if (vreq->data_fn)
+                    vreq->data_fn(vreq->data_fn_data, amount, buf, nw);
                 amount += nw;
                 if (vreq->progress_fn)
                     vreq->progress_fn(vreq->progress_fn_data, total_size, amount);
@@ -114,6 +114,10 @@ struct vfff_req {
     void         (*progress_fn)(void *data, long total, long amount);
     void         *progress_fn_data;
 
+    /* called with every chunk written at offset off */
+    void         (*data_fn)(void *data, off_t off, const void *buf, size_t size);
+    void         *data_fn_data;
+
     char         redirected_to[PATH_MAX];
 
     off_t        st_remote_size;
@@ -257,6 +257,11 @@ int do_vfn(const struct do_fn *dofn, struct vf_request *req,
             vreq.progress_fn_data = req->bar;
             vreq.progress_fn = vf_progress;
         }
+
+        if (req->digest) {
+            vreq.data_fn_data = req->digest;
+            vreq.data_fn = vf_rpmdigest_update;
+        }
     }
 
     *vreq.redirected_to = '\0';
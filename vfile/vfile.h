@@ -163,6 +163,7 @@ EXPORT int vf_stat(const char *url, const char *destdir, struct vf_stat *vfstat,
 
 #define VF_FETCH_NOLABEL     (1 << 3)
 #define VF_FETCH_NOPROGRESS  (1 << 4)
+#define VF_FETCH_RPMDIGEST   (1 << 5) /* check rpm's MD5 while downloading */
 
 EXPORT int vf_fetch(const char *url, const char *dest_dir, unsigned flags,
              const char *counter, const char *urlabel);
@@ -170,6 +171,12 @@ EXPORT int vf_fetch(const char *url, const char *dest_dir, unsigned flags,
 EXPORT int vf_fetcha(tn_array *urls, const char *destdir, unsigned flags,
               const char *urlabel, int begin, int max);
 
+/* verified[i] is set if i-th package digest was checked on the fly
+   (VF_FETCH_RPMDIGEST); unset ones need to be verified as usual */
+EXPORT int vf_fetcha_ex(tn_array *urls, const char *destdir, unsigned flags,
+                        const char *urlabel, int begin, int max,
+                        unsigned char *verified);
+
 EXPORT int vf_url_type(const char *url);
 EXPORT char *vf_url_proto(char *proto, int size, const char *url);
 EXPORT int vf_url_as_dirpath(char *buf, size_t size, const char *url);
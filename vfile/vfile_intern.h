@@ -16,7 +16,8 @@
 enum vf_fetchrc {
     VF_FETCHRC_NIL = 0,
     VF_FETCHRC_UPTODATE = 1,
-    VF_FETCHRC_FETCHED  = 2
+    VF_FETCHRC_FETCHED  = 2,
+    VF_FETCHRC_VERIFIED = 3     /* fetched, rpm digest checked on the fly */
 };
 
 
@@ -24,6 +25,15 @@ int vfile__vf_fetch(const char *url, const char *dest_dir, unsigned flags,
                     const char *counter, const char *urlabel,
                     enum vf_fetchrc *ftrc);
 
+/* vfdigest.c */
+struct vf_rpmdigest;
+struct vf_rpmdigest *vf_rpmdigest_new(const char *path);
+void vf_rpmdigest_free(struct vf_rpmdigest *dg);
+/* feeds size bytes written at offset off, suitable as vfff_req's data_fn */
+void vf_rpmdigest_update(void *digest, off_t off, const void *buf,
+                         size_t size);
+int vf_rpmdigest_final(struct vf_rpmdigest *dg, int fd);
+
 /* only external handlers are used */
 int vf_fetch_ext(const char *url, const char *destdir);
 int vf_fetcha_ext(tn_array *urls, const char *destdir);
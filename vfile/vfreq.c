@@ -354,6 +354,9 @@ void vf_request_free(struct vf_request *req)
 
     vf_request_close_destpath(req);
     n_cfree(&req->destpath);
+
+    if (req->digest)
+        vf_rpmdigest_free(req->digest);
     free(req);
 }
 
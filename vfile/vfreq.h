@@ -23,6 +23,8 @@ void vf_progress_free(void *bar);
 
 #define VF_REQ_INT_REDIRECTED         (1 << 0)
 
+struct vf_rpmdigest;
+
 struct vf_request {
     unsigned  flags;
     
@@ -47,6 +49,7 @@ struct vf_request {
     int       dest_fdoff;
     
     void      *bar;             /* progress bar */
+    struct vf_rpmdigest *digest; /* VF_FETCH_RPMDIGEST */
 
     /* filled by module's stat()s */
     time_t    st_remote_mtime;